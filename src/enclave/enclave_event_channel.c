@@ -23,6 +23,10 @@ static enc_dev_config_t* _enc_dev_config = NULL;
 static bool _event_channel_initialized = false;
 static uint8_t _evt_channel_num;
 
+/* Bitmap of devices with events signalled while their task was waiting, set
+ * by the host */
+static uint64_t* _evt_chn_pending;
+
 /*
  * Function to check whether virtio event channel task should stop or not
  */
@@ -57,9 +61,10 @@ static inline void vio_wait_for_host_event(
 }
 
 /*
- * Function to check whether sleeping event channel task needs wake up or not
+ * Function to check whether the event channel task is waiting while events
+ * are available for it
  */
-static inline int vio_signal_evt_channel(uint8_t dev_id)
+static inline int vio_evt_channel_has_events(uint8_t dev_id)
 {
     enc_evt_channel_t* evt_channel = _enc_dev_config[dev_id].enc_evt_chn;
     evt_t* processed = &_enc_dev_config[dev_id].evt_processed;
@@ -67,10 +72,18 @@ static inline int vio_signal_evt_channel(uint8_t dev_id)
 
     evt_t cur = __atomic_load_n(evt_chn, __ATOMIC_SEQ_CST);
 
+    return (cur & 1) && (cur > (*processed + 1));
+}
+
+/*
+ * Function to check whether sleeping event channel task needs wake up or not
+ */
+static inline int vio_signal_evt_channel(uint8_t dev_id)
+{
     struct lthread* lt = vio_tasks[dev_id];
     int state = __atomic_load_n(&lt->attr.state, __ATOMIC_SEQ_CST);
 
-    if ((cur & 1) && (cur > (*processed + 1)) && (state & BIT(LT_ST_SLEEPING)))
+    if (vio_evt_channel_has_events(dev_id) && (state & BIT(LT_ST_SLEEPING)))
         return 1;
     return 0;
 }
@@ -138,10 +151,12 @@ static void vio_enclave_process_host_event(uint8_t* param)
  */
 void initialize_enclave_event_channel(
     enc_dev_config_t* enc_dev_config,
-    size_t evt_channel_num)
+    size_t evt_channel_num,
+    uint64_t* evt_chn_pending)
 {
     uint8_t* dev_id = NULL;
     _evt_channel_num = evt_channel_num;
+    _evt_chn_pending = evt_chn_pending;
 
     evt_chn_lock = (struct ticketlock**)oe_calloc_or_die(
         evt_channel_num,
@@ -194,9 +209,44 @@ void vio_enclave_notify_enclave_event(uint8_t dev_id, uint32_t qidx)
 
     *qidx_p = qidx;
 
+    __atomic_fetch_add(
+        &_enc_dev_config[dev_id].num_notifications, 1, __ATOMIC_RELAXED);
+
     /* host task sleeping, wake up (ocall) */
     if (cur & 1)
+    {
+        __atomic_fetch_add(
+            &_enc_dev_config[dev_id].num_ocalls, 1, __ATOMIC_RELAXED);
         sgxlkl_host_device_request(dev_id);
+    }
+}
+
+/*
+ * Function to wake up the event channel task of a device with a pending
+ * event. The pending bit is cleared before the channel is checked, so that
+ * an event signalled meanwhile sets it again. If the task has events but has
+ * not gone to sleep yet, the bit is set again to check the device later.
+ */
+static int vio_wakeup_pending_evt_channel(uint8_t dev_id)
+{
+    uint64_t* pending = &_evt_chn_pending[dev_id / 64];
+    uint64_t bit = 1UL << (dev_id % 64);
+    int rc;
+
+    if (ticket_trylock(evt_chn_lock[dev_id]) == EBUSY)
+        return 0;
+
+    __atomic_fetch_and(pending, ~bit, __ATOMIC_SEQ_CST);
+
+    rc = vio_signal_evt_channel(dev_id);
+    if (rc)
+        lthread_wakeup(vio_tasks[dev_id]);
+    else if (vio_evt_channel_has_events(dev_id))
+        __atomic_fetch_or(pending, bit, __ATOMIC_SEQ_CST);
+
+    ticket_unlock(evt_chn_lock[dev_id]);
+
+    return rc;
 }
 
 /*
@@ -210,17 +260,37 @@ int vio_enclave_wakeup_event_channel(void)
     if (!_event_channel_initialized)
         return 0;
 
-    /* Schedule picks up the available event channel processing */
-    for (uint8_t dev_id = 0; dev_id < _evt_channel_num; dev_id++)
+    /* All tasks are woken up to let them exit */
+    if (vio_shutdown_requested())
     {
-        if (ticket_trylock(evt_chn_lock[dev_id]) == EBUSY)
-            continue;
+        for (uint8_t dev_id = 0; dev_id < _evt_channel_num; dev_id++)
+        {
+            if (ticket_trylock(evt_chn_lock[dev_id]) == EBUSY)
+                continue;
 
-        int rc = vio_signal_evt_channel(dev_id);
-        if (rc || vio_shutdown_requested())
+            ret |= vio_signal_evt_channel(dev_id);
             lthread_wakeup(vio_tasks[dev_id]);
-        ret |= rc;
-        ticket_unlock(evt_chn_lock[dev_id]);
+            ticket_unlock(evt_chn_lock[dev_id]);
+        }
+        return ret;
+    }
+
+    /* Schedule picks up the event channels of the devices marked as pending
+     * by the host. The bitmap is in host memory, so bits beyond the last
+     * device are ignored. */
+    for (size_t i = 0; i < VIO_EVT_CHN_PENDING_WORDS(_evt_channel_num); i++)
+    {
+        uint64_t pending =
+            __atomic_load_n(&_evt_chn_pending[i], __ATOMIC_ACQUIRE);
+
+        while (pending)
+        {
+            size_t dev_id = i * 64 + __builtin_ctzll(pending);
+            pending &= pending - 1;
+            if (dev_id >= _evt_channel_num)
+                break;
+            ret |= vio_wakeup_pending_evt_channel(dev_id);
+        }
     }
 
     return ret;
@@ -1,4 +1,5 @@
 #include "lkl/asm/host_ops.h"
+#include "lkl/host_dir.h"
 #include "lkl/setup.h"
 
 #include <openenclave/internal/globals.h>
@@ -58,6 +59,17 @@ static void find_and_mount_disks()
     }
 
     lkl_mount_disks(&cfg->root, cfg->mounts, cfg->num_mounts, cfg->cwd);
+
+    if (cfg->host_dir.destination)
+    {
+        if (!shm->virtio_9p_mem)
+            sgxlkl_fail(
+                "Host directory for mount point '%s' has not been provided by "
+                "host.\n",
+                cfg->host_dir.destination);
+
+        lkl_mount_host_dir(&cfg->host_dir);
+    }
 }
 
 static void init_wireguard()
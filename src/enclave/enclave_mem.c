@@ -34,10 +34,23 @@ int mmap_files; // Allow MAP_PRIVATE or MAP_SHARED?
 
 static size_t used_pages =
     0; // Tracks the number of used pages for the mmap tracing
+static size_t peak_used_pages = 0; // Maximum number of used pages thus far
+
+// Allocation counters, protected by mmaplock
+static uint64_t mmap_num_fixed;
+static uint64_t mmap_num_hinted;
+static uint64_t mmap_num_searched;
+static uint64_t mmap_num_failed;
+static uint64_t mmap_num_munmap;
+
+// Counters updated outside of mmaplock (atomically)
+static _Atomic(uint64_t) mmap_num_anonymous;
+static _Atomic(uint64_t) mmap_num_file;
+static _Atomic(uint64_t) mmap_zeroed_bytes;
+static _Atomic(uint64_t) mmap_mprotect_ocalls;
 
 #if DEBUG
 extern int sgxlkl_trace_mmap;
-static size_t mmap_max_allocated = 0; // Maximum amount of memory used thus far
 #endif
 
 #define DIV_ROUNDUP(x, y) (((x) + ((y)-1)) / (y))
@@ -106,6 +119,101 @@ void enclave_mem_info(size_t* total, size_t* free)
     *free = (mmap_num_pages - used_pages) * PAGESIZE;
 }
 
+void enclave_mem_count_mapping(int file_backed)
+{
+    if (file_backed)
+        mmap_num_file++;
+    else
+        mmap_num_anonymous++;
+}
+
+void enclave_mem_get_stats(enclave_mem_stats_t* stats)
+{
+    size_t free_pages, largest = 0, extents = 0;
+    unsigned long start, end;
+
+    memset(stats, 0, sizeof(*stats));
+
+    ticket_lock(&mmaplock);
+
+    // Walk the free ranges of the allocation bitmap
+    start = find_next_zero_bit(mmap_bitmap, mmap_num_pages, 0);
+    while (start < mmap_num_pages)
+    {
+        end = find_next_bit(mmap_bitmap, mmap_num_pages, start);
+        if (end - start > largest)
+            largest = end - start;
+        extents++;
+        start = find_next_zero_bit(mmap_bitmap, mmap_num_pages, end);
+    }
+
+    free_pages = mmap_num_pages - used_pages;
+
+    stats->total_pages = mmap_num_pages;
+    stats->used_pages = used_pages;
+    stats->free_pages = free_pages;
+    stats->peak_used_pages = peak_used_pages;
+    stats->largest_free_pages = largest;
+    stats->free_extents = extents;
+    stats->num_fixed = mmap_num_fixed;
+    stats->num_hinted = mmap_num_hinted;
+    stats->num_searched = mmap_num_searched;
+    stats->num_failed = mmap_num_failed;
+    stats->num_munmap = mmap_num_munmap;
+
+    ticket_unlock(&mmaplock);
+
+    stats->frag_index =
+        free_pages ? ((free_pages - largest) * 10000) / free_pages : 0;
+    stats->num_anonymous = mmap_num_anonymous;
+    stats->num_file = mmap_num_file;
+    stats->zeroed_bytes = mmap_zeroed_bytes;
+    stats->mprotect_ocalls = mmap_mprotect_ocalls;
+}
+
+int enclave_mem_format_stats(char* buf, size_t len)
+{
+    enclave_mem_stats_t s;
+    enclave_mem_get_stats(&s);
+
+    return snprintf(
+        buf,
+        len,
+        "MmapTotal:      %10zu kB\n"
+        "MmapUsed:       %10zu kB\n"
+        "MmapFree:       %10zu kB\n"
+        "MmapPeakUsed:   %10zu kB\n"
+        "MmapLargestFree:%10zu kB\n"
+        "MmapFreeExtents:%10zu\n"
+        "MmapFragIndex:  %7zu.%02zu %%\n"
+        "MmapFixed:      %10lu\n"
+        "MmapHinted:     %10lu\n"
+        "MmapSearched:   %10lu\n"
+        "MmapAnonymous:  %10lu\n"
+        "MmapFile:       %10lu\n"
+        "MmapFailed:     %10lu\n"
+        "MunmapCalls:    %10lu\n"
+        "MmapZeroed:     %10lu kB\n"
+        "MprotectOcalls: %10lu\n",
+        s.total_pages * PAGE_SIZE / 1024,
+        s.used_pages * PAGE_SIZE / 1024,
+        s.free_pages * PAGE_SIZE / 1024,
+        s.peak_used_pages * PAGE_SIZE / 1024,
+        s.largest_free_pages * PAGE_SIZE / 1024,
+        s.free_extents,
+        s.frag_index / 100,
+        s.frag_index % 100,
+        s.num_fixed,
+        s.num_hinted,
+        s.num_searched,
+        s.num_anonymous,
+        s.num_file,
+        s.num_failed,
+        s.num_munmap,
+        s.zeroed_bytes / 1024,
+        s.mprotect_ocalls);
+}
+
 /*
  * Initializes the enclave memory management.
  *
@@ -193,14 +301,12 @@ void* enclave_mmap(
             // Get index for last page since the bitmap is used in reverse
             index_top = addr_to_index(addr) - (pages - 1);
 
-#if DEBUG
-            if (sgxlkl_trace_mmap)
-                replaced_pages = bitmap_count_set_bits(
-                    mmap_bitmap, mmap_num_pages, index_top, pages);
-#endif
+            replaced_pages = bitmap_count_set_bits(
+                mmap_bitmap, mmap_num_pages, index_top, pages);
 
             bitmap_set(mmap_bitmap, index_top, pages);
             ret = addr;
+            mmap_num_fixed++;
         }
     }
     // Allocation with address hint
@@ -215,6 +321,7 @@ void* enclave_mmap(
         {
             bitmap_set(mmap_bitmap, index_top, pages);
             ret = addr;
+            mmap_num_hinted++;
         }
     }
 
@@ -232,6 +339,7 @@ void* enclave_mmap(
             bitmap_set(mmap_bitmap, index_top, pages);
             size_t index = index_top + (pages - 1);
             ret = index_to_addr(index);
+            mmap_num_searched++;
         }
     }
 
@@ -254,6 +362,10 @@ void* enclave_mmap(
         // Allocated pages are no longer fresh
         bitmap_clear(mmap_fresh_bitmap, index_top, pages);
 
+        used_pages += pages - replaced_pages;
+        if (used_pages > peak_used_pages)
+            peak_used_pages = used_pages;
+
         // Release lock early
         ticket_unlock(&mmaplock);
 
@@ -267,15 +379,18 @@ void* enclave_mmap(
                 // Make pages writeable
                 sgxlkl_host_syscall_mprotect(
                     &mprotect_ret, ret, length, prot | PROT_WRITE);
+                mmap_mprotect_ocalls++;
             }
 
             // Set all allocated pages to zero
             memset(ret, 0, pages * PAGE_SIZE);
+            mmap_zeroed_bytes += pages * PAGE_SIZE;
 
             // Restore the correct page permissions
             if (prot != -1 && ((prot | PROT_WRITE) != prot))
             {
                 sgxlkl_host_syscall_mprotect(&mprotect_ret, ret, length, prot);
+                mmap_mprotect_ocalls++;
             }
         }
 
@@ -285,12 +400,13 @@ void* enclave_mmap(
         {
             // Set requested page permission
             sgxlkl_host_syscall_mprotect(&mprotect_ret, ret, length, prot);
+            mmap_mprotect_ocalls++;
         }
-
-        used_pages += pages - replaced_pages;
     }
     else
     {
+        mmap_num_failed++;
+
         // Release lock
         ticket_unlock(&mmaplock);
     }
@@ -302,10 +418,6 @@ void* enclave_mmap(
         size_t total = mmap_num_pages * PAGESIZE;
         size_t free = (mmap_num_pages - used_pages) * PAGESIZE;
         size_t used = total - free;
-        if (mmap_max_allocated < used)
-        {
-            mmap_max_allocated = used;
-        }
         char* mfixed = mmap_fixed ? " (MAP_FIXED)" : "";
         char* rv = (((intptr_t)ret) < 0) ? " (FAILED)" : "";
         SGXLKL_TRACE_MMAP(
@@ -313,7 +425,7 @@ void* enclave_mmap(
             "%8zuKB, ALLOCATED: %6zuKB (addr = %p, ret = %p) %s%s\n",
             total / 1024,
             used / 1024,
-            mmap_max_allocated / 1024,
+            peak_used_pages * PAGESIZE / 1024,
             free / 1024,
             requested / 1024,
             addr,
@@ -349,6 +461,7 @@ long enclave_munmap(void* addr, size_t length)
     size_t occupied_pages =
         bitmap_count_set_bits(mmap_bitmap, mmap_num_pages, index_top, pages);
     used_pages -= occupied_pages;
+    mmap_num_munmap++;
 
     bitmap_clear(mmap_bitmap, index_top, pages);
     ticket_unlock(&mmaplock);
@@ -365,7 +478,7 @@ long enclave_munmap(void* addr, size_t length)
             "FREE: %8zuKB,     FREED: %6zuKB (addr = %p)\n",
             total / 1024,
             used / 1024,
-            mmap_max_allocated / 1024,
+            peak_used_pages * PAGESIZE / 1024,
             free / 1024,
             requested / 1024,
             addr);
@@ -325,9 +325,17 @@ static void _copy_shared_memory(const sgxlkl_shared_memory_t* host)
     if (cfg->io.console)
         enc->virtio_console_mem = host->virtio_console_mem;
 
+    if (cfg->io.vsock)
+        enc->virtio_vsock_mem = host->virtio_vsock_mem;
+
+    if (cfg->host_dir.destination)
+        enc->virtio_9p_mem = host->virtio_9p_mem;
+
     enc->evt_channel_num = host->evt_channel_num;
     /* enc_dev_config is required to be outside the enclave */
     enc->enc_dev_config = host->enc_dev_config;
+    /* evt_chn_pending is required to be outside the enclave */
+    enc->evt_chn_pending = host->evt_chn_pending;
 
     enc->virtio_swiotlb = host->virtio_swiotlb;
     enc->virtio_swiotlb_size = host->virtio_swiotlb_size;
@@ -0,0 +1,496 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <host/host_cow.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HOST_COW_MAGIC "SGXLKCOW"
+#define HOST_COW_VERSION 2
+
+/* Bytes at the start of the base image that identify it, besides its last
+ * cluster. They hold the partition table or the superblock, with its UUID
+ * and timestamps, of the file system on the image. */
+#define HOST_COW_ID_LEN (64 * 1024)
+
+struct host_cow_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t cluster_size;
+    /* Size of the base image and thus of the disk */
+    uint64_t size;
+    uint64_t bitmap_offset;
+    uint64_t data_offset;
+    /* Hash of the start and the end of the base image */
+    uint64_t base_id;
+};
+
+struct host_cow
+{
+    int base_fd;
+    int fd;
+    uint64_t size;
+    uint64_t num_clusters;
+    uint64_t bitmap_offset;
+    uint64_t data_offset;
+
+    /* In-memory copy of the bitmap. Bits are only set with the lock held,
+     * but are tested without it. */
+    uint8_t* bitmap;
+    pthread_mutex_t lock;
+
+    /* Range of bitmap bytes that changed since they were last written to
+     * the delta file. Bits are only written once the data of their clusters
+     * is durable, so that a crash cannot leave a bit set for a cluster whose
+     * data is missing. */
+    size_t dirty_start;
+    size_t dirty_end;
+
+    /* Statistics */
+    uint64_t num_allocated;
+    uint64_t num_copied;
+};
+
+static uint64_t round_up(uint64_t x, uint64_t align)
+{
+    return (x + align - 1) / align * align;
+}
+
+static bool cow_allocated(struct host_cow* cow, uint64_t c)
+{
+    return __atomic_load_n(&cow->bitmap[c / 8], __ATOMIC_ACQUIRE) &
+           (1 << (c % 8));
+}
+
+/* Add bitmap bytes start to end (exclusive) to the dirty range. Must be
+ * called with the lock held. */
+static void cow_mark_dirty(struct host_cow* cow, size_t start, size_t end)
+{
+    if (cow->dirty_start == cow->dirty_end)
+    {
+        cow->dirty_start = start;
+        cow->dirty_end = end;
+    }
+    else
+    {
+        if (start < cow->dirty_start)
+            cow->dirty_start = start;
+        if (end > cow->dirty_end)
+            cow->dirty_end = end;
+    }
+}
+
+/*
+ * Mark clusters first to last as stored in the delta file, whose data must
+ * have been written. The bitmap is written by host_cow_fsync. Must be
+ * called with the lock held.
+ */
+static void cow_mark_allocated(
+    struct host_cow* cow,
+    uint64_t first,
+    uint64_t last)
+{
+    for (uint64_t c = first; c <= last; c++)
+    {
+        if (cow_allocated(cow, c))
+            continue;
+        __atomic_fetch_or(&cow->bitmap[c / 8], 1 << (c % 8), __ATOMIC_RELEASE);
+        cow->num_allocated++;
+    }
+
+    cow_mark_dirty(cow, first / 8, last / 8 + 1);
+}
+
+/*
+ * Copy a cluster from the base image into the delta file. Must be called
+ * with the lock held.
+ */
+static int cow_copy_up(struct host_cow* cow, uint64_t c)
+{
+    uint64_t offset = c * HOST_COW_CLUSTER_SIZE;
+    ssize_t len = cow->size - offset < HOST_COW_CLUSTER_SIZE
+                      ? cow->size - offset
+                      : HOST_COW_CLUSTER_SIZE;
+    char buf[HOST_COW_CLUSTER_SIZE];
+
+    errno = 0;
+    if (pread(cow->base_fd, buf, len, offset) != len ||
+        pwrite(cow->fd, buf, len, cow->data_offset + offset) != len)
+    {
+        if (!errno)
+            errno = EIO;
+        return -1;
+    }
+
+    cow->num_copied++;
+    cow_mark_allocated(cow, c, c);
+    return 0;
+}
+
+/*
+ * Set up sub to refer to len bytes of iov starting at byte pos. Returns the
+ * number of entries of sub.
+ */
+static int iov_slice(
+    const struct iovec* iov,
+    int iovcnt,
+    size_t pos,
+    size_t len,
+    struct iovec* sub)
+{
+    int n = 0;
+
+    for (int i = 0; i < iovcnt && len; i++)
+    {
+        if (pos >= iov[i].iov_len)
+        {
+            pos -= iov[i].iov_len;
+            continue;
+        }
+
+        sub[n].iov_base = (char*)iov[i].iov_base + pos;
+        sub[n].iov_len =
+            iov[i].iov_len - pos < len ? iov[i].iov_len - pos : len;
+        len -= sub[n].iov_len;
+        pos = 0;
+        n++;
+    }
+
+    return n;
+}
+
+static size_t iov_len(const struct iovec* iov, int iovcnt)
+{
+    size_t len = 0;
+
+    for (int i = 0; i < iovcnt; i++)
+        len += iov[i].iov_len;
+
+    return len;
+}
+
+/* 64-bit FNV-1a hash of len bytes of buf, continuing from hash */
+static uint64_t fnv1a(uint64_t hash, const uint8_t* buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= buf[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/*
+ * Compute the identifier of the base image, so that a delta file is not
+ * applied to a different image of the same size, e.g. a rebuilt one
+ */
+static int cow_base_id(int base_fd, uint64_t size, uint64_t* id)
+{
+    uint8_t buf[HOST_COW_CLUSTER_SIZE];
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t offset = 0;
+    uint64_t last = size > HOST_COW_CLUSTER_SIZE ? size - HOST_COW_CLUSTER_SIZE
+                                                 : 0;
+
+    errno = 0;
+    while (offset < size && offset < HOST_COW_ID_LEN)
+    {
+        ssize_t len = size - offset < sizeof(buf) ? size - offset : sizeof(buf);
+        if (pread(base_fd, buf, len, offset) != len)
+            return errno ? -errno : -EIO;
+        hash = fnv1a(hash, buf, len);
+        offset += len;
+    }
+
+    if (last >= offset)
+    {
+        ssize_t len = size - last;
+        if (pread(base_fd, buf, len, last) != len)
+            return errno ? -errno : -EIO;
+        hash = fnv1a(hash, buf, len);
+    }
+
+    *id = hash;
+    return 0;
+}
+
+int host_cow_open(
+    struct host_cow** cow_out,
+    int base_fd,
+    uint64_t base_size,
+    int fd)
+{
+    struct host_cow_header hdr;
+    struct host_cow* cow;
+    struct stat st;
+    size_t bitmap_size;
+    uint64_t base_id;
+    int err;
+
+    if (fstat(fd, &st) < 0)
+        return -errno;
+
+    err = cow_base_id(base_fd, base_size, &base_id);
+    if (err < 0)
+        return err;
+
+    cow = calloc(1, sizeof(*cow));
+    if (!cow)
+        return -ENOMEM;
+
+    cow->base_fd = base_fd;
+    cow->fd = fd;
+    cow->size = base_size;
+    cow->num_clusters = round_up(base_size, HOST_COW_CLUSTER_SIZE) /
+                        HOST_COW_CLUSTER_SIZE;
+    bitmap_size = round_up(cow->num_clusters, 8) / 8;
+    cow->bitmap_offset = HOST_COW_CLUSTER_SIZE;
+    cow->data_offset =
+        cow->bitmap_offset + round_up(bitmap_size, HOST_COW_CLUSTER_SIZE);
+    pthread_mutex_init(&cow->lock, NULL);
+
+    cow->bitmap = calloc(1, bitmap_size);
+    if (!cow->bitmap)
+    {
+        err = -ENOMEM;
+        goto fail;
+    }
+
+    if (st.st_size == 0)
+    {
+        /* New delta file: only the header is written, the bitmap and the
+         * data area are holes */
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, HOST_COW_MAGIC, sizeof(hdr.magic));
+        hdr.version = HOST_COW_VERSION;
+        hdr.cluster_size = HOST_COW_CLUSTER_SIZE;
+        hdr.size = cow->size;
+        hdr.bitmap_offset = cow->bitmap_offset;
+        hdr.data_offset = cow->data_offset;
+        hdr.base_id = base_id;
+
+        if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+            ftruncate(fd, cow->data_offset + cow->size) < 0)
+        {
+            err = errno ? -errno : -EIO;
+            goto fail;
+        }
+    }
+    else
+    {
+        if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+            memcmp(hdr.magic, HOST_COW_MAGIC, sizeof(hdr.magic)) != 0 ||
+            hdr.version != HOST_COW_VERSION ||
+            hdr.cluster_size != HOST_COW_CLUSTER_SIZE ||
+            hdr.size != cow->size ||
+            hdr.bitmap_offset != cow->bitmap_offset ||
+            hdr.data_offset != cow->data_offset ||
+            hdr.base_id != base_id)
+        {
+            err = -EINVAL;
+            goto fail;
+        }
+
+        if (pread(fd, cow->bitmap, bitmap_size, cow->bitmap_offset) !=
+            (ssize_t)bitmap_size)
+        {
+            err = -EINVAL;
+            goto fail;
+        }
+
+        for (size_t i = 0; i < bitmap_size; i++)
+            cow->num_allocated += __builtin_popcount(cow->bitmap[i]);
+    }
+
+    *cow_out = cow;
+    return 0;
+
+fail:
+    free(cow->bitmap);
+    free(cow);
+    return err;
+}
+
+void host_cow_close(struct host_cow* cow)
+{
+    host_cow_fsync(cow);
+    close(cow->fd);
+    free(cow->bitmap);
+    free(cow);
+}
+
+ssize_t host_cow_preadv(
+    struct host_cow* cow,
+    const struct iovec* iov,
+    int iovcnt,
+    off_t offset)
+{
+    size_t len = iov_len(iov, iovcnt);
+    struct iovec sub[iovcnt];
+    size_t pos = 0, end;
+    ssize_t ret;
+    int n;
+
+    if (offset < 0 || offset + len > cow->size)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Read runs of clusters that are all in the base image or all in the
+     * delta file with a single system call each */
+    while (pos < len)
+    {
+        uint64_t c = (offset + pos) / HOST_COW_CLUSTER_SIZE;
+        bool allocated = cow_allocated(cow, c);
+
+        do
+        {
+            c++;
+            end = c * HOST_COW_CLUSTER_SIZE - offset;
+        } while (end < len && cow_allocated(cow, c) == allocated);
+        if (end > len)
+            end = len;
+
+        n = iov_slice(iov, iovcnt, pos, end - pos, sub);
+        if (allocated)
+            ret = preadv(cow->fd, sub, n, cow->data_offset + offset + pos);
+        else
+            ret = preadv(cow->base_fd, sub, n, offset + pos);
+        if (ret < 0)
+            return -1;
+        if ((size_t)ret != end - pos)
+        {
+            errno = EIO;
+            return -1;
+        }
+
+        pos = end;
+    }
+
+    return len;
+}
+
+ssize_t host_cow_pwritev(
+    struct host_cow* cow,
+    const struct iovec* iov,
+    int iovcnt,
+    off_t offset)
+{
+    size_t len = iov_len(iov, iovcnt);
+    uint64_t first, last;
+    bool allocated = true;
+    ssize_t ret;
+
+    if (offset < 0 || offset + len > cow->size)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (len == 0)
+        return 0;
+
+    first = offset / HOST_COW_CLUSTER_SIZE;
+    last = (offset + len - 1) / HOST_COW_CLUSTER_SIZE;
+    for (uint64_t c = first; c <= last && allocated; c++)
+        allocated = cow_allocated(cow, c);
+
+    /* Writes to clusters in the delta file go straight to it */
+    if (allocated)
+        return pwritev(cow->fd, iov, iovcnt, cow->data_offset + offset);
+
+    /* Otherwise, the clusters are allocated with the lock held, so that a
+     * concurrent copy-up cannot overwrite the data of this write */
+    pthread_mutex_lock(&cow->lock);
+
+    /* Clusters that are only partially written keep the rest of their
+     * data from the base image */
+    ret = 0;
+    if (offset % HOST_COW_CLUSTER_SIZE && !cow_allocated(cow, first))
+        ret = cow_copy_up(cow, first);
+    if (!ret && (offset + len) % HOST_COW_CLUSTER_SIZE &&
+        !cow_allocated(cow, last))
+        ret = cow_copy_up(cow, last);
+
+    if (!ret)
+        ret = pwritev(cow->fd, iov, iovcnt, cow->data_offset + offset);
+    if (ret >= 0)
+        cow_mark_allocated(cow, first, last);
+
+    pthread_mutex_unlock(&cow->lock);
+
+    return ret;
+}
+
+int host_cow_fsync(struct host_cow* cow)
+{
+    size_t start, end;
+    uint8_t* bits = NULL;
+    int ret = 0;
+
+    /* Take a copy of the changed bitmap bytes. Their clusters have been
+     * written already, bits set later are written by the next call. */
+    pthread_mutex_lock(&cow->lock);
+    start = cow->dirty_start;
+    end = cow->dirty_end;
+    if (start != end)
+    {
+        bits = malloc(end - start);
+        if (bits)
+        {
+            memcpy(bits, cow->bitmap + start, end - start);
+            cow->dirty_start = cow->dirty_end = 0;
+        }
+    }
+    pthread_mutex_unlock(&cow->lock);
+
+    if (start != end && !bits)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* The data must be durable before the bits that refer to it */
+    if (fdatasync(cow->fd) < 0)
+        ret = -1;
+    else if (bits)
+    {
+        errno = 0;
+        if (pwrite(cow->fd, bits, end - start, cow->bitmap_offset + start) !=
+                (ssize_t)(end - start) ||
+            fdatasync(cow->fd) < 0)
+        {
+            if (!errno)
+                errno = EIO;
+            ret = -1;
+        }
+    }
+
+    /* Keep the bytes dirty if they could not be written */
+    if (ret < 0 && bits)
+    {
+        pthread_mutex_lock(&cow->lock);
+        cow_mark_dirty(cow, start, end);
+        pthread_mutex_unlock(&cow->lock);
+    }
+
+    free(bits);
+    return ret;
+}
+
+void host_cow_get_stats(
+    struct host_cow* cow,
+    uint64_t* num_allocated,
+    uint64_t* num_copied)
+{
+    pthread_mutex_lock(&cow->lock);
+    *num_allocated = cow->num_allocated;
+    *num_copied = cow->num_copied;
+    pthread_mutex_unlock(&cow->lock);
+}
@@ -4,11 +4,13 @@
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
 #include <host/virtio_debug.h>
+#include <inttypes.h>
 
 #define LKL_SHUTDOWN_NOTIFICATION 1
 
 static host_dev_config_t* _dev_cfg;
 static uint8_t _evt_chn_num;
+static uint64_t* _evt_chn_pending;
 
 /* notifier to notify the host device task for the LKL shutdown event */
 static _Atomic(int) sgxlkl_shutdown_notifier = 0;
@@ -63,15 +65,48 @@ static inline int _vio_host_wait_for_enclave_event(
     return 0;
 }
 
+/*
+ * Function to spin for an event from guest. Returns 1 if an event arrived,
+ * in which case it has been marked as processed.
+ */
+static inline int _vio_host_spin_for_enclave_event(host_dev_config_t* cfg)
+{
+    evt_t* evt_chn = &cfg->host_evt_chn->host_evt_channel;
+    struct timespec start, now;
+    evt_t cur;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            cur = __atomic_load_n(evt_chn, __ATOMIC_SEQ_CST);
+            if (cur != cfg->evt_processed)
+            {
+                cfg->evt_processed = cur;
+                return 1;
+            }
+            __builtin_ia32_pause();
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((uint64_t)(now.tv_sec - start.tv_sec) * NSEC_PER_SECOND +
+                 now.tv_nsec - start.tv_nsec <
+             cfg->spin_ns);
+
+    return 0;
+}
+
 /*
  * Function to initialize the device event handler
  */
 void vio_host_initialize_device_cfg(
     host_dev_config_t* dev_cfg,
-    uint8_t evt_channel_num)
+    uint8_t evt_channel_num,
+    uint64_t* evt_chn_pending)
 {
     _dev_cfg = dev_cfg;
     _evt_chn_num = evt_channel_num;
+    _evt_chn_pending = evt_chn_pending;
 
     return;
 }
@@ -82,7 +117,10 @@ void vio_host_initialize_device_cfg(
 void sgxlkl_host_handle_device_request(uint8_t dev_id)
 {
     host_dev_config_t* dev_config = &_dev_cfg[dev_id];
-    pthread_cond_signal(&dev_config->cond);
+    if (dev_config->wakeup)
+        dev_config->wakeup(dev_id);
+    else
+        pthread_cond_signal(&dev_config->cond);
     return;
 }
 
@@ -94,6 +132,15 @@ void vio_host_process_enclave_event(uint8_t dev_id, int timeout_ms)
     host_dev_config_t* dev_config = &_dev_cfg[dev_id];
     host_evt_channel_t* evt_chn = dev_config->host_evt_chn;
     evt_t* evt_processed = &dev_config->evt_processed;
+
+    /* The waiting bit is not set while spinning, so the guest notifies the
+     * thread without an ocall */
+    if (dev_config->spin_ns && _vio_host_spin_for_enclave_event(dev_config))
+    {
+        dev_config->num_spin_wakeups++;
+        return;
+    }
+
     pthread_mutex_lock(&dev_config->lock);
 
     evt_t desired = *evt_processed + 1;
@@ -112,6 +159,7 @@ void vio_host_process_enclave_event(uint8_t dev_id, int timeout_ms)
     }
 
     /* wait for an event */
+    dev_config->num_sleeps++;
     _vio_host_wait_for_enclave_event(
         dev_config, &evt_chn->host_evt_channel, desired, timeout_ms);
     assert(desired & 1);
@@ -123,6 +171,41 @@ void vio_host_process_enclave_event(uint8_t dev_id, int timeout_ms)
     return;
 }
 
+/*
+ * Function to ask for a notification of the next event from guest
+ */
+int vio_host_arm_enclave_event(uint8_t dev_id)
+{
+    host_dev_config_t* dev_config = &_dev_cfg[dev_id];
+    evt_t* evt_processed = &dev_config->evt_processed;
+
+    assert((*evt_processed & 1) == 0);
+
+    /* On failure, the current value of the channel is stored as processed */
+    if (!__atomic_compare_exchange_n(
+            &dev_config->host_evt_chn->host_evt_channel,
+            evt_processed,
+            *evt_processed + 1,
+            false,
+            __ATOMIC_SEQ_CST,
+            __ATOMIC_SEQ_CST))
+        return 0;
+
+    dev_config->num_sleeps++;
+    return 1;
+}
+
+/*
+ * Function to stop the notifications of events from guest
+ */
+void vio_host_disarm_enclave_event(uint8_t dev_id)
+{
+    host_dev_config_t* dev_config = &_dev_cfg[dev_id];
+
+    dev_config->evt_processed = __atomic_add_fetch(
+        &dev_config->host_evt_chn->host_evt_channel, -1, __ATOMIC_SEQ_CST);
+}
+
 /*
  * Function to wake up the guest device event handler
  */
@@ -140,9 +223,60 @@ void vio_host_notify_host_event(uint8_t dev_id)
     evt_t cur =
         __atomic_add_fetch(evt->enclave_evt_channel, 2, __ATOMIC_SEQ_CST);
 
-    /* wakeup sleeping ethread notifying an events */
+    /* The enclave device task is waiting: mark the device as pending for the
+     * enclave scheduler and wakeup sleeping ethread notifying an events */
     if (cur & 1)
+    {
+        __atomic_fetch_or(
+            &_evt_chn_pending[dev_id / 64],
+            1UL << (dev_id % 64),
+            __ATOMIC_SEQ_CST);
         sgxlkl_signal_vio_event();
+    }
+}
+
+/*
+ * Function to set the spin time of a device thread
+ */
+void vio_host_set_device_spin(uint8_t dev_id, uint64_t spin_us)
+{
+    _dev_cfg[dev_id].spin_ns = spin_us * 1000;
+}
+
+/*
+ * Function to set the wake-up callback of a device
+ */
+void vio_host_set_device_wakeup(uint8_t dev_id, void (*wakeup)(uint8_t dev_id))
+{
+    _dev_cfg[dev_id].wakeup = wakeup;
+}
+
+/*
+ * Function to print the wake-up statistics of all devices
+ */
+void vio_host_print_dev_stats(void)
+{
+    if (!_dev_cfg)
+        return;
+
+    for (int dev_id = 0; dev_id < _evt_chn_num; dev_id++)
+    {
+        host_dev_config_t* cfg = &_dev_cfg[dev_id];
+        enc_dev_config_t* ecfg = cfg->enc_dev_cfg;
+        uint64_t notifications =
+            __atomic_load_n(&ecfg->num_notifications, __ATOMIC_RELAXED);
+        uint64_t ocalls = __atomic_load_n(&ecfg->num_ocalls, __ATOMIC_RELAXED);
+
+        sgxlkl_host_verbose(
+            "Device %d: %" PRIu64 " spin wake-ups, %" PRIu64 " sleeps, %" PRIu64
+            " notifications, %" PRIu64 " ocalls, %" PRIu64 " ocalls avoided\n",
+            dev_id,
+            cfg->num_spin_wakeups,
+            cfg->num_sleeps,
+            notifications,
+            ocalls,
+            notifications - ocalls);
+    }
 }
 
 /*
@@ -0,0 +1,228 @@
+#include <errno.h>
+#include <host/host_io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HOST_HAVE_IO_URING 1
+#endif
+
+#ifdef HOST_HAVE_IO_URING
+
+struct host_uring
+{
+    int fd;
+
+    /* Submission queue */
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned sq_entries;
+    unsigned to_submit;
+
+    /* Completion queue */
+    void* cq_ring;
+    size_t cq_ring_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+};
+
+int host_uring_init(struct host_uring** ring, unsigned entries)
+{
+    struct io_uring_params p;
+    struct host_uring* r;
+
+    r = calloc(1, sizeof(*r));
+    if (!r)
+        return -ENOMEM;
+
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+    {
+        int err = errno;
+        free(r);
+        return -err;
+    }
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ring = mmap(
+        NULL,
+        r->sq_ring_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        r->fd,
+        IORING_OFF_SQ_RING);
+    r->cq_ring = mmap(
+        NULL,
+        r->cq_ring_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        r->fd,
+        IORING_OFF_CQ_RING);
+    r->sqes = mmap(
+        NULL,
+        r->sqes_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        r->fd,
+        IORING_OFF_SQES);
+    if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED ||
+        r->sqes == MAP_FAILED)
+    {
+        int err = errno;
+        host_uring_destroy(r);
+        return -err;
+    }
+
+    r->sq_head = (unsigned*)((char*)r->sq_ring + p.sq_off.head);
+    r->sq_tail = (unsigned*)((char*)r->sq_ring + p.sq_off.tail);
+    r->sq_mask = (unsigned*)((char*)r->sq_ring + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)((char*)r->sq_ring + p.sq_off.array);
+    r->sq_entries = p.sq_entries;
+
+    r->cq_head = (unsigned*)((char*)r->cq_ring + p.cq_off.head);
+    r->cq_tail = (unsigned*)((char*)r->cq_ring + p.cq_off.tail);
+    r->cq_mask = (unsigned*)((char*)r->cq_ring + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)((char*)r->cq_ring + p.cq_off.cqes);
+
+    *ring = r;
+    return 0;
+}
+
+void host_uring_destroy(struct host_uring* r)
+{
+    if (r->sq_ring && r->sq_ring != MAP_FAILED)
+        munmap(r->sq_ring, r->sq_ring_size);
+    if (r->cq_ring && r->cq_ring != MAP_FAILED)
+        munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_size);
+    close(r->fd);
+    free(r);
+}
+
+int host_uring_prep(
+    struct host_uring* r,
+    int op,
+    int fd,
+    const struct iovec* iov,
+    unsigned iovcnt,
+    uint64_t offset,
+    void* user_data)
+{
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *r->sq_tail;
+
+    if (tail - head >= r->sq_entries)
+        return -EBUSY;
+
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    /* The kernel rejects an fsync with a buffer, length or offset */
+    if (op != HOST_URING_OP_FSYNC)
+    {
+        sqe->addr = (uint64_t)(uintptr_t)iov;
+        sqe->len = iovcnt;
+        sqe->off = offset;
+    }
+    sqe->user_data = (uint64_t)(uintptr_t)user_data;
+
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+
+    return 0;
+}
+
+int host_uring_submit(struct host_uring* r, unsigned wait_nr)
+{
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+
+    do
+    {
+        ret = syscall(
+            __NR_io_uring_enter, r->fd, r->to_submit, wait_nr, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0)
+        return -errno;
+
+    r->to_submit -= ret;
+    return ret;
+}
+
+int host_uring_reap(struct host_uring* r, void** user_data, int* res)
+{
+    unsigned head = *r->cq_head;
+
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+
+    struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+    *user_data = (void*)(uintptr_t)cqe->user_data;
+    *res = cqe->res;
+
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+#else
+
+struct host_uring
+{
+    int unused;
+};
+
+int host_uring_init(struct host_uring** ring, unsigned entries)
+{
+    return -ENOSYS;
+}
+
+void host_uring_destroy(struct host_uring* ring)
+{
+}
+
+int host_uring_prep(
+    struct host_uring* ring,
+    int op,
+    int fd,
+    const struct iovec* iov,
+    unsigned iovcnt,
+    uint64_t offset,
+    void* user_data)
+{
+    return -ENOSYS;
+}
+
+int host_uring_submit(struct host_uring* ring, unsigned wait_nr)
+{
+    return -ENOSYS;
+}
+
+int host_uring_reap(struct host_uring* ring, void** user_data, int* res)
+{
+    return 0;
+}
+
+#endif /* HOST_HAVE_IO_URING */
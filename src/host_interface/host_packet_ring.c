@@ -0,0 +1,307 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <host/host_packet_ring.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* The kernel hands over a partially filled RX block after this timeout */
+#define RX_BLOCK_TIMEOUT_MS 1
+#define RX_BLOCK_SIZE (256 * 1024)
+#define RX_NUM_BLOCKS 16
+/* Only used to satisfy the ring setup checks, TPACKET_V3 RX frames are
+ * variable-sized */
+#define RX_FRAME_SIZE 2048
+
+#define TX_BLOCK_SIZE (256 * 1024)
+#define TX_NUM_BLOCKS 4
+#define TX_MIN_FRAME_SIZE 2048
+
+/* Offset of the packet data in a TX frame */
+#define TX_DATA_OFFSET (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+
+#define VLAN_HLEN 4
+
+int host_packet_socket_open(const char* ifname)
+{
+    struct sockaddr_ll addr;
+    struct packet_mreq mreq;
+    int version = TPACKET_V3;
+    int one = 1;
+    int fd, err;
+
+    unsigned int ifindex = if_nametoindex(ifname);
+    if (!ifindex)
+        return -errno;
+
+    fd = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+
+    /* The ring version must be set before the rings are set up */
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)))
+        goto err;
+
+    /* Transmit directly to the device; the enclave does its own queuing */
+    setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = ifindex;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)))
+        goto err;
+
+    /* The enclave uses its own MAC address */
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(
+            fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)))
+        goto err;
+
+    return fd;
+
+err:
+    err = errno;
+    close(fd);
+    return -err;
+}
+
+/*
+ * Get the size of TX frames, which must hold a packet of the MTU of the
+ * interface the socket is bound to
+ */
+static size_t tx_frame_size(int fd)
+{
+    struct sockaddr_ll addr;
+    socklen_t addr_len = sizeof(addr);
+    struct ifreq ifr;
+    size_t len, size = TX_MIN_FRAME_SIZE;
+
+    memset(&ifr, 0, sizeof(ifr));
+    if (getsockname(fd, (struct sockaddr*)&addr, &addr_len) ||
+        !if_indextoname(addr.sll_ifindex, ifr.ifr_name) ||
+        ioctl(fd, SIOCGIFMTU, &ifr))
+        return size;
+
+    len = TX_DATA_OFFSET + ETH_HLEN + VLAN_HLEN + ifr.ifr_mtu;
+    while (size < len && size < TX_BLOCK_SIZE)
+        size *= 2;
+    return size;
+}
+
+int host_packet_ring_init(struct host_packet_ring* ring, int fd)
+{
+    struct tpacket_req3 rx_req, tx_req;
+    size_t rx_size, tx_size;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = fd;
+    ring->rx_block_size = RX_BLOCK_SIZE;
+    ring->rx_num_blocks = RX_NUM_BLOCKS;
+    ring->tx_frame_size = tx_frame_size(fd);
+    ring->tx_num_frames =
+        TX_BLOCK_SIZE / ring->tx_frame_size * TX_NUM_BLOCKS;
+
+    memset(&rx_req, 0, sizeof(rx_req));
+    rx_req.tp_block_size = RX_BLOCK_SIZE;
+    rx_req.tp_block_nr = RX_NUM_BLOCKS;
+    rx_req.tp_frame_size = RX_FRAME_SIZE;
+    rx_req.tp_frame_nr = RX_BLOCK_SIZE / RX_FRAME_SIZE * RX_NUM_BLOCKS;
+    rx_req.tp_retire_blk_tov = RX_BLOCK_TIMEOUT_MS;
+
+    memset(&tx_req, 0, sizeof(tx_req));
+    tx_req.tp_block_size = TX_BLOCK_SIZE;
+    tx_req.tp_block_nr = TX_NUM_BLOCKS;
+    tx_req.tp_frame_size = ring->tx_frame_size;
+    tx_req.tp_frame_nr = ring->tx_num_frames;
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &rx_req, sizeof(rx_req)) ||
+        setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &tx_req, sizeof(tx_req)))
+        return -errno;
+
+    /* Both rings are mapped at once, the TX ring follows the RX ring */
+    rx_size = (size_t)RX_BLOCK_SIZE * RX_NUM_BLOCKS;
+    tx_size = (size_t)TX_BLOCK_SIZE * TX_NUM_BLOCKS;
+    ring->map_size = rx_size + tx_size;
+    ring->rx_map = mmap(
+        NULL,
+        ring->map_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_LOCKED,
+        fd,
+        0);
+    if (ring->rx_map == MAP_FAILED)
+    {
+        /* Locking the rings is an optimization only */
+        ring->rx_map = mmap(
+            NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ring->rx_map == MAP_FAILED)
+        {
+            ring->rx_map = NULL;
+            return -errno;
+        }
+    }
+    ring->tx_map = ring->rx_map + rx_size;
+
+    return 0;
+}
+
+void host_packet_ring_destroy(struct host_packet_ring* ring)
+{
+    if (ring->rx_map)
+        munmap(ring->rx_map, ring->map_size);
+    ring->rx_map = ring->tx_map = NULL;
+    close(ring->fd);
+}
+
+static inline struct tpacket_block_desc* rx_block(
+    struct host_packet_ring* ring,
+    unsigned idx)
+{
+    uint8_t* block = ring->rx_map + idx * ring->rx_block_size;
+    return (struct tpacket_block_desc*)block;
+}
+
+/* Return the current RX block to the kernel and move on to the next one */
+static void rx_release_block(struct host_packet_ring* ring)
+{
+    struct tpacket_block_desc* bd = rx_block(ring, ring->rx_block_idx);
+
+    __sync_synchronize();
+    bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    ring->rx_block_idx = (ring->rx_block_idx + 1) % ring->rx_num_blocks;
+}
+
+/* Copy len bytes from data to iov, returns the number of bytes copied */
+static size_t copy_to_iov(
+    const struct iovec* iov,
+    int iovcnt,
+    const uint8_t* data,
+    size_t len)
+{
+    size_t copied = 0;
+
+    for (int i = 0; i < iovcnt && copied < len; i++)
+    {
+        size_t n = len - copied;
+        if (n > iov[i].iov_len)
+            n = iov[i].iov_len;
+        memcpy(iov[i].iov_base, data + copied, n);
+        copied += n;
+    }
+    return copied;
+}
+
+ssize_t host_packet_ring_recv(
+    struct host_packet_ring* ring,
+    const struct iovec* iov,
+    int iovcnt)
+{
+    for (;;)
+    {
+        if (!ring->rx_pkts_left)
+        {
+            struct tpacket_block_desc* bd =
+                rx_block(ring, ring->rx_block_idx);
+
+            if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+                return -EAGAIN;
+
+            /* Read the block contents only after its status */
+            __sync_synchronize();
+
+            if (!bd->hdr.bh1.num_pkts)
+            {
+                rx_release_block(ring);
+                continue;
+            }
+            ring->rx_pkts_left = bd->hdr.bh1.num_pkts;
+            ring->rx_pkt = (uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt;
+        }
+
+        struct tpacket3_hdr* hdr = (struct tpacket3_hdr*)ring->rx_pkt;
+        struct sockaddr_ll* sll =
+            (struct sockaddr_ll*)(ring->rx_pkt + TPACKET_ALIGN(sizeof(*hdr)));
+        ssize_t ret = -1;
+
+        /* Skip packets sent by the host itself on the interface */
+        if (sll->sll_pkttype != PACKET_OUTGOING)
+            ret = copy_to_iov(
+                iov, iovcnt, ring->rx_pkt + hdr->tp_mac, hdr->tp_snaplen);
+
+        ring->rx_pkt += hdr->tp_next_offset;
+        if (!--ring->rx_pkts_left)
+            rx_release_block(ring);
+
+        if (ret >= 0)
+            return ret;
+    }
+}
+
+ssize_t host_packet_ring_send(
+    struct host_packet_ring* ring,
+    const struct iovec* iov,
+    int iovcnt)
+{
+    uint8_t* frame = ring->tx_map + ring->tx_frame_idx * ring->tx_frame_size;
+    struct tpacket3_hdr* hdr = (struct tpacket3_hdr*)frame;
+    size_t len = 0;
+
+    for (int i = 0; i < iovcnt; i++)
+        len += iov[i].iov_len;
+    if (len > ring->tx_frame_size - TX_DATA_OFFSET)
+        return -EMSGSIZE;
+
+    if (hdr->tp_status != TP_STATUS_AVAILABLE &&
+        hdr->tp_status != TP_STATUS_WRONG_FORMAT)
+    {
+        /* Make sure the kernel sends the frames that fill the ring */
+        host_packet_ring_flush(ring);
+        return -EAGAIN;
+    }
+
+    /* Write the frame only after reading its status */
+    __sync_synchronize();
+
+    uint8_t* data = frame + TX_DATA_OFFSET;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        memcpy(data, iov[i].iov_base, iov[i].iov_len);
+        data += iov[i].iov_len;
+    }
+    hdr->tp_len = len;
+    hdr->tp_snaplen = len;
+    hdr->tp_next_offset = 0;
+
+    __sync_synchronize();
+    hdr->tp_status = TP_STATUS_SEND_REQUEST;
+
+    ring->tx_frame_idx = (ring->tx_frame_idx + 1) % ring->tx_num_frames;
+    ring->tx_pending++;
+    return len;
+}
+
+int host_packet_ring_flush(struct host_packet_ring* ring)
+{
+    if (!ring->tx_pending)
+        return 0;
+
+    if (sendto(ring->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0)
+    {
+        /* The socket send buffer is full, frames the kernel could not send
+         * yet remain marked as send requests */
+        if (errno == EAGAIN || errno == ENOBUFS)
+            return -EAGAIN;
+        return -errno;
+    }
+
+    ring->tx_pending = 0;
+    return 0;
+}
@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <host/host_threads.h>
+#include <host/sgxlkl_util.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct host_thread_class_cfg
+{
+    const char* name;
+    cpu_set_t cpus;
+    bool has_cpus;
+    bool has_sched;
+    int policy;
+    int priority;
+    /* Only warn once per class if the settings cannot be applied */
+    bool warned;
+};
+
+struct host_thread
+{
+    char name[16];
+    host_thread_class_t cls;
+    void* (*start_routine)(void*);
+    void* arg;
+    pthread_t tid;
+    /* CPU time of the thread, set once it has returned */
+    bool exited;
+    struct timespec cpu_time;
+    struct host_thread* next;
+};
+
+static struct host_thread_class_cfg _classes[HOST_THREAD_CLASS_COUNT] = {
+    [HOST_THREAD_DEVICE] = {.name = "device"},
+    [HOST_THREAD_TIMER] = {.name = "timer"},
+};
+
+/* Threads in the order of their creation */
+static struct host_thread* _threads;
+static struct host_thread** _threads_tail = &_threads;
+static pthread_mutex_t _threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const struct
+{
+    const char* name;
+    int policy;
+} _policies[] = {
+    {"other", SCHED_OTHER},
+    {"batch", SCHED_BATCH},
+    {"idle", SCHED_IDLE},
+    {"fifo", SCHED_FIFO},
+    {"rr", SCHED_RR},
+};
+
+static bool is_rt_policy(int policy)
+{
+    return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static void parse_sched(struct host_thread_class_cfg* c, const char* sched)
+{
+    const char* colon = strchr(sched, ':');
+    size_t len = colon ? (size_t)(colon - sched) : strlen(sched);
+    size_t i;
+
+    for (i = 0; i < sizeof(_policies) / sizeof(_policies[0]); i++)
+    {
+        if (strlen(_policies[i].name) == len &&
+            strncmp(_policies[i].name, sched, len) == 0)
+            break;
+    }
+    if (i == sizeof(_policies) / sizeof(_policies[0]))
+        sgxlkl_host_fail(
+            "Invalid scheduling policy for %s threads: %s\n", c->name, sched);
+
+    c->policy = _policies[i].policy;
+    c->priority = 0;
+    if (colon)
+    {
+        char* end;
+        long prio = strtol(colon + 1, &end, 10);
+        if (!colon[1] || *end || prio < -20 || prio > 99)
+            sgxlkl_host_fail(
+                "Invalid scheduling priority for %s threads: %s\n",
+                c->name,
+                sched);
+        c->priority = (int)prio;
+    }
+
+    if (is_rt_policy(c->policy)
+            ? c->priority < sched_get_priority_min(c->policy) ||
+                  c->priority > sched_get_priority_max(c->policy)
+            : c->priority > 19)
+        sgxlkl_host_fail(
+            "Invalid scheduling priority for %s threads: %s\n",
+            c->name,
+            sched);
+
+    c->has_sched = true;
+}
+
+void host_threads_configure(
+    host_thread_class_t cls,
+    const int* cores,
+    size_t cores_len,
+    const char* sched)
+{
+    struct host_thread_class_cfg* c = &_classes[cls];
+
+    CPU_ZERO(&c->cpus);
+    for (size_t i = 0; i < cores_len; i++)
+        CPU_SET(cores[i], &c->cpus);
+    c->has_cpus = cores_len > 0;
+
+    if (sched && strlen(sched))
+        parse_sched(c, sched);
+}
+
+/* Apply the settings of the class of the calling thread */
+static void host_thread_apply(struct host_thread_class_cfg* c)
+{
+    int err = 0;
+
+    if (c->has_cpus)
+        err = pthread_setaffinity_np(pthread_self(), sizeof(c->cpus), &c->cpus);
+
+    if (!err && c->has_sched)
+    {
+        struct sched_param param = {
+            .sched_priority = is_rt_policy(c->policy) ? c->priority : 0};
+
+        err = pthread_setschedparam(pthread_self(), c->policy, &param);
+
+        /* The nice value is a per-thread attribute on Linux */
+        if (!err && !is_rt_policy(c->policy) &&
+            setpriority(PRIO_PROCESS, syscall(SYS_gettid), c->priority))
+            err = errno;
+    }
+
+    if (err && !__atomic_exchange_n(&c->warned, true, __ATOMIC_RELAXED))
+        sgxlkl_host_warn(
+            "Failed to set the CPU affinity or scheduling of the %s threads: "
+            "%s\n",
+            c->name,
+            strerror(err));
+}
+
+static void* host_thread_start(void* arg)
+{
+    struct host_thread* t = arg;
+    void* ret;
+
+    host_thread_apply(&_classes[t->cls]);
+
+    ret = t->start_routine(t->arg);
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t->cpu_time);
+    __atomic_store_n(&t->exited, true, __ATOMIC_RELEASE);
+
+    return ret;
+}
+
+int host_thread_create(
+    pthread_t* thread,
+    host_thread_class_t cls,
+    const char* name,
+    void* (*start_routine)(void*),
+    void* arg)
+{
+    struct host_thread* t = calloc(1, sizeof(*t));
+    int err;
+
+    if (!t)
+        return ENOMEM;
+
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    t->cls = cls;
+    t->start_routine = start_routine;
+    t->arg = arg;
+
+    pthread_mutex_lock(&_threads_lock);
+    err = pthread_create(&t->tid, NULL, host_thread_start, t);
+    if (!err)
+    {
+        pthread_setname_np(t->tid, t->name);
+        *_threads_tail = t;
+        _threads_tail = &t->next;
+        *thread = t->tid;
+    }
+    pthread_mutex_unlock(&_threads_lock);
+
+    if (err)
+        free(t);
+
+    return err;
+}
+
+static double timespec_to_sec(const struct timespec* ts)
+{
+    return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+void host_threads_print_cpu_time(void)
+{
+    struct rusage usage;
+    double total = 0;
+
+    pthread_mutex_lock(&_threads_lock);
+    for (struct host_thread* t = _threads; t; t = t->next)
+    {
+        struct timespec ts;
+        clockid_t clock;
+
+        /*
+         * Threads that are still running are sampled now. A thread may
+         * return between the two checks, in which case its clock is gone.
+         */
+        if (__atomic_load_n(&t->exited, __ATOMIC_ACQUIRE))
+            ts = t->cpu_time;
+        else if (
+            pthread_getcpuclockid(t->tid, &clock) || clock_gettime(clock, &ts))
+        {
+            if (!__atomic_load_n(&t->exited, __ATOMIC_ACQUIRE))
+                continue;
+            ts = t->cpu_time;
+        }
+
+        sgxlkl_host_verbose(
+            "Host thread %s (%s): %.3f s CPU time\n",
+            t->name,
+            _classes[t->cls].name,
+            timespec_to_sec(&ts));
+        total += timespec_to_sec(&ts);
+    }
+    pthread_mutex_unlock(&_threads_lock);
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        double process = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+        sgxlkl_host_verbose(
+            "Host helper threads: %.3f s CPU time, ethreads and main thread: "
+            "%.3f s CPU time\n",
+            total,
+            process > total ? process - total : 0);
+    }
+}
@@ -5,8 +5,13 @@
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
 #include <host/virtio_blkdev.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
+#include <time.h>
 
 #define min_len(a, b) (a < b ? a : b)
 
@@ -16,8 +21,109 @@ struct _virtio_req
     struct virtio_dev* dev;
     struct virtq* q;
     uint16_t idx;
+    /* Head descriptor of a detached request, valid if detached is set */
+    uint16_t desc_idx;
+    bool detached;
+    /* Packed virtqueues: driver wrap counter at idx and the buffer ID of the
+     * descriptor chain, or of each buffer of a mergeable request */
+    uint16_t avail_wrap_counter;
+    uint16_t buf_ids[VIRTIO_REQ_MAX_MERGE_BUFS];
 };
 
+/* Bounce buffer usage of a device, indexed by the device id */
+struct virtio_bounce_stats
+{
+    uint64_t num_reqs;
+    uint64_t num_bytes;
+    uint64_t max_req_bytes;
+    /* Buffers outside the bounce buffer area */
+    uint64_t num_outside;
+};
+
+static struct virtio_bounce_stats* _bounce_stats;
+static size_t _bounce_num_devs;
+static uintptr_t _bounce_start, _bounce_end;
+
+static inline bool virtio_is_packed(struct virtio_dev* dev)
+{
+    return dev->driver_features & BIT(VIRTIO_F_RING_PACKED);
+}
+
+static inline struct virtq_packed_desc* virtq_packed_desc_at(
+    struct virtq* q,
+    uint16_t idx)
+{
+    return &((struct virtq_packed_desc*)q->desc)[idx];
+}
+
+/*
+ * virtq_packed_desc_is_avail: check whether the driver has made a packed
+ * descriptor available for the given driver wrap counter. The descriptor
+ * contents may only be read after this returned true.
+ */
+static inline bool virtq_packed_desc_is_avail(
+    struct virtq_packed_desc* desc,
+    uint16_t wrap_counter)
+{
+    uint16_t flags = le16toh(__atomic_load_n(&desc->flags, __ATOMIC_ACQUIRE));
+    bool avail = flags & BIT(LKL_VRING_PACKED_DESC_F_AVAIL);
+    bool used = flags & BIT(LKL_VRING_PACKED_DESC_F_USED);
+
+    return avail == wrap_counter && used != wrap_counter;
+}
+
+/*
+ * virtq_packed_advance: move a packed ring position forward by n
+ * descriptors, flipping its wrap counter when it wraps around
+ */
+static inline void virtq_packed_advance(
+    struct virtq* q,
+    uint16_t* idx,
+    uint16_t* wrap_counter,
+    uint16_t n)
+{
+    *idx += n;
+    if (*idx >= q->num)
+    {
+        *idx -= q->num;
+        *wrap_counter ^= 1;
+    }
+}
+
+/*
+ * virtq_packed_init: set up the device state of a packed virtqueue before
+ * the device first processes it
+ */
+static inline void virtq_packed_init(struct virtio_dev* dev, struct virtq* q)
+{
+    if (!virtio_is_packed(dev) || q->packed_ready)
+        return;
+
+    q->last_avail_idx = 0;
+    q->avail_wrap_counter = 1;
+    q->used_idx = 0;
+    q->used_wrap_counter = 1;
+    q->last_used_idx_signaled = 0;
+    q->packed_ready = 1;
+}
+
+/*
+ * virtq_has_avail: check whether the driver has made requests available
+ * that the device has not processed yet
+ */
+static inline bool virtq_has_avail(struct virtio_dev* dev, struct virtq* q)
+{
+    if (!virtio_is_packed(dev))
+        return q->last_avail_idx != le16toh(q->avail->idx);
+
+    /* The device has not processed the queue yet */
+    if (!q->packed_ready)
+        return virtq_packed_desc_is_avail(virtq_packed_desc_at(q, 0), 1);
+
+    return virtq_packed_desc_is_avail(
+        virtq_packed_desc_at(q, q->last_avail_idx), q->avail_wrap_counter);
+}
+
 /*
  * vring_desc_at_avail_idx : get the pointer to vring descriptor
  *                           at given available index from virtio_queue
@@ -87,13 +193,13 @@ static inline void virtio_add_used(
     struct virtq* q,
     uint16_t used_idx,
     uint16_t avail_idx,
-    uint16_t len)
+    uint32_t len)
 {
     uint16_t desc_idx = q->avail->ring[avail_idx & (q->num - 1)];
 
     used_idx = used_idx & (q->num - 1);
     q->used->ring[used_idx].id = desc_idx;
-    q->used->ring[used_idx].len = htole16(len);
+    q->used->ring[used_idx].len = htole32(len);
 }
 
 /*
@@ -143,6 +249,358 @@ static inline void virtio_deliver_irq(struct virtio_dev* dev)
     vio_host_notify_host_event(dev->vendor_id);
 }
 
+/*
+ * virtio_add_used_split: add the used entries of a request to the used ring
+ * of a split virtqueue
+ */
+static void virtio_add_used_split(struct _virtio_req* _req, uint32_t len)
+{
+    struct virtio_req* req = &_req->req;
+    struct virtq* q = _req->q;
+    uint16_t avail_idx = _req->idx;
+    uint16_t used_idx =
+        q->batching ? q->batch_used_idx : virtio_get_used_idx(_req->q);
+
+    if (_req->detached)
+    {
+        /* The avail ring slot may have been reused, so use the descriptor
+         * recorded when the request was detached */
+        q->used->ring[used_idx & (q->num - 1)].id = _req->desc_idx;
+        q->used->ring[used_idx & (q->num - 1)].len = htole32(len);
+        used_idx++;
+    }
+    else
+    {
+        /*
+         * We've potentially used up multiple (non-chained) descriptors and
+         * have to create one "used" entry for each descriptor we've
+         * consumed.
+         */
+        for (int i = 0; i < req->buf_count; i++)
+        {
+            uint32_t used_len;
+
+            if (!q->max_merge_len)
+                used_len = len;
+            else
+                used_len = min_len(len, req->buf[i].iov_len);
+
+            virtio_add_used(q, used_idx++, avail_idx++, used_len);
+
+            len -= used_len;
+            if (!len)
+                break;
+        }
+        q->last_avail_idx = avail_idx;
+    }
+
+    /* The batch publishes its used entries once all requests are complete */
+    if (q->batching)
+        q->batch_used_idx = used_idx;
+    else
+        virtio_sync_used_idx(q, used_idx);
+}
+
+/*
+ * virtq_packed_add_used: mark the descriptor at the next used position of a
+ * packed virtqueue as used by the buffer id, which spans num_descs
+ * descriptors
+ */
+static inline void virtq_packed_add_used(
+    struct virtq* q,
+    uint16_t id,
+    uint32_t len,
+    uint16_t num_descs)
+{
+    struct virtq_packed_desc* desc = virtq_packed_desc_at(q, q->used_idx);
+    uint16_t flags = 0;
+
+    if (q->used_wrap_counter)
+        flags = BIT(LKL_VRING_PACKED_DESC_F_AVAIL) |
+                BIT(LKL_VRING_PACKED_DESC_F_USED);
+
+    desc->id = htole16(id);
+    desc->len = htole32(len);
+    /* The driver may only see the descriptor as used once id and len are
+     * written */
+    __atomic_store_n(&desc->flags, htole16(flags), __ATOMIC_RELEASE);
+
+    virtq_packed_advance(q, &q->used_idx, &q->used_wrap_counter, num_descs);
+}
+
+/*
+ * virtio_add_used_packed: mark the descriptors of a request as used in a
+ * packed virtqueue. Unlike split virtqueues, each used descriptor is
+ * published as it is written, so batching only defers the irq.
+ */
+static void virtio_add_used_packed(struct _virtio_req* _req, uint32_t len)
+{
+    struct virtio_req* req = &_req->req;
+    struct virtq* q = _req->q;
+    uint16_t num_descs = 0;
+
+    if (!q->max_merge_len)
+    {
+        /* A descriptor chain is used as a whole */
+        virtq_packed_add_used(q, _req->buf_ids[0], len, req->buf_count);
+        num_descs = req->buf_count;
+    }
+    else
+    {
+        for (int i = 0; i < req->buf_count; i++)
+        {
+            uint32_t used_len = min_len(len, req->buf[i].iov_len);
+
+            virtq_packed_add_used(q, _req->buf_ids[i], used_len, 1);
+            num_descs++;
+
+            len -= used_len;
+            if (!len)
+                break;
+        }
+    }
+
+    /* The position of detached requests has been advanced already */
+    if (!_req->detached)
+    {
+        q->last_avail_idx = _req->idx;
+        q->avail_wrap_counter = _req->avail_wrap_counter;
+        virtq_packed_advance(
+            q, &q->last_avail_idx, &q->avail_wrap_counter, num_descs);
+    }
+}
+
+/*
+ * virtq_packed_need_irq: check whether the driver asked to be notified of
+ * the descriptors used since the last irq, following the driver event
+ * suppression settings of a packed virtqueue
+ */
+static bool virtq_packed_need_irq(struct virtio_dev* dev, struct virtq* q)
+{
+    struct virtq_packed_event* event = (struct virtq_packed_event*)q->avail;
+    uint16_t flags = le16toh(event->flags);
+    uint16_t off_wrap, off, old;
+
+    if (flags == LKL_VRING_PACKED_EVENT_FLAG_DISABLE)
+        return false;
+
+    /* Triggers the irq whenever there is no available buffer, as for split
+     * virtqueues */
+    if (flags == LKL_VRING_PACKED_EVENT_FLAG_ENABLE || !virtq_has_avail(dev, q))
+        return true;
+
+    /*
+     * The driver asks for an irq once the descriptor at off has been used.
+     * Ring positions are converted to free-running indices for
+     * lkl_vring_need_event, with positions of the previous lap, identified
+     * by the wrap counter, moved back by the ring size.
+     */
+    off_wrap = le16toh(event->off_wrap);
+    off = off_wrap & ~BIT(LKL_VRING_PACKED_EVENT_F_WRAP_CTR);
+    if ((off_wrap >> LKL_VRING_PACKED_EVENT_F_WRAP_CTR) != q->used_wrap_counter)
+        off -= q->num;
+
+    old = q->last_used_idx_signaled;
+    if (old > q->used_idx)
+        old -= q->num;
+
+    return lkl_vring_need_event(off, q->used_idx, old);
+}
+
+/*
+ * virtio_signal_used: deliver an irq to the driver for the requests
+ * completed since the last irq, unless the driver suppressed it
+ */
+static void virtio_signal_used(struct virtio_dev* dev, struct virtq* q)
+{
+    uint16_t used_idx;
+    bool send_irq;
+
+    if (virtio_is_packed(dev))
+    {
+        /* Read the event suppression settings only after the descriptors
+         * have been marked as used */
+        __sync_synchronize();
+        used_idx = q->used_idx;
+        send_irq = virtq_packed_need_irq(dev, q);
+    }
+    else
+    {
+        /*
+         * There are two rings: q->avail and q->used for each of the rx and
+         * tx queues that are used to pass buffers between kernel driver and
+         * the virtio device implementation.
+         *
+         * Kernel maitains the first one and appends buffers to it. In rx
+         * queue, it's empty buffers kernel offers to store received packets.
+         * In tx queue, it's buffers containing packets to transmit. Kernel
+         * notifies the device by mmio write (see VIRTIO_MMIO_QUEUE_NOTIFY
+         * below).
+         *
+         * The virtio device (here in this file) maintains the
+         * q->used and appends buffer to it after consuming it from q->avail.
+         *
+         * The device needs to notify the driver by triggering irq here. The
+         * LKL_VIRTIO_RING_F_EVENT_IDX is enabled in this implementation so
+         * kernel can set virtio_get_used_event(q) to tell the device to
+         * "only trigger the irq when this item in q->used ring is
+         * populated."
+         *
+         * Because driver and device are run in two different threads. When
+         * driver sets virtio_get_used_event(q), q->used->idx may already be
+         * increased to a larger one. So we need to trigger the irq when
+         * virtio_get_used_event(q) < q->used->idx.
+         *
+         * To avoid unnessary irqs for each packet after
+         * virtio_get_used_event(q) < q->used->idx, last_used_idx_signaled is
+         * stored and irq is only triggered if
+         * last_used_idx_signaled <= virtio_get_used_event(q) < q->used->idx
+         *
+         * This is what lkl_vring_need_event() checks and it evens covers the
+         * case when those numbers wrap up.
+         *
+         * Triggers the irq whenever there is no available buffer.
+         */
+        used_idx = virtio_get_used_idx(q);
+        send_irq = q->last_avail_idx == le16toh(q->avail->idx) ||
+                   lkl_vring_need_event(
+                       le16toh(virtio_get_used_event(q)),
+                       used_idx,
+                       q->last_used_idx_signaled);
+    }
+
+    if (send_irq)
+    {
+        q->last_used_idx_signaled = used_idx;
+        virtio_deliver_irq(dev);
+    }
+}
+
+static inline uint64_t virtio_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*
+ * virtq_batch_flush: publish the used entries added during the current batch
+ * and signal the driver once for all of them
+ */
+static void virtq_batch_flush(struct virtio_dev* dev, struct virtq* q)
+{
+    if (!q->batch_pending)
+        return;
+
+    q->batch_pending = 0;
+
+    /* Used descriptors of packed virtqueues are published as they are
+     * written, only the irq is deferred */
+    if (!virtio_is_packed(dev))
+        virtio_sync_used_idx(q, q->batch_used_idx);
+
+    virtio_signal_used(dev, q);
+}
+
+/*
+ * virtq_batch_add: account for a request completed during a batch and
+ * publish the batch early if it reached the coalescing limits of the queue
+ */
+static void virtq_batch_add(struct virtio_dev* dev, struct virtq* q)
+{
+    uint64_t now = 0;
+
+    if (q->batch_max_delay_us)
+    {
+        now = virtio_now_ns();
+        if (!q->batch_pending)
+            q->batch_start_ns = now;
+    }
+    q->batch_pending++;
+
+    if ((q->batch_max_reqs && q->batch_pending >= q->batch_max_reqs) ||
+        (q->batch_max_delay_us &&
+         now - q->batch_start_ns >= q->batch_max_delay_us * 1000ULL))
+        virtq_batch_flush(dev, q);
+}
+
+void virtio_bounce_stats_init(void* base, size_t size, size_t num_devs)
+{
+    _bounce_stats = calloc(num_devs, sizeof(*_bounce_stats));
+    if (!_bounce_stats)
+        sgxlkl_host_fail("%s: out of memory\n", __func__);
+
+    _bounce_num_devs = num_devs;
+    _bounce_start = (uintptr_t)base;
+    _bounce_end = _bounce_start + size;
+}
+
+/*
+ * virtio_bounce_account: account for the buffers of a completed request,
+ * which the enclave has copied through the bounce buffer area
+ */
+static void virtio_bounce_account(
+    struct virtio_dev* dev,
+    struct virtio_req* req)
+{
+    struct virtio_bounce_stats* stats;
+    uint64_t max;
+
+    if (dev->vendor_id >= _bounce_num_devs)
+        return;
+
+    stats = &_bounce_stats[dev->vendor_id];
+    for (int i = 0; i < req->buf_count; i++)
+    {
+        uintptr_t start = (uintptr_t)req->buf[i].iov_base;
+        if (start < _bounce_start ||
+            start + req->buf[i].iov_len > _bounce_end)
+            __atomic_fetch_add(&stats->num_outside, 1, __ATOMIC_RELAXED);
+    }
+
+    __atomic_fetch_add(&stats->num_reqs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->num_bytes, req->total_len, __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&stats->max_req_bytes, __ATOMIC_RELAXED);
+    while (req->total_len > max &&
+           !__atomic_compare_exchange_n(
+               &stats->max_req_bytes,
+               &max,
+               req->total_len,
+               true,
+               __ATOMIC_RELAXED,
+               __ATOMIC_RELAXED))
+        ;
+}
+
+void virtio_print_bounce_stats(void)
+{
+    if (!_bounce_stats)
+        return;
+
+    sgxlkl_host_verbose(
+        "Bounce buffer: %zu KiB\n",
+        (size_t)(_bounce_end - _bounce_start) >> 10);
+
+    for (size_t i = 0; i < _bounce_num_devs; i++)
+    {
+        struct virtio_bounce_stats* stats = &_bounce_stats[i];
+
+        if (!stats->num_reqs)
+            continue;
+
+        sgxlkl_host_verbose(
+            "Device %zu: %" PRIu64 " requests, %" PRIu64
+            " KiB through bounce buffer, largest request %" PRIu64
+            " KiB, %" PRIu64 " buffers outside bounce buffer\n",
+            i,
+            stats->num_reqs,
+            stats->num_bytes >> 10,
+            stats->max_req_bytes >> 10,
+            stats->num_outside);
+    }
+}
+
 /*
  * virtio_req_complete: handle finishing activities after processing request
  * req: local virtio request buffer
@@ -150,79 +608,125 @@ static inline void virtio_deliver_irq(struct virtio_dev* dev)
  */
 void virtio_req_complete(struct virtio_req* req, uint32_t len)
 {
-    int send_irq = 0;
     struct _virtio_req* _req = container_of(req, struct _virtio_req, req);
     struct virtq* q = _req->q;
-    uint16_t avail_idx = _req->idx;
-    uint16_t used_idx = virtio_get_used_idx(_req->q);
 
-    /*
-     * We've potentially used up multiple (non-chained) descriptors and have
-     * to create one "used" entry for each descriptor we've consumed.
-     */
-    for (int i = 0; i < req->buf_count; i++)
+    if (_bounce_stats)
+        virtio_bounce_account(_req->dev, req);
+
+    if (virtio_is_packed(_req->dev))
+        virtio_add_used_packed(_req, len);
+    else
+        virtio_add_used_split(_req, len);
+
+    /* The batch signals the driver once for all its requests */
+    if (q->batching)
+        virtq_batch_add(_req->dev, q);
+    else
+        virtio_signal_used(_req->dev, q);
+
+    if (_req->detached)
+        free(_req);
+}
+
+/*
+ * virtio_req_detach: take a request out of the synchronous processing path
+ * so that it can be completed later, and in any order, with
+ * virtio_req_complete. The queue moves on to the next available request.
+ * req: request passed to the enqueue callback
+ * returns the detached request or NULL on allocation failure
+ */
+struct virtio_req* virtio_req_detach(struct virtio_req* req)
+{
+    struct _virtio_req* _req = container_of(req, struct _virtio_req, req);
+    struct virtq* q = _req->q;
+
+    /* Requests spanning several avail entries (mergeable buffers) must be
+     * completed in order */
+    if (q->max_merge_len)
+        return NULL;
+
+    struct _virtio_req* detached = malloc(sizeof(*detached));
+    if (!detached)
+        return NULL;
+
+    memcpy(detached, _req, sizeof(*detached));
+    detached->detached = true;
+    if (virtio_is_packed(_req->dev))
     {
-        uint16_t used_len;
+        q->last_avail_idx = _req->idx;
+        q->avail_wrap_counter = _req->avail_wrap_counter;
+        virtq_packed_advance(
+            q, &q->last_avail_idx, &q->avail_wrap_counter, req->buf_count);
+    }
+    else
+    {
+        detached->desc_idx = q->avail->ring[_req->idx & (q->num - 1)];
+        q->last_avail_idx = _req->idx + 1;
+    }
 
-        if (!q->max_merge_len)
-            used_len = len;
-        else
-            used_len = min_len(len, req->buf[i].iov_len);
+    return &detached->req;
+}
 
-        virtio_add_used(q, used_idx++, avail_idx++, used_len);
+/*
+ * virtio_req_iov: set up iov as the len bytes of the buffers of req that
+ * follow the first skip bytes
+ * iov: array of at least req->buf_count entries
+ * returns the number of entries of iov
+ */
+int virtio_req_iov(
+    const struct virtio_req* req,
+    size_t skip,
+    size_t len,
+    struct iovec* iov)
+{
+    int n = 0;
 
-        len -= used_len;
-        if (!len)
-            break;
+    for (int i = 0; i < req->buf_count && len; i++)
+    {
+        size_t buf_len = req->buf[i].iov_len;
+
+        if (skip >= buf_len)
+        {
+            skip -= buf_len;
+            continue;
+        }
+
+        iov[n].iov_base = (char*)req->buf[i].iov_base + skip;
+        iov[n].iov_len = buf_len - skip < len ? buf_len - skip : len;
+        len -= iov[n].iov_len;
+        skip = 0;
+        n++;
     }
-    virtio_sync_used_idx(q, used_idx);
-    q->last_avail_idx = avail_idx;
+    return n;
+}
 
-    /*
-     * Triggers the irq whenever there is no available buffer.
-     */
-    if (q->last_avail_idx == le16toh(q->avail->idx))
-        send_irq = 1;
+/*
+ * virtio_req_copy: copy between data and the len bytes of the buffers of
+ * req that follow the first skip bytes
+ * to_req: copy from data into req if set, from req into data otherwise
+ * returns the number of bytes copied
+ */
+size_t virtio_req_copy(
+    const struct virtio_req* req,
+    size_t skip,
+    void* data,
+    size_t len,
+    bool to_req)
+{
+    struct iovec iov[VIRTIO_REQ_MAX_MERGE_BUFS];
+    int iovcnt = virtio_req_iov(req, skip, len, iov);
+    size_t copied = 0;
 
-    /*
-     * There are two rings: q->avail and q->used for each of the rx and tx
-     * queues that are used to pass buffers between kernel driver and the
-     * virtio device implementation.
-     *
-     * Kernel maitains the first one and appends buffers to it. In rx queue,
-     * it's empty buffers kernel offers to store received packets. In tx
-     * queue, it's buffers containing packets to transmit. Kernel notifies
-     * the device by mmio write (see VIRTIO_MMIO_QUEUE_NOTIFY below).
-     *
-     * The virtio device (here in this file) maintains the
-     * q->used and appends buffer to it after consuming it from q->avail.
-     *
-     * The device needs to notify the driver by triggering irq here. The
-     * LKL_VIRTIO_RING_F_EVENT_IDX is enabled in this implementation so
-     * kernel can set virtio_get_used_event(q) to tell the device to "only
-     * trigger the irq when this item in q->used ring is populated."
-     *
-     * Because driver and device are run in two different threads. When
-     * driver sets virtio_get_used_event(q), q->used->idx may already be
-     * increased to a larger one. So we need to trigger the irq when
-     * virtio_get_used_event(q) < q->used->idx.
-     *
-     * To avoid unnessary irqs for each packet after
-     * virtio_get_used_event(q) < q->used->idx, last_used_idx_signaled is
-     * stored and irq is only triggered if
-     * last_used_idx_signaled <= virtio_get_used_event(q) < q->used->idx
-     *
-     * This is what lkl_vring_need_event() checks and it evens covers the
-     * case when those numbers wrap up.
-     */
-    if (send_irq || lkl_vring_need_event(
-                        le16toh(virtio_get_used_event(q)),
-                        virtio_get_used_idx(q),
-                        q->last_used_idx_signaled))
+    for (int i = 0; i < iovcnt; i++)
     {
-        q->last_used_idx_signaled = virtio_get_used_idx(q);
-        virtio_deliver_irq(_req->dev);
+        if (to_req)
+            memcpy(iov[i].iov_base, (char*)data + copied, iov[i].iov_len);
+        else
+            memcpy((char*)data + copied, iov[i].iov_base, iov[i].iov_len);
+        copied += iov[i].iov_len;
     }
+    return copied;
 }
 
 /*
@@ -234,6 +738,8 @@ static int virtio_process_one(struct virtio_dev* dev, int qidx)
 {
     struct virtq* q = &dev->queue[qidx];
     uint16_t idx = q->last_avail_idx;
+    int max_bufs =
+        q->max_merge_len ? VIRTIO_REQ_MAX_MERGE_BUFS : VIRTIO_REQ_MAX_BUFS;
 
     struct _virtio_req _req = {
         .dev = dev,
@@ -247,50 +753,266 @@ static int virtio_process_one(struct virtio_dev* dev, int qidx)
     do
     {
         add_dev_buf_from_vring_desc(req, desc);
-        if (q->max_merge_len && req->total_len > q->max_merge_len)
+        if (q->max_merge_len && req->total_len >= q->max_merge_len)
             break;
         desc = get_next_desc(q, desc, &idx);
-    } while (desc && req->buf_count < VIRTIO_REQ_MAX_BUFS);
+    } while (desc && req->buf_count < max_bufs);
 
     // Return result of enqueue operation
     return dev->ops->enqueue(dev, qidx, req);
 }
 
+/*
+ * virtio_process_one_packed: Process the request at the head of a packed
+ * virtqueue. The buffers of a request are either a descriptor chain or, for
+ * mergeable buffers, consecutive single-descriptor buffers.
+ * dev: device structure pointer
+ * qidx: queue index to be processed
+ */
+static int virtio_process_one_packed(struct virtio_dev* dev, int qidx)
+{
+    struct virtq* q = &dev->queue[qidx];
+    uint16_t idx = q->last_avail_idx;
+    uint16_t wrap_counter = q->avail_wrap_counter;
+    int max_bufs =
+        q->max_merge_len ? VIRTIO_REQ_MAX_MERGE_BUFS : VIRTIO_REQ_MAX_BUFS;
+
+    struct _virtio_req _req = {
+        .dev = dev,
+        .q = q,
+        .idx = idx,
+        .avail_wrap_counter = wrap_counter,
+    };
+
+    struct virtio_req* req = &_req.req;
+    memset(req, 0, sizeof(struct virtio_req));
+    struct virtq_packed_desc* desc = virtq_packed_desc_at(q, idx);
+    do
+    {
+        struct iovec* buf = &req->buf[req->buf_count];
+        uint16_t flags = le16toh(desc->flags);
+
+        /* The ID of a chain is only set in its last descriptor */
+        _req.buf_ids[q->max_merge_len ? req->buf_count : 0] =
+            le16toh(desc->id);
+        buf->iov_base = (void*)(uintptr_t)le64toh(desc->addr);
+        buf->iov_len = le32toh(desc->len);
+        req->total_len += buf->iov_len;
+        req->buf_count++;
+
+        virtq_packed_advance(q, &idx, &wrap_counter, 1);
+        desc = virtq_packed_desc_at(q, idx);
+
+        if (q->max_merge_len)
+        {
+            if (req->total_len >= q->max_merge_len ||
+                !virtq_packed_desc_is_avail(desc, wrap_counter))
+                break;
+        }
+        else if (!(flags & LKL_VRING_DESC_F_NEXT))
+            break;
+    } while (req->buf_count < max_bufs);
+
+    return dev->ops->enqueue(dev, qidx, req);
+}
+
 static inline void virtio_set_avail_event(struct virtq* q, uint16_t val)
 {
     *((uint16_t*)&q->used->ring[q->num]) = val;
 }
 
+/*
+ * virtq_enable_notify: ask the driver to notify the device of new requests.
+ * The caller must check for available requests afterwards, as the driver
+ * may have made requests available before it saw the change.
+ */
+static inline void virtq_enable_notify(struct virtio_dev* dev, struct virtq* q)
+{
+    if (virtio_is_packed(dev))
+    {
+        struct virtq_packed_event* event =
+            (struct virtq_packed_event*)q->used;
+        event->flags = htole16(LKL_VRING_PACKED_EVENT_FLAG_ENABLE);
+    }
+    else
+        virtio_set_avail_event(q, q->avail->idx);
+
+    __sync_synchronize();
+}
+
+/*
+ * virtq_disable_notify: tell the driver that the device is processing the
+ * queue and does not need to be notified of new requests. Split virtqueues
+ * only ask for a notification once the device reaches the avail event index.
+ */
+static inline void virtq_disable_notify(struct virtio_dev* dev, struct virtq* q)
+{
+    if (virtio_is_packed(dev))
+    {
+        struct virtq_packed_event* event =
+            (struct virtq_packed_event*)q->used;
+        event->flags = htole16(LKL_VRING_PACKED_EVENT_FLAG_DISABLE);
+    }
+}
+
 void virtio_set_queue_max_merge_len(struct virtio_dev* dev, int q, int len)
 {
     dev->queue[q].max_merge_len = len;
 }
 
 /*
- * virtio_process_queue : process all the requests in the specific queue
+ * virtio_set_queue_coalescing: limit the number of requests completed, and
+ * the time in microseconds a completion may wait, before the used entries of
+ * a batch are published and signalled. 0 means no limit, in which case the
+ * whole batch is signalled at its end.
+ */
+void virtio_set_queue_coalescing(
+    struct virtio_dev* dev,
+    int q,
+    uint32_t max_reqs,
+    uint32_t max_delay_us)
+{
+    dev->queue[q].batch_max_reqs = max_reqs;
+    dev->queue[q].batch_max_delay_us = max_delay_us;
+}
+
+/*
+ * virtio_queue_batch_begin: start a batch of completions. Requests completed
+ * until virtio_queue_batch_end, e.g. while processing a queue or reaping
+ * asynchronous I/O, are published with as few used index updates and irqs
+ * as the coalescing limits of the queue allow.
+ * dev: virtio device structure pointer
+ * qidx: queue index
+ */
+void virtio_queue_batch_begin(struct virtio_dev* dev, uint32_t qidx)
+{
+    struct virtq* q = &dev->queue[qidx];
+
+    if (!virtio_is_packed(dev))
+        q->batch_used_idx = virtio_get_used_idx(q);
+    q->batch_pending = 0;
+    q->batching = 1;
+}
+
+/*
+ * virtio_queue_batch_end: publish and signal the remaining completions of
+ * the batch
+ * dev: virtio device structure pointer
+ * qidx: queue index
+ */
+void virtio_queue_batch_end(struct virtio_dev* dev, uint32_t qidx)
+{
+    struct virtq* q = &dev->queue[qidx];
+
+    q->batching = 0;
+    virtq_batch_flush(dev, q);
+}
+
+/*
+ * virtio_queue_has_avail: check whether a queue has requests that have not
+ * been processed yet, e.g. to decide which queue workers to wake up
+ * dev: virtio device structure pointer
+ * qidx: queue index
+ */
+int virtio_queue_has_avail(struct virtio_dev* dev, uint32_t qidx)
+{
+    struct virtq* q = &dev->queue[qidx];
+
+    return q->ready && virtq_has_avail(dev, q);
+}
+
+/*
+ * virtio_process_reqs: process up to max_reqs requests of a queue. Driver
+ * notifications are re-enabled once the queue is empty or the device cannot
+ * process more requests.
+ * returns the number of requests processed
+ */
+static int virtio_process_reqs(
+    struct virtio_dev* dev,
+    uint32_t qidx,
+    int max_reqs)
+{
+    struct virtq* q = &dev->queue[qidx];
+    int n = 0;
+
+    virtq_disable_notify(dev, q);
+
+    for (;;)
+    {
+        /* Make sure following loads happens after loading q->avail->idx */
+        while (n < max_reqs && virtq_has_avail(dev, q))
+        {
+            int ret = virtio_is_packed(dev)
+                          ? virtio_process_one_packed(dev, qidx)
+                          : virtio_process_one(dev, qidx);
+            if (ret < 0)
+            {
+                /* The device may need more requests, e.g. receive buffers, to
+                 * restart processing, so ask the driver for a notification */
+                virtq_enable_notify(dev, q);
+                return n;
+            }
+            n++;
+        }
+
+        /* The remaining requests are processed by the next batch */
+        if (n == max_reqs && virtq_has_avail(dev, q))
+            return n;
+
+        virtq_enable_notify(dev, q);
+
+        /* Process requests made available before notifications were
+         * enabled */
+        if (n == max_reqs || !virtq_has_avail(dev, q))
+            return n;
+
+        virtq_disable_notify(dev, q);
+    }
+}
+
+/*
+ * virtio_process_queue_batch: process up to max_reqs requests of a queue.
+ * The used entries of the whole batch are published with a single update of
+ * the used index, and at most one interrupt is delivered for the batch,
+ * unless the coalescing limits of the queue are reached first.
  * dev: virtio device structure pointer
  * qidx: queue index to be processed
- * fd: disk file descriptor
+ * max_reqs: maximum number of requests to process
+ * returns the number of requests processed
  */
-void virtio_process_queue(struct virtio_dev* dev, uint32_t qidx)
+int virtio_process_queue_batch(
+    struct virtio_dev* dev,
+    uint32_t qidx,
+    int max_reqs)
 {
     struct virtq* q = &dev->queue[qidx];
+    int n;
 
     if (!q->ready)
-        return;
+        return 0;
 
     if (dev->ops->acquire_queue)
         dev->ops->acquire_queue(dev, qidx);
 
-    while (q->last_avail_idx != q->avail->idx)
-    {
-        /* Make sure following loads happens after loading q->avail->idx */
-        if (virtio_process_one(dev, qidx) < 0)
-            break;
-        if (q->last_avail_idx == le16toh(q->avail->idx))
-            virtio_set_avail_event(q, q->avail->idx);
-    }
+    virtq_packed_init(dev, q);
+
+    virtio_queue_batch_begin(dev, qidx);
+    n = virtio_process_reqs(dev, qidx, max_reqs);
+    virtio_queue_batch_end(dev, qidx);
 
     if (dev->ops->release_queue)
         dev->ops->release_queue(dev, qidx);
+
+    return n;
+}
+
+/*
+ * virtio_process_queue : process all the requests in the specific queue as
+ * a single batch
+ * dev: virtio device structure pointer
+ * qidx: queue index to be processed
+ */
+void virtio_process_queue(struct virtio_dev* dev, uint32_t qidx)
+{
+    virtio_process_queue_batch(dev, qidx, INT_MAX);
 }
@@ -0,0 +1,993 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <host/host_state.h>
+#include <host/sgxlkl_util.h>
+#include <host/vio_host_event_channel.h>
+#include <host/virtio_9p.h>
+#include <limits.h>
+#include <shared/env.h>
+#include <shared/host_dir.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+/*
+ * Virtio 9p device that shares a host directory read-only with the enclave.
+ * The device thread serves the 9P2000.L requests of the enclave one at a
+ * time. Each fid holds an O_PATH descriptor of the file it refers to, and
+ * walks open each name relative to it without following symlinks, so that
+ * the enclave cannot reach files outside the shared directory. Requests
+ * that would modify the directory fail with EROFS.
+ */
+
+/* Request queue */
+#define NUM_QUEUES 1
+#define QUEUE_DEPTH 128
+
+#define REQUEST_QUEUE_ID 0
+
+/* time in milliseconds */
+#define WAIT_FOR_EVENT_TIMEOUT 10
+
+#define P9_MAX_FIDS (64 * 1024)
+
+/* Largest request the device copies out of the queue; only writes, which are
+ * rejected, can be larger */
+#define P9_MAX_TMSG 4096
+
+/* Size of the header of a read or readdir reply, which precedes the data */
+#define P9_IOHDR_SIZE (P9_HDR_SIZE + 4)
+
+#define P9_VERSION "9P2000.L"
+
+struct p9_fid
+{
+    bool used;
+    /* O_PATH descriptor of the file */
+    int fd;
+    /* Descriptor of the file opened for reading, -1 if not opened */
+    int open_fd;
+    /* Stream of an opened directory */
+    DIR* dir;
+};
+
+/* Message being parsed or built */
+struct p9_msg
+{
+    uint8_t* data;
+    size_t size;
+    size_t pos;
+    bool overflow;
+};
+
+/* Server state of the device, which is not shared with the enclave */
+struct p9_server
+{
+    int root_fd;
+    dev_t root_dev;
+    ino_t root_ino;
+    uint32_t msize;
+    struct p9_fid* fids;
+    uint32_t num_fids;
+    uint8_t tbuf[P9_MAX_TMSG];
+    uint8_t rbuf[SGXLKL_HOST_DIR_MSIZE];
+};
+
+/* Virtio 9p device structure */
+struct virtio_9p_dev
+{
+    struct virtio_dev dev;
+    struct virtio_9p_config config;
+};
+
+/* Local variable to hold the settings locally */
+static host_dev_config_t* _cfg = NULL;
+static struct virtio_9p_dev* _9p_dev = NULL;
+static struct p9_server _p9;
+
+static void* p9_get(struct p9_msg* m, size_t len)
+{
+    void* p = m->data + m->pos;
+
+    if (m->overflow || m->size - m->pos < len)
+    {
+        m->overflow = true;
+        return NULL;
+    }
+    m->pos += len;
+    return p;
+}
+
+static uint8_t p9_get8(struct p9_msg* m)
+{
+    uint8_t* p = p9_get(m, 1);
+    return p ? *p : 0;
+}
+
+static uint16_t p9_get16(struct p9_msg* m)
+{
+    uint16_t v = 0;
+    void* p = p9_get(m, sizeof(v));
+    if (p)
+        memcpy(&v, p, sizeof(v));
+    return le16toh(v);
+}
+
+static uint32_t p9_get32(struct p9_msg* m)
+{
+    uint32_t v = 0;
+    void* p = p9_get(m, sizeof(v));
+    if (p)
+        memcpy(&v, p, sizeof(v));
+    return le32toh(v);
+}
+
+static uint64_t p9_get64(struct p9_msg* m)
+{
+    uint64_t v = 0;
+    void* p = p9_get(m, sizeof(v));
+    if (p)
+        memcpy(&v, p, sizeof(v));
+    return le64toh(v);
+}
+
+/*
+ * Function to read a string into buf, which holds up to size - 1 bytes and
+ * the terminating null byte. Strings that contain null bytes or do not fit
+ * are treated like a truncated message.
+ */
+static void p9_get_str(struct p9_msg* m, char* buf, size_t size)
+{
+    uint16_t len = p9_get16(m);
+    char* p = p9_get(m, len);
+
+    buf[0] = '\0';
+    if (!p)
+        return;
+    if (len >= size || memchr(p, '\0', len))
+    {
+        m->overflow = true;
+        return;
+    }
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+}
+
+static void p9_put8(struct p9_msg* m, uint8_t v)
+{
+    uint8_t* p = p9_get(m, 1);
+    if (p)
+        *p = v;
+}
+
+static void p9_put16(struct p9_msg* m, uint16_t v)
+{
+    void* p = p9_get(m, sizeof(v));
+    v = htole16(v);
+    if (p)
+        memcpy(p, &v, sizeof(v));
+}
+
+static void p9_put32(struct p9_msg* m, uint32_t v)
+{
+    void* p = p9_get(m, sizeof(v));
+    v = htole32(v);
+    if (p)
+        memcpy(p, &v, sizeof(v));
+}
+
+static void p9_put64(struct p9_msg* m, uint64_t v)
+{
+    void* p = p9_get(m, sizeof(v));
+    v = htole64(v);
+    if (p)
+        memcpy(p, &v, sizeof(v));
+}
+
+static void p9_put_str(struct p9_msg* m, const char* s, size_t len)
+{
+    void* p;
+
+    if (len > UINT16_MAX)
+    {
+        m->overflow = true;
+        return;
+    }
+    p9_put16(m, len);
+    p = p9_get(m, len);
+    if (p)
+        memcpy(p, s, len);
+}
+
+static uint8_t p9_qid_type(mode_t mode)
+{
+    if (S_ISDIR(mode))
+        return P9_QTDIR;
+    if (S_ISLNK(mode))
+        return P9_QTSYMLINK;
+    return P9_QTFILE;
+}
+
+static void p9_put_qid(struct p9_msg* m, uint8_t type, uint64_t path)
+{
+    p9_put8(m, type);
+    /* version */
+    p9_put32(m, 0);
+    p9_put64(m, path);
+}
+
+static void p9_put_stat_qid(struct p9_msg* m, const struct stat* st)
+{
+    p9_put_qid(m, p9_qid_type(st->st_mode), st->st_ino);
+}
+
+static int p9_stat(int fd, struct stat* st)
+{
+    if (fstatat(fd, "", st, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW))
+        return errno;
+    return 0;
+}
+
+static struct p9_fid* p9_fid_get(struct p9_server* s, uint32_t fid)
+{
+    if (fid >= s->num_fids || !s->fids[fid].used)
+        return NULL;
+    return &s->fids[fid];
+}
+
+/*
+ * Function to allocate fid for the file of the O_PATH descriptor fd. The
+ * descriptor is closed if the fid cannot be allocated.
+ */
+static int p9_fid_new(struct p9_server* s, uint32_t fid, int fd)
+{
+    if (fid >= P9_MAX_FIDS)
+    {
+        close(fd);
+        return EMFILE;
+    }
+
+    if (fid >= s->num_fids)
+    {
+        uint32_t num = s->num_fids ? s->num_fids : 64;
+        struct p9_fid* fids;
+
+        while (num <= fid)
+            num *= 2;
+        fids = realloc(s->fids, num * sizeof(*fids));
+        if (!fids)
+        {
+            close(fd);
+            return ENOMEM;
+        }
+        memset(&fids[s->num_fids], 0, (num - s->num_fids) * sizeof(*fids));
+        s->fids = fids;
+        s->num_fids = num;
+    }
+
+    if (s->fids[fid].used)
+    {
+        close(fd);
+        return EBADF;
+    }
+
+    s->fids[fid].used = true;
+    s->fids[fid].fd = fd;
+    s->fids[fid].open_fd = -1;
+    s->fids[fid].dir = NULL;
+    return 0;
+}
+
+static void p9_fid_close(struct p9_fid* f)
+{
+    if (f->dir)
+        closedir(f->dir);
+    else if (f->open_fd >= 0)
+        close(f->open_fd);
+    close(f->fd);
+    f->used = false;
+}
+
+static bool p9_is_root(struct p9_server* s, int fd)
+{
+    struct stat st;
+
+    return !p9_stat(fd, &st) && st.st_dev == s->root_dev &&
+           st.st_ino == s->root_ino;
+}
+
+static int p9_version(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    char version[32];
+    uint32_t msize = p9_get32(t);
+
+    p9_get_str(t, version, sizeof(version));
+    if (msize < P9_MAX_TMSG)
+        return EINVAL;
+
+    /* A new session starts, forget all fids */
+    for (uint32_t i = 0; i < s->num_fids; i++)
+        if (s->fids[i].used)
+            p9_fid_close(&s->fids[i]);
+
+    s->msize = msize < sizeof(s->rbuf) ? msize : sizeof(s->rbuf);
+    p9_put32(r, s->msize);
+    if (strcmp(version, P9_VERSION) == 0)
+        p9_put_str(r, P9_VERSION, strlen(P9_VERSION));
+    else
+        p9_put_str(r, "unknown", strlen("unknown"));
+    return 0;
+}
+
+static int p9_attach(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    struct stat st;
+    int fd, err;
+    uint32_t fid = p9_get32(t);
+
+    /* afid, uname, aname and n_uname are ignored */
+    fd = fcntl(s->root_fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+        return errno;
+
+    if ((err = p9_stat(fd, &st)) || (err = p9_fid_new(s, fid, fd)))
+        return err;
+
+    p9_put_stat_qid(r, &st);
+    return 0;
+}
+
+/*
+ * Function to open name relative to the O_PATH descriptor dirfd without
+ * leaving the shared directory. Returns the new descriptor or a negative
+ * error code.
+ */
+static int p9_walk_one(struct p9_server* s, int dirfd, const char* name)
+{
+    int fd;
+
+    if (!name[0] || strchr(name, '/'))
+        return -ENOENT;
+
+    /* The parent of the shared directory is the directory itself */
+    if (strcmp(name, "..") == 0 && p9_is_root(s, dirfd))
+        name = ".";
+
+    fd = openat(dirfd, name, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+    return fd < 0 ? -errno : fd;
+}
+
+static int p9_walk(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    char name[NAME_MAX + 1];
+    struct stat st;
+    uint32_t fid = p9_get32(t);
+    uint32_t newfid = p9_get32(t);
+    uint16_t nwname = p9_get16(t);
+    struct p9_fid* f = p9_fid_get(s, fid);
+    size_t nwqid_pos;
+    uint16_t nwqid = 0;
+    int fd;
+
+    if (!f)
+        return EBADF;
+    if (nwname > P9_MAXWELEM)
+        return EINVAL;
+    if (newfid != fid && p9_fid_get(s, newfid))
+        return EBADF;
+
+    fd = fcntl(f->fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+        return errno;
+
+    nwqid_pos = r->pos;
+    p9_put16(r, 0);
+
+    for (; nwqid < nwname; nwqid++)
+    {
+        p9_get_str(t, name, sizeof(name));
+        if (t->overflow)
+            break;
+
+        int next = p9_walk_one(s, fd, name);
+        if (next < 0)
+        {
+            if (nwqid == 0)
+            {
+                close(fd);
+                return -next;
+            }
+            break;
+        }
+        close(fd);
+        fd = next;
+
+        if (p9_stat(fd, &st))
+            break;
+        p9_put_stat_qid(r, &st);
+    }
+
+    /* The new fid is only set up if all names could be walked */
+    if (nwqid == nwname)
+    {
+        int err;
+
+        if (newfid == fid)
+            p9_fid_close(f);
+        if ((err = p9_fid_new(s, newfid, fd)))
+            return err;
+    }
+    else
+        close(fd);
+
+    size_t end = r->pos;
+    r->pos = nwqid_pos;
+    p9_put16(r, nwqid);
+    r->pos = end;
+    return 0;
+}
+
+static int p9_getattr(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    struct p9_fid* f = p9_fid_get(s, p9_get32(t));
+    struct stat st;
+    int err;
+
+    /* request_mask is ignored, the basic attributes are always returned */
+    if (!f)
+        return EBADF;
+    if ((err = p9_stat(f->fd, &st)))
+        return err;
+
+    p9_put64(r, P9_GETATTR_BASIC);
+    p9_put_stat_qid(r, &st);
+    p9_put32(r, st.st_mode & ~(S_ISUID | S_ISGID));
+    p9_put32(r, st.st_uid);
+    p9_put32(r, st.st_gid);
+    p9_put64(r, st.st_nlink);
+    p9_put64(r, st.st_rdev);
+    p9_put64(r, st.st_size);
+    p9_put64(r, st.st_blksize);
+    p9_put64(r, st.st_blocks);
+    p9_put64(r, st.st_atim.tv_sec);
+    p9_put64(r, st.st_atim.tv_nsec);
+    p9_put64(r, st.st_mtim.tv_sec);
+    p9_put64(r, st.st_mtim.tv_nsec);
+    p9_put64(r, st.st_ctim.tv_sec);
+    p9_put64(r, st.st_ctim.tv_nsec);
+    /* btime, gen and data_version are not provided */
+    for (int i = 0; i < 4; i++)
+        p9_put64(r, 0);
+    return 0;
+}
+
+static int p9_lopen(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    struct p9_fid* f = p9_fid_get(s, p9_get32(t));
+    uint32_t flags = p9_get32(t);
+    char path[64];
+    struct stat st;
+    int fd, err;
+
+    if (!f)
+        return EBADF;
+    if (f->open_fd >= 0)
+        return EBADF;
+    if ((flags & O_ACCMODE) != O_RDONLY || (flags & (O_CREAT | O_TRUNC)))
+        return EROFS;
+    if ((err = p9_stat(f->fd, &st)))
+        return err;
+
+    if (S_ISDIR(st.st_mode))
+    {
+        fd = openat(f->fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            return errno;
+        f->dir = fdopendir(fd);
+        if (!f->dir)
+        {
+            err = errno;
+            close(fd);
+            return err;
+        }
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+        /* Reopen the file itself rather than a path, which may have been
+         * replaced since the walk */
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", f->fd);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return errno;
+    }
+    else
+        return S_ISLNK(st.st_mode) ? ELOOP : EACCES;
+
+    f->open_fd = fd;
+    p9_put_stat_qid(r, &st);
+    /* iounit, 0 leaves it to the enclave */
+    p9_put32(r, 0);
+    return 0;
+}
+
+/*
+ * Function to read from a file directly into the reply buffers of req that
+ * follow the reply header at reply_off. Returns the number of bytes read or
+ * a negative error code.
+ */
+static ssize_t p9_read(
+    struct p9_server* s,
+    struct p9_msg* t,
+    struct virtio_req* req,
+    size_t reply_off)
+{
+    struct iovec iov[VIRTIO_REQ_MAX_MERGE_BUFS];
+    struct p9_fid* f = p9_fid_get(s, p9_get32(t));
+    uint64_t offset = p9_get64(t);
+    uint32_t count = p9_get32(t);
+    size_t room = req->total_len - reply_off - P9_IOHDR_SIZE;
+    ssize_t ret;
+
+    if (!f || f->open_fd < 0 || f->dir)
+        return -EBADF;
+    if (offset > LLONG_MAX)
+        return -EINVAL;
+
+    if (count > s->msize - P9_IOHDR_SIZE)
+        count = s->msize - P9_IOHDR_SIZE;
+    if (count > room)
+        count = room;
+
+    int iovcnt = virtio_req_iov(req, reply_off + P9_IOHDR_SIZE, count, iov);
+    do
+        ret = preadv(f->open_fd, iov, iovcnt, offset);
+    while (ret < 0 && errno == EINTR);
+
+    return ret < 0 ? -errno : ret;
+}
+
+static int p9_readdir(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    struct p9_fid* f = p9_fid_get(s, p9_get32(t));
+    uint64_t offset = p9_get64(t);
+    uint32_t count = p9_get32(t);
+    size_t count_pos, start;
+    struct dirent* de;
+
+    if (!f || !f->dir)
+        return EBADF;
+
+    if (offset == 0)
+        rewinddir(f->dir);
+    else
+        seekdir(f->dir, offset);
+
+    if (count > r->size - r->pos - 4)
+        count = r->size - r->pos - 4;
+
+    count_pos = r->pos;
+    p9_put32(r, 0);
+    start = r->pos;
+
+    for (;;)
+    {
+        long pos = telldir(f->dir);
+        size_t len;
+
+        errno = 0;
+        de = readdir(f->dir);
+        if (!de)
+        {
+            if (errno && r->pos == start)
+                return errno;
+            break;
+        }
+
+        /* qid, offset, type and name */
+        len = strlen(de->d_name);
+        if (r->pos - start + 13 + 8 + 1 + 2 + len > count)
+        {
+            /* The entry is returned by the next request */
+            seekdir(f->dir, pos);
+            break;
+        }
+
+        uint8_t qid_type = de->d_type == DT_DIR
+                               ? P9_QTDIR
+                               : de->d_type == DT_LNK ? P9_QTSYMLINK
+                                                      : P9_QTFILE;
+        p9_put_qid(r, qid_type, de->d_ino);
+        p9_put64(r, telldir(f->dir));
+        p9_put8(r, de->d_type);
+        p9_put_str(r, de->d_name, len);
+    }
+
+    size_t end = r->pos;
+    r->pos = count_pos;
+    p9_put32(r, end - start);
+    r->pos = end;
+    return 0;
+}
+
+static int p9_readlink(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    struct p9_fid* f = p9_fid_get(s, p9_get32(t));
+    char target[PATH_MAX];
+    ssize_t len;
+
+    if (!f)
+        return EBADF;
+
+    len = readlinkat(f->fd, "", target, sizeof(target));
+    if (len < 0)
+        return errno;
+    if (len == sizeof(target))
+        return ENAMETOOLONG;
+
+    p9_put_str(r, target, len);
+    return 0;
+}
+
+static int p9_statfs(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    struct p9_fid* f = p9_fid_get(s, p9_get32(t));
+    struct statfs sfs;
+    uint64_t fsid;
+
+    if (!f)
+        return EBADF;
+    if (fstatfs(f->fd, &sfs))
+        return errno;
+
+    memcpy(&fsid, &sfs.f_fsid, sizeof(fsid));
+    p9_put32(r, P9_MAGIC);
+    p9_put32(r, sfs.f_bsize);
+    p9_put64(r, sfs.f_blocks);
+    p9_put64(r, sfs.f_bfree);
+    p9_put64(r, sfs.f_bavail);
+    p9_put64(r, sfs.f_files);
+    p9_put64(r, sfs.f_ffree);
+    p9_put64(r, fsid);
+    p9_put32(r, sfs.f_namelen);
+    return 0;
+}
+
+static int p9_clunk(struct p9_server* s, struct p9_msg* t)
+{
+    struct p9_fid* f = p9_fid_get(s, p9_get32(t));
+
+    if (!f)
+        return EBADF;
+    p9_fid_close(f);
+    return 0;
+}
+
+/*
+ * Locks only need to be consistent within the enclave, which is the only
+ * client of the device
+ */
+static int p9_lock(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    if (!p9_fid_get(s, p9_get32(t)))
+        return EBADF;
+    p9_put8(r, P9_LOCK_SUCCESS);
+    return 0;
+}
+
+static int p9_getlock(struct p9_server* s, struct p9_msg* t, struct p9_msg* r)
+{
+    char client_id[256];
+
+    if (!p9_fid_get(s, p9_get32(t)))
+        return EBADF;
+
+    p9_get8(t);
+    uint64_t start = p9_get64(t);
+    uint64_t length = p9_get64(t);
+    uint32_t proc_id = p9_get32(t);
+    p9_get_str(t, client_id, sizeof(client_id));
+
+    p9_put8(r, P9_LOCK_TYPE_UNLCK);
+    p9_put64(r, start);
+    p9_put64(r, length);
+    p9_put32(r, proc_id);
+    p9_put_str(r, client_id, strlen(client_id));
+    return 0;
+}
+
+/*
+ * Function to handle a request other than a read. Returns 0 with the reply
+ * body in r or an error code.
+ */
+static int p9_handle(
+    struct p9_server* s,
+    uint8_t type,
+    struct p9_msg* t,
+    struct p9_msg* r)
+{
+    switch (type)
+    {
+        case P9_TVERSION:
+            return p9_version(s, t, r);
+        case P9_TATTACH:
+            return p9_attach(s, t, r);
+        case P9_TWALK:
+            return p9_walk(s, t, r);
+        case P9_TGETATTR:
+            return p9_getattr(s, t, r);
+        case P9_TLOPEN:
+            return p9_lopen(s, t, r);
+        case P9_TREADDIR:
+            return p9_readdir(s, t, r);
+        case P9_TREADLINK:
+            return p9_readlink(s, t, r);
+        case P9_TSTATFS:
+            return p9_statfs(s, t, r);
+        case P9_TCLUNK:
+            return p9_clunk(s, t);
+        case P9_TLOCK:
+            return p9_lock(s, t, r);
+        case P9_TGETLOCK:
+            return p9_getlock(s, t, r);
+        case P9_TFLUSH:
+        case P9_TFSYNC:
+            /* Requests are served in order and nothing is written */
+            return 0;
+        case P9_TREMOVE:
+            /* A remove clunks the fid even if it fails */
+            p9_clunk(s, t);
+            return EROFS;
+        case P9_TLCREATE:
+        case P9_TSYMLINK:
+        case P9_TMKNOD:
+        case P9_TRENAME:
+        case P9_TSETATTR:
+        case P9_TXATTRCREATE:
+        case P9_TLINK:
+        case P9_TMKDIR:
+        case P9_TRENAMEAT:
+        case P9_TUNLINKAT:
+        case P9_TWRITE:
+            return EROFS;
+        default:
+            /* Including extended attributes */
+            return EOPNOTSUPP;
+    }
+}
+
+static void p9_put_hdr(
+    struct p9_msg* r,
+    uint32_t size,
+    uint8_t type,
+    uint16_t tag)
+{
+    r->pos = 0;
+    p9_put32(r, size);
+    p9_put8(r, type);
+    p9_put16(r, tag);
+}
+
+/*
+ * Function to serve a request. The request message is followed by the
+ * buffers for the reply.
+ */
+static int p9_enqueue(struct virtio_dev* dev, int q, struct virtio_req* req)
+{
+    struct p9_server* s = &_p9;
+    struct p9_msg t = {.data = s->tbuf, .size = P9_HDR_SIZE};
+    struct p9_msg r = {.data = s->rbuf, .size = sizeof(s->rbuf)};
+    uint32_t size, reply_len = 0;
+    uint8_t type, rtype;
+    uint16_t tag;
+    int err;
+
+    if (virtio_req_copy(req, 0, s->tbuf, P9_HDR_SIZE, false) < P9_HDR_SIZE)
+        goto out;
+
+    size = p9_get32(&t);
+    type = p9_get8(&t);
+    tag = p9_get16(&t);
+    rtype = type + 1;
+    if (size < P9_HDR_SIZE || size + P9_IOHDR_SIZE > req->total_len)
+    {
+        sgxlkl_host_warn("9p: malformed request of type %u\n", type);
+        goto out;
+    }
+
+    t.size = size < sizeof(s->tbuf) ? size : sizeof(s->tbuf);
+    virtio_req_copy(
+        req,
+        P9_HDR_SIZE,
+        s->tbuf + P9_HDR_SIZE,
+        t.size - P9_HDR_SIZE,
+        false);
+
+    /* The reply must fit the buffers of the enclave */
+    if (r.size > req->total_len - size)
+        r.size = req->total_len - size;
+    r.pos = P9_HDR_SIZE;
+
+    if (type == P9_TREAD)
+    {
+        ssize_t n = p9_read(s, &t, req, size);
+        if (n >= 0 && !t.overflow)
+        {
+            p9_put_hdr(&r, P9_IOHDR_SIZE + n, rtype, tag);
+            p9_put32(&r, n);
+            virtio_req_copy(req, size, s->rbuf, P9_IOHDR_SIZE, true);
+            reply_len = P9_IOHDR_SIZE + n;
+            goto out;
+        }
+        err = t.overflow ? EINVAL : -n;
+    }
+    else if (size > sizeof(s->tbuf))
+        err = type == P9_TWRITE ? EROFS : EINVAL;
+    else
+    {
+        err = p9_handle(s, type, &t, &r);
+        if (!err && (t.overflow || r.overflow))
+            err = t.overflow ? EINVAL : ENOBUFS;
+    }
+
+    if (err)
+    {
+        r.pos = P9_HDR_SIZE;
+        p9_put32(&r, err);
+        rtype = P9_RLERROR;
+    }
+
+    reply_len = r.pos;
+    p9_put_hdr(&r, reply_len, rtype, tag);
+    virtio_req_copy(req, size, s->rbuf, reply_len, true);
+
+out:
+    virtio_req_complete(req, reply_len);
+    return 0;
+}
+
+/*
+ * Function to check the features supported
+ */
+static int p9_check_features(struct virtio_dev* dev)
+{
+    if ((dev->driver_features & ~dev->device_features) == 0)
+        return 0;
+
+    return -EINVAL;
+}
+
+static struct virtio_dev_ops host_9p_ops = {
+    .check_features = p9_check_features,
+    .enqueue = p9_enqueue,
+};
+
+/*
+ * Function to initialize the 9p device based on the user config
+ * This function allocates the memory for virtio device & virtio ring buffer.
+ * The shared memory is shared between host & enclave
+ */
+int virtio_9p_init(sgxlkl_host_state_t* host_state, host_dev_config_t* cfg)
+{
+    struct p9_server* s = &_p9;
+    const char* path = host_state->config.host_dir;
+    void* p9_vq_mem = NULL;
+    struct stat st;
+
+    size_t host_9p_size = next_pow2(sizeof(struct virtio_9p_dev));
+    size_t p9_vq_size = next_pow2(NUM_QUEUES * sizeof(struct virtq));
+
+    /* 9p host device configuration */
+    _cfg = cfg;
+
+    s->root_fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (s->root_fd < 0 || fstat(s->root_fd, &st))
+        sgxlkl_host_fail(
+            "9p: failed to open host directory %s: %s\n",
+            path,
+            strerror(errno));
+    s->root_dev = st.st_dev;
+    s->root_ino = st.st_ino;
+    s->msize = sizeof(s->rbuf);
+
+    /* Allocate memory for 9p device */
+    _9p_dev = mmap(
+        0,
+        host_9p_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS,
+        -1,
+        0);
+
+    if (_9p_dev == MAP_FAILED)
+    {
+        sgxlkl_host_fail("Host 9p device mem alloc failed\n");
+        return -1;
+    }
+
+    /* Allocate memory for virtio queue */
+    p9_vq_mem = mmap(
+        0,
+        p9_vq_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS,
+        -1,
+        0);
+
+    if (p9_vq_mem == MAP_FAILED)
+    {
+        sgxlkl_host_fail("Host 9p device virtio queue mem alloc failed\n");
+        return -1;
+    }
+
+    struct virtio_dev* dev = &_9p_dev->dev;
+
+    dev->queue = p9_vq_mem;
+    memset(dev->queue, 0, p9_vq_size);
+
+    /* assign the queue depth to each virt queue */
+    for (int i = 0; i < NUM_QUEUES; i++)
+    {
+        dev->queue[i].num_max = QUEUE_DEPTH;
+        virtio_set_queue_coalescing(
+            dev,
+            i,
+            host_state->config.virtio_completion_batch,
+            host_state->config.virtio_completion_delay_us);
+    }
+
+    _9p_dev->config.tag_len = htole16(strlen(SGXLKL_HOST_DIR_TAG));
+    memcpy(
+        _9p_dev->config.tag, SGXLKL_HOST_DIR_TAG, strlen(SGXLKL_HOST_DIR_TAG));
+    dev->config_data = &_9p_dev->config;
+    dev->config_len = sizeof(_9p_dev->config);
+
+    /* set 9p device feature */
+    dev->device_id = VIRTIO_ID_9P;
+    dev->vendor_id = _cfg->dev_id;
+    dev->device_features = BIT(VIRTIO_F_VERSION_1) |
+                           BIT(VIRTIO_RING_F_EVENT_IDX) |
+                           BIT(VIRTIO_9P_MOUNT_TAG);
+
+    if (host_state->enclave_config.mode != SW_DEBUG_MODE)
+        dev->device_features |= BIT(VIRTIO_F_IOMMU_PLATFORM);
+
+    if (host_state->config.packed_virtqueues)
+        dev->device_features |= BIT(VIRTIO_F_RING_PACKED);
+
+    dev->ops = &host_9p_ops;
+
+    host_state->shared_memory.virtio_9p_mem = dev;
+
+    return 0;
+}
+
+/*
+ * Host 9p task for monitoring the virtio events from host
+ * and processing the request
+ */
+void* p9_task(void* arg)
+{
+    int timeout_ms = WAIT_FOR_EVENT_TIMEOUT;
+    struct virtio_dev* dev = &_9p_dev->dev;
+
+    pthread_mutex_init(&(_cfg->lock), NULL);
+    pthread_cond_init(&(_cfg->cond), NULL);
+
+    while (1)
+    {
+        vio_host_process_enclave_event(_cfg->dev_id, timeout_ms);
+
+        if (vio_host_check_guest_shutdown_evt())
+            continue;
+
+        virtio_process_queue(dev, REQUEST_QUEUE_ID);
+    }
+}
@@ -1,23 +1,105 @@
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <endian.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <host/host_cow.h>
+#include <host/host_io_uring.h>
 #include <host/host_state.h>
+#include <host/host_threads.h>
 #include <host/sgxlkl_u.h>
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
 #include <host/virtio_blkdev.h>
 #include <host/virtio_debug.h>
+#include <limits.h>
+#include <pthread.h>
 #include <shared/env.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
 
 #define min_len(a, b) (a < b ? a : b)
 
-#define HOST_BLK_DEV_NUM_QUEUES 1
-#define HOST_BLK_DEV_QUEUE_DEPTH 32
+#define HOST_BLK_DEV_DEFAULT_NUM_QUEUES 1
+#define HOST_BLK_DEV_MAX_NUM_QUEUES 16
+#define HOST_BLK_DEV_DEFAULT_QUEUE_DEPTH 32
+#define HOST_BLK_DEV_MAX_QUEUE_DEPTH 1024
+
+/* Largest data segment accepted by the device. The guest may bounce
+ * segments through swiotlb, which maps at most 256 KiB at a time. */
+#define HOST_BLK_DEV_SIZE_MAX (128 * 1024)
+
+/* Granularity (in sectors) of discarded ranges, the host page size */
+#define HOST_BLK_DEV_DISCARD_ALIGNMENT (PAGE_SIZE / 512)
+
+/* Number of consecutive sequential (or random) reads after which the access
+ * pattern of a disk is considered sequential (or random) */
+#define HOST_BLK_DEV_PATTERN_THRESHOLD 4
+/* Default size of the range read ahead of sequential reads */
+#define HOST_BLK_DEV_DEFAULT_READAHEAD_WINDOW (1024 * 1024)
 
 extern sgxlkl_host_state_t sgxlkl_host_state;
 
+/*
+ * Host-side state of one request queue of a block device
+ */
+struct blk_queue
+{
+    struct virtio_dev* dev;
+    uint32_t qidx;
+
+    /* io_uring instance used to submit requests asynchronously, NULL if
+     * requests are processed synchronously */
+    struct host_uring* ring;
+    unsigned inflight;
+
+    /* Worker serving the queue of a multi-queue device. The device thread
+     * waits on the event channel of the disk and kicks the workers of the
+     * queues that have pending requests. */
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;
+};
+
+static struct blk_queue* _blk_queues[HOST_MAX_DISKS];
+
+/*
+ * Host-side state of a disk shared by all its queues
+ */
+struct blk_disk_state
+{
+    pthread_mutex_t lock;
+
+    /* Page-aligned range written to the memory mapping of the disk since
+     * the last flush */
+    size_t dirty_start;
+    size_t dirty_end;
+
+    /* Access pattern of reads: the offset at which a sequential read would
+     * start, the number of consecutive sequential (positive) or random
+     * (negative) reads, and the current madvise() advice of the mapping */
+    size_t next_offset;
+    int streak;
+    int advice;
+
+    /* Range read ahead of the current sequential stream */
+    size_t ra_window;
+    size_t ra_start;
+    size_t ra_end;
+
+    /* Statistics */
+    uint64_t num_reads;
+    uint64_t num_ra_hits;
+    uint64_t ra_bytes;
+};
+
+static struct blk_disk_state _blk_disk_state[HOST_MAX_DISKS];
+
 #if DEBUG && VIRTIO_TEST_HOOK
 static uint64_t virtio_blk_req_cnt;
 #endif // DEBUG && VIRTIO_TEST_HOOK
@@ -33,6 +115,431 @@ static inline sgxlkl_host_disk_state_t* get_disk_config(uint8_t blkdev_id)
     return disk;
 }
 
+/*
+ * Total length of the data segments of a request, i.e. of all buffers
+ * between the request header and the status trailer
+ */
+static size_t blk_data_len(struct virtio_req* req)
+{
+    size_t len = 0;
+    for (int i = 1; i < req->buf_count - 1; i++)
+        len += req->buf[i].iov_len;
+    return len;
+}
+
+/*
+ * Update the access pattern of a disk with a read of len bytes at offset.
+ * Once reads are found to be sequential, the range following them is read
+ * ahead asynchronously into the host page cache, so that subsequent reads
+ * hit memory. Memory-mapped disks also get matching madvise() hints.
+ */
+static void blk_track_read(
+    sgxlkl_host_disk_state_t* disk,
+    struct blk_disk_state* ds,
+    bool mmap_io,
+    size_t offset,
+    size_t len)
+{
+    size_t start, end;
+
+    pthread_mutex_lock(&ds->lock);
+
+    ds->num_reads++;
+    if (offset >= ds->ra_start && offset + len <= ds->ra_end)
+        ds->num_ra_hits++;
+
+    if (offset == ds->next_offset)
+        ds->streak = ds->streak < 0 ? 1 : ds->streak + 1;
+    else
+        ds->streak = ds->streak > 0 ? -1 : ds->streak - 1;
+    ds->next_offset = offset + len;
+
+    if (mmap_io)
+    {
+        int advice = ds->advice;
+        if (ds->streak >= HOST_BLK_DEV_PATTERN_THRESHOLD)
+            advice = MADV_SEQUENTIAL;
+        else if (ds->streak <= -HOST_BLK_DEV_PATTERN_THRESHOLD)
+            advice = MADV_RANDOM;
+
+        if (advice != ds->advice)
+        {
+            madvise(disk->mmap, disk->size, advice);
+            ds->advice = advice;
+        }
+    }
+
+    /* Extend the readahead range once half of it has been consumed */
+    if (ds->streak >= HOST_BLK_DEV_PATTERN_THRESHOLD &&
+        ds->next_offset < disk->size &&
+        ds->next_offset + ds->ra_window / 2 > ds->ra_end)
+    {
+        start = ds->next_offset & ~(size_t)(PAGE_SIZE - 1);
+        end = min_len(start + ds->ra_window, disk->size);
+
+        /* Only read ahead what the current range does not cover yet */
+        if (start >= ds->ra_start && start <= ds->ra_end)
+            start = ds->ra_end;
+        else
+            ds->ra_start = start;
+
+        if (end > start)
+        {
+            if (mmap_io)
+                madvise(disk->mmap + start, end - start, MADV_WILLNEED);
+            else
+                posix_fadvise(
+                    disk->fd, start, end - start, POSIX_FADV_WILLNEED);
+
+            ds->ra_end = end;
+            ds->ra_bytes += end - start;
+        }
+    }
+
+    pthread_mutex_unlock(&ds->lock);
+}
+
+/* Add a range to the dirty range of the memory mapping of the disk */
+static void blk_mark_dirty(struct blk_disk_state* ds, size_t start, size_t end)
+{
+    pthread_mutex_lock(&ds->lock);
+    if (ds->dirty_start == ds->dirty_end)
+    {
+        ds->dirty_start = start;
+        ds->dirty_end = end;
+    }
+    else
+    {
+        ds->dirty_start = min_len(ds->dirty_start, start);
+        ds->dirty_end = ds->dirty_end > end ? ds->dirty_end : end;
+    }
+    pthread_mutex_unlock(&ds->lock);
+}
+
+/*
+ * Process a request by copying from or into the host memory mapping of the
+ * disk image instead of issuing a system call. Writes are made durable by
+ * msync() when the guest flushes.
+ */
+static int blk_mmap_io(
+    sgxlkl_host_disk_state_t* disk,
+    struct blk_disk_state* ds,
+    bool readonly,
+    struct virtio_blk_outhdr* h,
+    struct virtio_req* req)
+{
+    size_t offset = h->sector * 512;
+    size_t len = blk_data_len(req);
+    size_t start, end;
+    int ret = LKL_DEV_BLK_STATUS_OK;
+
+    switch (h->type)
+    {
+        case LKL_DEV_BLK_TYPE_READ:
+            if (offset > disk->size || len > disk->size - offset)
+                return LKL_DEV_BLK_STATUS_IOERR;
+
+            for (int i = 1; i < req->buf_count - 1; i++)
+            {
+                memcpy(
+                    req->buf[i].iov_base,
+                    disk->mmap + offset,
+                    req->buf[i].iov_len);
+                offset += req->buf[i].iov_len;
+            }
+
+            blk_track_read(disk, ds, true, h->sector * 512, len);
+            break;
+        case LKL_DEV_BLK_TYPE_WRITE:
+            if (readonly || offset > disk->size || len > disk->size - offset)
+                return LKL_DEV_BLK_STATUS_IOERR;
+
+            for (int i = 1; i < req->buf_count - 1; i++)
+            {
+                memcpy(
+                    disk->mmap + offset,
+                    req->buf[i].iov_base,
+                    req->buf[i].iov_len);
+                offset += req->buf[i].iov_len;
+            }
+
+            start = (h->sector * 512) & ~(size_t)(PAGE_SIZE - 1);
+            blk_mark_dirty(ds, start, offset);
+            break;
+        case LKL_DEV_BLK_TYPE_FLUSH:
+        case LKL_DEV_BLK_TYPE_FLUSH_OUT:
+            pthread_mutex_lock(&ds->lock);
+            start = ds->dirty_start;
+            end = ds->dirty_end;
+            ds->dirty_start = ds->dirty_end = 0;
+            pthread_mutex_unlock(&ds->lock);
+
+            // Keep the range dirty if it could not be synced, so that the
+            // next flush does not report data as durable that is not
+            if (start != end &&
+                msync(disk->mmap + start, end - start, MS_SYNC) < 0)
+            {
+                blk_mark_dirty(ds, start, end);
+                ret = LKL_DEV_BLK_STATUS_IOERR;
+            }
+            break;
+        default:
+            ret = LKL_DEV_BLK_STATUS_UNSUP;
+    }
+
+    return ret;
+}
+
+/*
+ * Zero a range of the disk image by writing zero blocks, for files and
+ * devices that support neither hole punching nor zero ranges
+ */
+static int blk_write_zeroes_slow(int fd, off_t offset, off_t len)
+{
+    static const char zeroes[PAGE_SIZE];
+    ssize_t ret;
+
+    while (len > 0)
+    {
+        ret = pwrite(fd, zeroes, min_len(len, sizeof(zeroes)), offset);
+        if (ret < 0)
+            return -1;
+        offset += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/*
+ * Process a DISCARD or WRITE_ZEROES request. Both deallocate the ranges of
+ * sparse disk images where possible, so that images stay sparse.
+ */
+static int blk_discard_write_zeroes(
+    int fd,
+    size_t disk_size,
+    uint32_t type,
+    struct virtio_req* req)
+{
+    struct virtio_blk_discard_write_zeroes* range;
+    off_t offset, len;
+    int mode;
+
+    for (int i = 1; i < req->buf_count - 1; i++)
+    {
+        if (req->buf[i].iov_len % sizeof(*range))
+            return LKL_DEV_BLK_STATUS_IOERR;
+
+        for (range = req->buf[i].iov_base;
+             (char*)range < (char*)req->buf[i].iov_base + req->buf[i].iov_len;
+             range++)
+        {
+            offset = range->sector * 512;
+            len = (off_t)range->num_sectors * 512;
+
+            if (range->sector > disk_size / 512 ||
+                range->num_sectors > disk_size / 512 - range->sector)
+                return LKL_DEV_BLK_STATUS_IOERR;
+
+            if (type == LKL_DEV_BLK_TYPE_DISCARD)
+            {
+                /* Discarding is only a hint, ignore failures */
+                fallocate(
+                    fd,
+                    FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    offset,
+                    len);
+                continue;
+            }
+
+            mode = range->flags & VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP
+                       ? FALLOC_FL_PUNCH_HOLE
+                       : FALLOC_FL_ZERO_RANGE;
+            if (fallocate(fd, mode | FALLOC_FL_KEEP_SIZE, offset, len) == 0)
+                continue;
+
+            /* Punched holes read back as zeroes, too */
+            if (mode == FALLOC_FL_ZERO_RANGE &&
+                fallocate(
+                    fd,
+                    FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    offset,
+                    len) == 0)
+                continue;
+
+            if (blk_write_zeroes_slow(fd, offset, len))
+                return LKL_DEV_BLK_STATUS_IOERR;
+        }
+    }
+
+    return LKL_DEV_BLK_STATUS_OK;
+}
+
+/*
+ * Serve a request of a copy-on-write disk, whose reads and writes go to the
+ * base image or the delta file
+ */
+static uint8_t blk_cow_io(
+    sgxlkl_host_disk_state_t* disk,
+    struct virtio_blk_outhdr* h,
+    struct virtio_req* req)
+{
+    size_t offset = h->sector * 512;
+    size_t len = blk_data_len(req);
+    ssize_t ret;
+
+    switch (h->type)
+    {
+        case LKL_DEV_BLK_TYPE_READ:
+            ret = host_cow_preadv(
+                disk->cow, &req->buf[1], req->buf_count - 2, offset);
+            blk_track_read(
+                disk,
+                &_blk_disk_state[disk - sgxlkl_host_state.disks],
+                false,
+                offset,
+                len);
+            break;
+        case LKL_DEV_BLK_TYPE_WRITE:
+            ret = host_cow_pwritev(
+                disk->cow, &req->buf[1], req->buf_count - 2, offset);
+            break;
+        case LKL_DEV_BLK_TYPE_FLUSH:
+        case LKL_DEV_BLK_TYPE_FLUSH_OUT:
+            return host_cow_fsync(disk->cow) == 0 ? LKL_DEV_BLK_STATUS_OK
+                                                  : LKL_DEV_BLK_STATUS_IOERR;
+        default:
+            return LKL_DEV_BLK_STATUS_UNSUP;
+    }
+
+    return ret >= 0 && (size_t)ret == len ? LKL_DEV_BLK_STATUS_OK
+                                          : LKL_DEV_BLK_STATUS_IOERR;
+}
+
+/*
+ * Submit a request through the io_uring instance of the queue. Returns a
+ * negative value if the request could not be queued, in which case it is
+ * left to the synchronous path.
+ */
+static int blk_enqueue_async(
+    struct blk_queue* bq,
+    int fd,
+    struct virtio_blk_outhdr* h,
+    struct virtio_req* req)
+{
+    struct virtio_req* areq;
+    int op;
+
+    switch (h->type)
+    {
+        case LKL_DEV_BLK_TYPE_READ:
+            op = HOST_URING_OP_READV;
+            blk_track_read(
+                get_disk_config(bq->dev->vendor_id),
+                &_blk_disk_state[bq->dev->vendor_id],
+                false,
+                h->sector * 512,
+                blk_data_len(req));
+            break;
+        case LKL_DEV_BLK_TYPE_WRITE:
+            op = HOST_URING_OP_WRITEV;
+            break;
+        case LKL_DEV_BLK_TYPE_FLUSH:
+        case LKL_DEV_BLK_TYPE_FLUSH_OUT:
+            op = HOST_URING_OP_FSYNC;
+            break;
+        default:
+            return -1;
+    }
+
+    areq = virtio_req_detach(req);
+    if (!areq)
+        return -1;
+
+    /* The iovecs of the detached request stay valid until completion. A
+     * flush carries no data. */
+    bool flush = op == HOST_URING_OP_FSYNC;
+    if (host_uring_prep(
+            bq->ring,
+            op,
+            fd,
+            flush ? NULL : &areq->buf[1],
+            flush ? 0 : areq->buf_count - 2,
+            flush ? 0 : h->sector * 512,
+            areq) < 0)
+    {
+        /* Cannot happen as the ring is as large as the queue */
+        sgxlkl_host_fail("%s: io_uring submission queue full\n", __func__);
+    }
+    bq->inflight++;
+
+    return 0;
+}
+
+/*
+ * Complete all requests of the queue whose asynchronous I/O has finished
+ */
+static void blk_reap_async(struct blk_queue* bq)
+{
+    struct virtio_req* req;
+    struct virtio_blk_outhdr* h;
+    struct virtio_blk_req_trailer* t;
+    size_t expected;
+    int res;
+
+    virtio_queue_batch_begin(bq->dev, bq->qidx);
+    while (host_uring_reap(bq->ring, (void**)&req, &res))
+    {
+        h = req->buf[0].iov_base;
+        t = req->buf[req->buf_count - 1].iov_base;
+        expected = (h->type == LKL_DEV_BLK_TYPE_READ ||
+                    h->type == LKL_DEV_BLK_TYPE_WRITE)
+                       ? blk_data_len(req)
+                       : 0;
+        t->status = res < 0 || (size_t)res != expected
+                        ? LKL_DEV_BLK_STATUS_IOERR
+                        : LKL_DEV_BLK_STATUS_OK;
+        bq->inflight--;
+        virtio_req_complete(req, 0);
+    }
+    virtio_queue_batch_end(bq->dev, bq->qidx);
+}
+
+/*
+ * Process up to max_reqs available requests of a queue. With io_uring,
+ * requests are submitted in one batch and completed out of order; requests
+ * that become available while others are in flight are submitted as
+ * completions are reaped, so the function only returns once no request is
+ * in flight. Returns the number of requests processed.
+ */
+static int blk_process_queue_batch(struct blk_queue* bq, int max_reqs)
+{
+    int ret, n;
+
+    n = virtio_process_queue_batch(bq->dev, bq->qidx, max_reqs);
+
+    while (bq->ring && bq->inflight)
+    {
+        ret = host_uring_submit(bq->ring, 1);
+        if (ret < 0 && ret != -EAGAIN && ret != -EBUSY)
+            sgxlkl_host_fail(
+                "%s: io_uring_enter failed: %s\n", __func__, strerror(-ret));
+
+        blk_reap_async(bq);
+        if (n < max_reqs)
+            n += virtio_process_queue_batch(bq->dev, bq->qidx, max_reqs - n);
+    }
+
+    return n;
+}
+
+/*
+ * Process all available requests of a queue, until the queue is idle
+ */
+static void blk_process_queue(struct blk_queue* bq)
+{
+    blk_process_queue_batch(bq, INT_MAX);
+}
+
 /*
  * Virtio callback functions for processing virtio requests
  */
@@ -41,9 +548,10 @@ static int blk_enqueue(struct virtio_dev* dev, int q, struct virtio_req* req)
     struct virtio_blk_outhdr* h;
     struct virtio_blk_req_trailer* t;
     size_t offset;
-    int ret;
+    ssize_t ret;
 
     sgxlkl_host_disk_state_t* disk = get_disk_config(dev->vendor_id);
+    struct blk_queue* bq = &_blk_queues[dev->vendor_id][q];
     int fd = disk->fd;
 
     if (req->buf_count < 3)
@@ -60,24 +568,61 @@ static int blk_enqueue(struct virtio_dev* dev, int q, struct virtio_req* req)
     if (req->buf[req->buf_count - 1].iov_len != sizeof(*t))
         goto out;
 
+    if (sgxlkl_host_state.config.disk_mmap_io && disk->mmap &&
+        h->type != LKL_DEV_BLK_TYPE_DISCARD &&
+        h->type != LKL_DEV_BLK_TYPE_WRITE_ZEROES)
+    {
+        t->status = blk_mmap_io(
+            disk,
+            &_blk_disk_state[dev->vendor_id],
+            disk->root_config ? disk->root_config->readonly
+                              : disk->mount_config->readonly,
+            h,
+            req);
+        goto out;
+    }
+
+    if (bq->ring && blk_enqueue_async(bq, fd, h, req) == 0)
+        return 0;
+
+    if (disk->cow)
+    {
+        t->status = blk_cow_io(disk, h, req);
+        goto out;
+    }
+
     offset = h->sector * 512;
 
     switch (h->type)
     {
         case LKL_DEV_BLK_TYPE_READ:
-            ret = pread(fd, req->buf[1].iov_base, req->buf[1].iov_len, offset);
+            ret = preadv(fd, &req->buf[1], req->buf_count - 2, offset);
+            if (ret >= 0 && (size_t)ret == blk_data_len(req))
+                t->status = LKL_DEV_BLK_STATUS_OK;
+            blk_track_read(
+                disk,
+                &_blk_disk_state[dev->vendor_id],
+                false,
+                offset,
+                blk_data_len(req));
             break;
         case LKL_DEV_BLK_TYPE_WRITE:
-            ret = pwrite(fd, req->buf[1].iov_base, req->buf[1].iov_len, offset);
+            ret = pwritev(fd, &req->buf[1], req->buf_count - 2, offset);
+            if (ret >= 0 && (size_t)ret == blk_data_len(req))
+                t->status = LKL_DEV_BLK_STATUS_OK;
             break;
         case LKL_DEV_BLK_TYPE_FLUSH:
         case LKL_DEV_BLK_TYPE_FLUSH_OUT:
-            ret = fsync(fd);
+            if (fsync(fd) == 0)
+                t->status = LKL_DEV_BLK_STATUS_OK;
+            break;
+        case LKL_DEV_BLK_TYPE_DISCARD:
+        case LKL_DEV_BLK_TYPE_WRITE_ZEROES:
+            t->status = blk_discard_write_zeroes(fd, disk->size, h->type, req);
             break;
         default:
-            ret = LKL_DEV_BLK_STATUS_UNSUP;
+            t->status = LKL_DEV_BLK_STATUS_UNSUP;
     }
-    t->status = ret;
 
 out:
     virtio_req_complete(req, 0);
@@ -112,7 +657,44 @@ int blk_device_init(
     void* vq_mem = NULL;
     struct virtio_blk_dev* host_blk_device = NULL;
     size_t bdev_size = sizeof(struct virtio_blk_dev);
-    size_t vq_size = HOST_BLK_DEV_NUM_QUEUES * sizeof(struct virtq);
+    uint64_t num_queues = disk->root_config ? disk->root_config->num_queues
+                                            : disk->mount_config->num_queues;
+    uint64_t queue_depth = disk->root_config ? disk->root_config->queue_depth
+                                             : disk->mount_config->queue_depth;
+    bool readonly = disk->root_config ? disk->root_config->readonly
+                                      : disk->mount_config->readonly;
+    size_t ra_window = sgxlkl_host_state.config.readahead_window;
+
+    if (num_queues == 0)
+        num_queues = HOST_BLK_DEV_DEFAULT_NUM_QUEUES;
+    if (queue_depth == 0)
+        queue_depth = HOST_BLK_DEV_DEFAULT_QUEUE_DEPTH;
+
+    if (num_queues > HOST_BLK_DEV_MAX_NUM_QUEUES)
+        sgxlkl_host_fail(
+            "%s: disk %zu: number of queues must be at most %d\n",
+            __func__,
+            disk_index,
+            HOST_BLK_DEV_MAX_NUM_QUEUES);
+
+    if (queue_depth > HOST_BLK_DEV_MAX_QUEUE_DEPTH ||
+        (queue_depth & (queue_depth - 1)))
+        sgxlkl_host_fail(
+            "%s: disk %zu: queue depth must be a power of two of at most %d\n",
+            __func__,
+            disk_index,
+            HOST_BLK_DEV_MAX_QUEUE_DEPTH);
+
+    if (ra_window == 0)
+        ra_window = HOST_BLK_DEV_DEFAULT_READAHEAD_WINDOW;
+
+    if (ra_window < 2 * PAGE_SIZE)
+        sgxlkl_host_fail(
+            "%s: readahead window must be at least %d bytes\n",
+            __func__,
+            2 * PAGE_SIZE);
+
+    size_t vq_size = num_queues * sizeof(struct virtq);
 
     /*Allocate memory for block device*/
     bdev_size = next_pow2(bdev_size);
@@ -142,10 +724,27 @@ int blk_device_init(
     /* Initialize block device */
     host_blk_device->dev.queue = vq_mem;
     memset(host_blk_device->dev.queue, 0, vq_size);
-    for (int i = 0; i < HOST_BLK_DEV_NUM_QUEUES; i++)
-        host_blk_device->dev.queue[i].num_max = HOST_BLK_DEV_QUEUE_DEPTH;
+    for (int i = 0; i < num_queues; i++)
+    {
+        host_blk_device->dev.queue[i].num_max = queue_depth;
+        virtio_set_queue_coalescing(
+            &host_blk_device->dev,
+            i,
+            sgxlkl_host_state.config.virtio_completion_batch,
+            sgxlkl_host_state.config.virtio_completion_delay_us);
+    }
 
     host_blk_device->config.capacity = disk->size / 512;
+    pthread_mutex_init(&_blk_disk_state[disk_index].lock, NULL);
+    _blk_disk_state[disk_index].advice = MADV_NORMAL;
+    _blk_disk_state[disk_index].ra_window = ra_window;
+
+    /* A request carries a header and a status trailer besides its data
+     * segments and must fit both into a virtio_req and into the queue */
+    host_blk_device->config.size_max = HOST_BLK_DEV_SIZE_MAX;
+    host_blk_device->config.seg_max =
+        queue_depth > 4 ? min_len(queue_depth, VIRTIO_REQ_MAX_BUFS) - 2 : 1;
+    host_blk_device->config.num_queues = num_queues;
 
     /* Initialize virtio dev */
     host_blk_device->dev.device_id = VIRTIO_ID_BLOCK;
@@ -156,11 +755,41 @@ int blk_device_init(
     host_blk_device->dev.ops = &_host_blk_ops;
     host_blk_device->dev.int_status = 0;
     host_blk_device->dev.device_features |=
-        BIT(VIRTIO_F_VERSION_1) | BIT(VIRTIO_RING_F_EVENT_IDX);
+        BIT(VIRTIO_F_VERSION_1) | BIT(VIRTIO_RING_F_EVENT_IDX) |
+        BIT(VIRTIO_BLK_F_SIZE_MAX) | BIT(VIRTIO_BLK_F_SEG_MAX);
 
     if (enable_swiotlb)
         host_blk_device->dev.device_features |= BIT(VIRTIO_F_IOMMU_PLATFORM);
 
+    if (num_queues > 1)
+        host_blk_device->dev.device_features |= BIT(VIRTIO_BLK_F_MQ);
+
+    if (sgxlkl_host_state.config.packed_virtqueues)
+        host_blk_device->dev.device_features |= BIT(VIRTIO_F_RING_PACKED);
+
+    /* Without FLUSH, the guest treats the device as write-through and never
+     * asks for writes to be made durable on the host */
+    if (!readonly)
+        host_blk_device->dev.device_features |= BIT(VIRTIO_BLK_F_FLUSH);
+
+    /* Discarded and zeroed ranges are deallocated in the disk image. This
+     * is not supported for copy-on-write disks, as the ranges would have to
+     * mask the base image. */
+    if (!readonly && !disk->cow)
+    {
+        host_blk_device->config.max_discard_sectors = UINT32_MAX;
+        host_blk_device->config.max_discard_seg =
+            host_blk_device->config.seg_max;
+        host_blk_device->config.discard_sector_alignment =
+            HOST_BLK_DEV_DISCARD_ALIGNMENT;
+        host_blk_device->config.max_write_zeroes_sectors = UINT32_MAX;
+        host_blk_device->config.max_write_zeroes_seg =
+            host_blk_device->config.seg_max;
+        host_blk_device->config.write_zeroes_may_unmap = 1;
+        host_blk_device->dev.device_features |=
+            BIT(VIRTIO_BLK_F_DISCARD) | BIT(VIRTIO_BLK_F_WRITE_ZEROES);
+    }
+
     sgxlkl_host_state.shared_memory.virtio_blk_dev_mem[disk_index] =
         &host_blk_device->dev;
     sgxlkl_host_state.shared_memory.virtio_blk_dev_names[disk_index] =
@@ -169,9 +798,151 @@ int blk_device_init(
     return 0;
 }
 
+/*
+ * Print the readahead statistics of a disk
+ */
+void blk_device_print_stats(size_t disk_index)
+{
+    struct blk_disk_state* ds = &_blk_disk_state[disk_index];
+    uint64_t hit_rate =
+        ds->num_reads ? ds->num_ra_hits * 10000 / ds->num_reads : 0;
+
+    sgxlkl_host_verbose(
+        "Disk %zu: %" PRIu64 " reads, readahead hit rate %" PRIu64
+        ".%02" PRIu64 "%%, %" PRIu64 " KiB read ahead\n",
+        disk_index,
+        ds->num_reads,
+        hit_rate / 100,
+        hit_rate % 100,
+        ds->ra_bytes / 1024);
+
+    if (sgxlkl_host_state.disks[disk_index].cow)
+    {
+        uint64_t num_allocated, num_copied;
+
+        host_cow_get_stats(
+            sgxlkl_host_state.disks[disk_index].cow,
+            &num_allocated,
+            &num_copied);
+        sgxlkl_host_verbose(
+            "Disk %zu: %" PRIu64 " KiB in copy-on-write delta, %" PRIu64
+            " clusters copied from base image\n",
+            disk_index,
+            num_allocated * HOST_COW_CLUSTER_SIZE / 1024,
+            num_copied);
+    }
+}
+
+/*
+ * blk_queue_worker_thread :
+ * Processes the requests of a single queue of a multi-queue block device
+ * whenever it is kicked by the device thread.
+ */
+static void* blk_queue_worker_thread(void* arg)
+{
+    struct blk_queue* bq = arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&bq->lock);
+        while (!bq->pending)
+            pthread_cond_wait(&bq->cond, &bq->lock);
+        bq->pending = 0;
+        pthread_mutex_unlock(&bq->lock);
+
+        if (vio_host_check_guest_shutdown_evt())
+            continue;
+
+        blk_process_queue(bq);
+    }
+    return NULL;
+}
+
+/*
+ * Set up the host state of all queues of a block device, including an
+ * io_uring instance per queue if enabled, and create one worker thread per
+ * queue for multi-queue devices if workers is set
+ */
+static struct blk_queue* blk_setup_queues(
+    struct virtio_dev* dev,
+    uint8_t dev_id,
+    uint16_t num_queues,
+    bool workers)
+{
+    int ret;
+    struct blk_queue* queues = calloc(num_queues, sizeof(struct blk_queue));
+    if (!queues)
+        sgxlkl_host_fail("%s: out of memory\n", __func__);
+
+    for (uint16_t i = 0; i < num_queues; i++)
+    {
+        struct blk_queue* bq = &queues[i];
+        bq->dev = dev;
+        bq->qidx = i;
+
+        /* Copy-on-write disks need to look up each request in the delta
+         * file first and are always served synchronously */
+        if (sgxlkl_host_state.config.io_uring && !get_disk_config(dev_id)->cow)
+        {
+            ret = host_uring_init(&bq->ring, dev->queue[i].num_max);
+            if (ret < 0)
+            {
+                sgxlkl_host_warn(
+                    "io_uring not available for disk %d (%s), using "
+                    "synchronous I/O\n",
+                    dev_id,
+                    strerror(-ret));
+                bq->ring = NULL;
+            }
+        }
+
+        if (num_queues == 1 || !workers)
+            continue;
+
+        pthread_mutex_init(&bq->lock, NULL);
+        pthread_cond_init(&bq->cond, NULL);
+
+        if (host_thread_create(
+                &bq->tid,
+                HOST_THREAD_DEVICE,
+                "HOST_BLKQUEUE",
+                blk_queue_worker_thread,
+                bq) != 0)
+            sgxlkl_host_fail(
+                "%s: failed to create worker for queue %d of disk %d\n",
+                __func__,
+                i,
+                dev_id);
+    }
+
+    return queues;
+}
+
+/*
+ * Wake up the workers of all queues with available requests
+ */
+static void blk_kick_queue_workers(
+    struct blk_queue* queues,
+    uint16_t num_queues)
+{
+    for (uint16_t i = 0; i < num_queues; i++)
+    {
+        struct blk_queue* bq = &queues[i];
+
+        if (!virtio_queue_has_avail(bq->dev, i))
+            continue;
+
+        pthread_mutex_lock(&bq->lock);
+        bq->pending = 1;
+        pthread_cond_signal(&bq->cond);
+        pthread_mutex_unlock(&bq->lock);
+    }
+}
+
 /*
  * blkdevice_thread :
- * Block device thread handles all the virtio queue requests.
+ * Block device thread handles all the virtio queue requests. For
+ * multi-queue devices, requests are handed off to per-queue workers.
  * Block device configuration is used for monitoring eventQ
  */
 void* blkdevice_thread(void* arg)
@@ -181,6 +952,16 @@ void* blkdevice_thread(void* arg)
     /* time (in ms) for waiting for an event from enclave */
     int timeout_ms = 10;
 
+    struct virtio_dev* dev =
+        sgxlkl_host_state.shared_memory.virtio_blk_dev_mem[cfg->dev_id];
+    struct virtio_blk_dev* blk_dev =
+        container_of(dev, struct virtio_blk_dev, dev);
+    uint16_t num_queues = blk_dev->config.num_queues;
+    struct blk_queue* queues =
+        blk_setup_queues(dev, cfg->dev_id, num_queues, true);
+
+    _blk_queues[cfg->dev_id] = queues;
+
     for (;;)
     {
         vio_host_process_enclave_event(cfg->dev_id, timeout_ms);
@@ -188,9 +969,10 @@ void* blkdevice_thread(void* arg)
         if (vio_host_check_guest_shutdown_evt())
             continue;
 
-        struct virtio_dev* dev =
-            sgxlkl_host_state.shared_memory.virtio_blk_dev_mem[cfg->dev_id];
-        virtio_process_queue(dev, 0);
+        if (num_queues > 1)
+            blk_kick_queue_workers(queues, num_queues);
+        else
+            blk_process_queue(&queues[0]);
 #if DEBUG && VIRTIO_TEST_HOOK
         uint64_t vio_req_cnt = virtio_debug_blk_get_ring_count();
         if ((vio_req_cnt) && !(virtio_blk_req_cnt++ % vio_req_cnt))
@@ -199,3 +981,303 @@ void* blkdevice_thread(void* arg)
     }
     return NULL;
 }
+
+/*
+ * Shared disk I/O reactor: instead of a thread per disk, a pool of host
+ * threads serves the event channels of all disks. A disk whose event channel
+ * is signalled is put on a ready list, from which idle workers take disks in
+ * FIFO order. A worker processes at most HOST_BLK_REACTOR_BUDGET requests
+ * per queue of a disk at a time; a disk with more requests is put back at
+ * the end of the ready list, so that busy disks do not starve the others.
+ * Workers are started when disks are ready and all workers are busy, up to
+ * the configured number of threads.
+ */
+#define HOST_BLK_REACTOR_BUDGET 64
+
+/* Interval (in ms) at which the first worker checks all disks while idle,
+ * as the per-disk threads do with their wait timeout */
+#define HOST_BLK_REACTOR_POLL_MS 100
+
+struct blk_reactor_dev
+{
+    uint8_t dev_id;
+    struct blk_queue* queues;
+    uint16_t num_queues;
+
+    /* Set while the disk is on the ready list or serviced by a worker, and
+     * if it has been woken up while being serviced */
+    bool queued;
+    bool busy;
+    bool woken;
+    /* Set while the guest is asked to notify the disk of new events, only
+     * accessed by the worker servicing the disk */
+    bool armed;
+    struct timespec queued_at;
+    struct blk_reactor_dev* next;
+
+    /* Statistics */
+    uint64_t num_runs;
+    uint64_t num_reqs;
+    uint64_t num_requeues;
+    uint64_t wait_ns;
+    uint64_t max_wait_ns;
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct blk_reactor_dev* devs[HOST_MAX_DISKS];
+    size_t num_devs;
+
+    /* Ready list */
+    struct blk_reactor_dev* head;
+    struct blk_reactor_dev** tail;
+    size_t num_ready;
+
+    size_t max_threads;
+    size_t num_threads;
+    size_t num_idle;
+} _blk_reactor = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .tail = &_blk_reactor.head,
+};
+
+static uint64_t blk_reactor_elapsed_ns(const struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * NSEC_PER_SECOND + now.tv_nsec -
+           start->tv_nsec;
+}
+
+static void* blk_reactor_thread(void* arg);
+
+/*
+ * Put a disk on the ready list and make sure that a worker picks it up,
+ * starting a new worker if all are busy and spawn is set. Must be called
+ * with the reactor lock held.
+ */
+static void blk_reactor_queue(struct blk_reactor_dev* rd, bool spawn)
+{
+    pthread_t tid;
+
+    if (rd->busy)
+        rd->woken = true;
+    if (rd->queued || rd->busy)
+        return;
+
+    rd->queued = true;
+    rd->next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &rd->queued_at);
+    *_blk_reactor.tail = rd;
+    _blk_reactor.tail = &rd->next;
+    _blk_reactor.num_ready++;
+
+    if (_blk_reactor.num_idle)
+        pthread_cond_signal(&_blk_reactor.cond);
+
+    if (spawn && _blk_reactor.num_ready > _blk_reactor.num_idle &&
+        _blk_reactor.num_threads < _blk_reactor.max_threads)
+    {
+        if (host_thread_create(
+                &tid,
+                HOST_THREAD_DEVICE,
+                "HOST_BLKREACTOR",
+                blk_reactor_thread,
+                (void*)_blk_reactor.num_threads) != 0)
+            sgxlkl_host_fail(
+                "%s: failed to create disk I/O thread\n", __func__);
+        _blk_reactor.num_threads++;
+    }
+}
+
+static struct blk_reactor_dev* blk_reactor_dequeue(void)
+{
+    struct blk_reactor_dev* rd = _blk_reactor.head;
+    uint64_t wait_ns;
+
+    _blk_reactor.head = rd->next;
+    if (!_blk_reactor.head)
+        _blk_reactor.tail = &_blk_reactor.head;
+    _blk_reactor.num_ready--;
+
+    rd->queued = false;
+    rd->busy = true;
+    rd->woken = false;
+    rd->num_runs++;
+
+    wait_ns = blk_reactor_elapsed_ns(&rd->queued_at);
+    rd->wait_ns += wait_ns;
+    if (wait_ns > rd->max_wait_ns)
+        rd->max_wait_ns = wait_ns;
+
+    return rd;
+}
+
+/*
+ * Event channel wake-up callback of the disks served by the reactor
+ */
+static void blk_reactor_wakeup(uint8_t dev_id)
+{
+    pthread_mutex_lock(&_blk_reactor.lock);
+    blk_reactor_queue(_blk_reactor.devs[dev_id], true);
+    pthread_mutex_unlock(&_blk_reactor.lock);
+}
+
+/*
+ * Process the pending requests of a disk. Returns true if the disk has more
+ * requests and must be serviced again.
+ */
+static bool blk_reactor_service(struct blk_reactor_dev* rd)
+{
+    bool again = false;
+
+    if (rd->armed)
+    {
+        vio_host_disarm_enclave_event(rd->dev_id);
+        rd->armed = false;
+    }
+
+    if (vio_host_check_guest_shutdown_evt())
+        return false;
+
+    for (uint16_t i = 0; i < rd->num_queues; i++)
+    {
+        struct blk_queue* bq = &rd->queues[i];
+
+        rd->num_reqs += blk_process_queue_batch(bq, HOST_BLK_REACTOR_BUDGET);
+        if (virtio_queue_has_avail(bq->dev, i))
+            again = true;
+    }
+
+    /* Requests that arrive while the disk is not armed are picked up by the
+     * next service without a notification from the guest */
+    if (!again && !(rd->armed = vio_host_arm_enclave_event(rd->dev_id)))
+        again = true;
+
+    if (again)
+        rd->num_requeues++;
+
+    return again;
+}
+
+/*
+ * Disk I/O worker of the reactor. The first worker wakes up periodically
+ * while idle to check all disks that are not on the ready list.
+ */
+static void* blk_reactor_thread(void* arg)
+{
+    bool poll = (size_t)arg == 0;
+    struct timespec timeout;
+    int rc;
+
+    pthread_mutex_lock(&_blk_reactor.lock);
+    for (;;)
+    {
+        while (!_blk_reactor.head)
+        {
+            _blk_reactor.num_idle++;
+            if (poll)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &timeout);
+                timeout.tv_nsec += HOST_BLK_REACTOR_POLL_MS * 1000000UL;
+                timeout.tv_sec += timeout.tv_nsec / NSEC_PER_SECOND;
+                timeout.tv_nsec %= NSEC_PER_SECOND;
+                rc = pthread_cond_timedwait(
+                    &_blk_reactor.cond, &_blk_reactor.lock, &timeout);
+            }
+            else
+                rc = pthread_cond_wait(&_blk_reactor.cond, &_blk_reactor.lock);
+            _blk_reactor.num_idle--;
+
+            if (rc == ETIMEDOUT && !_blk_reactor.head)
+                for (size_t i = 0; i < _blk_reactor.num_devs; i++)
+                    blk_reactor_queue(_blk_reactor.devs[i], false);
+        }
+
+        struct blk_reactor_dev* rd = blk_reactor_dequeue();
+        pthread_mutex_unlock(&_blk_reactor.lock);
+
+        bool again = blk_reactor_service(rd);
+
+        /* The guest may have notified the disk after it was armed. This
+         * worker picks the disk up again if no other worker does. */
+        pthread_mutex_lock(&_blk_reactor.lock);
+        rd->busy = false;
+        if (again || rd->woken)
+            blk_reactor_queue(rd, false);
+    }
+    return NULL;
+}
+
+/*
+ * Serve a block device from the shared pool of disk I/O threads
+ */
+void blk_reactor_add_device(host_dev_config_t* cfg, size_t max_threads)
+{
+    struct virtio_dev* dev =
+        sgxlkl_host_state.shared_memory.virtio_blk_dev_mem[cfg->dev_id];
+    struct virtio_blk_dev* blk_dev =
+        container_of(dev, struct virtio_blk_dev, dev);
+    struct blk_reactor_dev* rd = calloc(1, sizeof(*rd));
+
+    if (!rd)
+        sgxlkl_host_fail("%s: out of memory\n", __func__);
+
+    /* Queues are processed in turn by the workers of the reactor */
+    rd->dev_id = cfg->dev_id;
+    rd->num_queues = blk_dev->config.num_queues;
+    rd->queues = blk_setup_queues(dev, cfg->dev_id, rd->num_queues, false);
+    _blk_queues[cfg->dev_id] = rd->queues;
+
+    vio_host_set_device_wakeup(cfg->dev_id, blk_reactor_wakeup);
+
+    pthread_mutex_lock(&_blk_reactor.lock);
+    if (!_blk_reactor.num_devs)
+    {
+        pthread_condattr_t cattr;
+
+        pthread_condattr_init(&cattr);
+        pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+        pthread_cond_init(&_blk_reactor.cond, &cattr);
+    }
+    _blk_reactor.max_threads = max_threads;
+    _blk_reactor.devs[cfg->dev_id] = rd;
+    _blk_reactor.num_devs++;
+
+    /* The first service asks the guest for notifications */
+    blk_reactor_queue(rd, _blk_reactor.num_threads == 0);
+    pthread_mutex_unlock(&_blk_reactor.lock);
+}
+
+/*
+ * Print the queueing statistics of the disks served by the reactor
+ */
+void blk_reactor_print_stats(void)
+{
+    if (!_blk_reactor.num_devs)
+        return;
+
+    sgxlkl_host_verbose(
+        "Disk I/O reactor: %zu threads for %zu disks\n",
+        _blk_reactor.num_threads,
+        _blk_reactor.num_devs);
+
+    for (size_t i = 0; i < _blk_reactor.num_devs; i++)
+    {
+        struct blk_reactor_dev* rd = _blk_reactor.devs[i];
+
+        sgxlkl_host_verbose(
+            "Disk %d: %" PRIu64 " services, %" PRIu64 " requests, %" PRIu64
+            " requeued, average wait %" PRIu64 " us, maximum wait %" PRIu64
+            " us\n",
+            rd->dev_id,
+            rd->num_runs,
+            rd->num_reqs,
+            rd->num_requeues,
+            rd->num_runs ? rd->wait_ns / rd->num_runs / 1000 : 0,
+            rd->max_wait_ns / 1000);
+    }
+}
@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <host/host_state.h>
+#include <host/host_threads.h>
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
 #include <host/virtio_console.h>
@@ -13,6 +14,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
 /* two queue for one console port */
 #define NUM_QUEUES 2
@@ -23,6 +26,9 @@
 /* time in milliseconds */
 #define WAIT_FOR_EVENT_TIMEOUT 10
 
+/* Maximum time for which buffered output is held back, in milliseconds */
+#define CONSOLE_DEFAULT_FLUSH_DELAY_MS 10
+
 /* Identifier for signaling the appropiate events */
 #define DEV_CONSOLE_WRITE 1
 #define DEV_CONSOLE_HUP 2
@@ -41,9 +47,35 @@ struct virtio_console_dev
     pthread_mutex_t** qlocks;
 };
 
+/*
+ * Ring buffer for console output. The console task copies the output of the
+ * enclave into the buffer and a writer thread writes it to the console.
+ */
+struct console_out_buf
+{
+    char* data;
+    size_t size;
+    /* Next byte to write to the console and number of buffered bytes */
+    size_t head;
+    size_t used;
+    /* Set to make the writer write the buffer without waiting */
+    bool flush;
+    /* Flush at each newline, set if the console is a terminal */
+    bool line_buffered;
+    uint64_t flush_delay_ms;
+    int fd;
+    pthread_mutex_t lock;
+    /* Signalled when there is output to write */
+    pthread_cond_t data_cond;
+    /* Signalled when the writer has written output */
+    pthread_cond_t space_cond;
+    pthread_t writer_tid;
+};
+
 /* Local variable to hold the settings locally */
 static host_dev_config_t* _cfg = NULL;
 static struct virtio_console_dev* _console_dev = NULL;
+static struct console_out_buf _out_buf;
 
 /*
  * Function to return the console backend device instance
@@ -110,6 +142,192 @@ void* monitor_console_input(void* cons_dev)
     return NULL;
 }
 
+/*
+ * Function to write len bytes to the console. Output that cannot be written
+ * is dropped, as with unbuffered output. Returns the number of bytes consumed.
+ */
+static size_t console_write(int fd, const char* data, size_t len)
+{
+    ssize_t ret;
+
+    do
+    {
+        ret = write(fd, data, len);
+    } while (ret == -1 && errno == EINTR);
+
+    return ret <= 0 ? len : (size_t)ret;
+}
+
+/*
+ * Console writer thread, which writes the buffered output once a flush is
+ * requested or the flush delay has passed since output was buffered
+ */
+static void* console_writer(void* arg)
+{
+    struct console_out_buf* ob = arg;
+
+    pthread_mutex_lock(&ob->lock);
+    while (1)
+    {
+        while (!ob->used)
+            pthread_cond_wait(&ob->data_cond, &ob->lock);
+
+        if (!ob->flush)
+        {
+            struct timespec deadline;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += ob->flush_delay_ms / 1000;
+            deadline.tv_nsec += (ob->flush_delay_ms % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+
+            while (!ob->flush && pthread_cond_timedwait(
+                                     &ob->data_cond, &ob->lock, &deadline) !=
+                                     ETIMEDOUT)
+                ;
+        }
+
+        /* Output buffered while writing is written straight away */
+        while (ob->used)
+        {
+            size_t head = ob->head;
+            size_t len = ob->used;
+
+            if (len > ob->size - head)
+                len = ob->size - head;
+
+            pthread_mutex_unlock(&ob->lock);
+            len = console_write(ob->fd, ob->data + head, len);
+            pthread_mutex_lock(&ob->lock);
+
+            ob->head = (head + len) % ob->size;
+            ob->used -= len;
+            pthread_cond_broadcast(&ob->space_cond);
+        }
+        ob->flush = false;
+    }
+
+    return NULL;
+}
+
+/*
+ * Function to copy the console output in iov into the output buffer. Waits
+ * for the writer if the buffer is full. Returns the number of bytes copied.
+ */
+static ssize_t console_buffer_output(
+    struct console_out_buf* ob,
+    const struct iovec* iov,
+    int iovcnt)
+{
+    ssize_t total = 0;
+    bool flush = false;
+    bool was_empty;
+
+    pthread_mutex_lock(&ob->lock);
+    was_empty = !ob->used;
+
+    for (int i = 0; i < iovcnt; i++)
+    {
+        const char* data = iov[i].iov_base;
+        size_t left = iov[i].iov_len;
+
+        if (ob->line_buffered && memchr(data, '\n', left))
+            flush = true;
+
+        while (left)
+        {
+            size_t tail, len;
+
+            while (ob->used == ob->size)
+            {
+                ob->flush = true;
+                pthread_cond_signal(&ob->data_cond);
+                pthread_cond_wait(&ob->space_cond, &ob->lock);
+                was_empty = !ob->used;
+            }
+
+            tail = (ob->head + ob->used) % ob->size;
+            len = ob->size - ob->used;
+            if (len > ob->size - tail)
+                len = ob->size - tail;
+            if (len > left)
+                len = left;
+
+            memcpy(ob->data + tail, data, len);
+            ob->used += len;
+            data += len;
+            left -= len;
+            total += len;
+        }
+    }
+
+    if (ob->used >= ob->size / 2)
+        flush = true;
+
+    /* Wake up the writer to start the flush delay or to stop waiting */
+    if ((flush && !ob->flush) || (was_empty && ob->used))
+    {
+        ob->flush |= flush;
+        pthread_cond_signal(&ob->data_cond);
+    }
+
+    pthread_mutex_unlock(&ob->lock);
+    return total;
+}
+
+/*
+ * Function to set up console output buffering with a buffer of size bytes
+ */
+static void console_out_buf_init(
+    struct console_out_buf* ob,
+    int fd,
+    size_t size,
+    uint64_t flush_delay_ms)
+{
+    ob->data = malloc(size);
+    if (!ob->data)
+        sgxlkl_host_fail("Host console output buffer alloc failed\n");
+
+    ob->size = size;
+    ob->fd = fd;
+    ob->line_buffered = isatty(fd);
+    ob->flush_delay_ms =
+        flush_delay_ms ? flush_delay_ms : CONSOLE_DEFAULT_FLUSH_DELAY_MS;
+    pthread_mutex_init(&ob->lock, NULL);
+    pthread_cond_init(&ob->data_cond, NULL);
+    pthread_cond_init(&ob->space_cond, NULL);
+
+    if (host_thread_create(
+            &ob->writer_tid,
+            HOST_THREAD_DEVICE,
+            "HOST_CONSOLE_WRITER",
+            console_writer,
+            ob))
+        sgxlkl_host_fail("Failed to start the host console writer task\n");
+}
+
+void virtio_console_flush(void)
+{
+    struct console_out_buf* ob = &_out_buf;
+
+    if (!ob->data)
+        return;
+
+    pthread_mutex_lock(&ob->lock);
+    if (ob->used)
+    {
+        ob->flush = true;
+        pthread_cond_signal(&ob->data_cond);
+        while (ob->used)
+            pthread_cond_wait(&ob->space_cond, &ob->lock);
+    }
+    pthread_mutex_unlock(&ob->lock);
+}
+
 /*
  * Function to free the locks created for protecting queues
  */
@@ -186,6 +404,10 @@ static int console_enqueue(
             ret = readv(vcd->in_console_fd, iov, req->buf_count);
         } while (ret == -1 && errno == EINTR);
     }
+    else if (_out_buf.data)
+    {
+        ret = console_buffer_output(&_out_buf, iov, req->buf_count);
+    }
     else
     {
         do
@@ -273,7 +495,14 @@ int virtio_console_init(sgxlkl_host_state_t* host_state, host_dev_config_t* cfg)
 
     /* assign the queue depth to each virt queue */
     for (int i = 0; i < NUM_QUEUES; i++)
+    {
         dev->queue[i].num_max = QUEUE_DEPTH;
+        virtio_set_queue_coalescing(
+            dev,
+            i,
+            host_state->config.virtio_completion_batch,
+            host_state->config.virtio_completion_delay_us);
+    }
 
     /* set console device feature */
     dev->device_id = VIRTIO_ID_CONSOLE;
@@ -286,13 +515,27 @@ int virtio_console_init(sgxlkl_host_state_t* host_state, host_dev_config_t* cfg)
     if (host_state->enclave_config.mode != SW_DEBUG_MODE)
         dev->device_features |= BIT(VIRTIO_F_IOMMU_PLATFORM);
 
+    if (host_state->config.packed_virtqueues)
+        dev->device_features |= BIT(VIRTIO_F_RING_PACKED);
+
     dev->ops = &host_console_ops;
 
     _console_dev->qlocks = init_queue_locks(NUM_QUEUES);
 
+    if (host_state->config.console_buffer_size)
+        console_out_buf_init(
+            &_out_buf,
+            _console_dev->out_console_fd,
+            host_state->config.console_buffer_size,
+            host_state->config.console_flush_delay_ms);
+
     /* Start the console monitor thread for monitoring the input */
-    pthread_create(
-        &_console_dev->monitor_tid, NULL, monitor_console_input, _console_dev);
+    host_thread_create(
+        &_console_dev->monitor_tid,
+        HOST_THREAD_DEVICE,
+        "HOST_CONSOLE_INPUT",
+        monitor_console_input,
+        _console_dev);
 
     /* Check the polling thread spawning status */
     if (_console_dev->monitor_tid == 0)
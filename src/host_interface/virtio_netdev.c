@@ -16,52 +16,117 @@
  */
 
 #include <assert.h>
+#include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <host/host_packet_ring.h>
 #include <host/host_state.h>
+#include <host/host_threads.h>
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
 #include <host/virtio_debug.h>
 #include <host/virtio_netdev.h>
-#include <poll.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
 #include <shared/env.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/random.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
 
-/* We always have 2 queues on a netdev: one for tx, one for rx. */
-#define RX_QUEUE_IDX 0
-#define TX_QUEUE_IDX 1
+/*
+ * A netdev has a receive and a transmit queue per queue pair. With more than
+ * one queue pair, these are followed by a control queue used by the driver
+ * to select the number of queue pairs in use.
+ */
+#define RX_QUEUE_IDX(pair) (2 * (pair))
+#define TX_QUEUE_IDX(pair) (2 * (pair) + 1)
+#define IS_RX_QUEUE(q) (((q)&1) == 0)
+#define QUEUE_PAIR(q) ((q) / 2)
 
 #define MAX_NET_DEVS 16
-#define NUM_QUEUES (TX_QUEUE_IDX + 1)
 #define QUEUE_DEPTH 128
 
-#define DEV_NET_POLL_RX 1
-#define DEV_NET_POLL_TX 2
-#define DEV_NET_POLL_HUP 4
+/*
+ * Largest packet read from the tap device: a 64 KB GSO packet with a VLAN tag
+ * and the virtio net header. Without receive segmentation offloads, packets
+ * are at most as large as the MTU of the tap device, see NET_RX_LEN.
+ */
+#define ETH_HLEN 14
+#define VLAN_HLEN 4
+#define NET_RX_LEN(mtu) \
+    (sizeof(struct virtio_net_hdr_v1) + ETH_HLEN + VLAN_HLEN + (mtu))
+#define NET_MAX_PACKET_LEN NET_RX_LEN(65535)
+
+/* Receive segmentation offloads of the tap device */
+#define NET_TAP_GSO_OFFLOADS \
+    (TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_UFO | TUN_F_USO4 | TUN_F_USO6)
+
+/* Offload flags of recent kernels, which older headers may lack */
+#ifndef TUN_F_USO4
+#define TUN_F_USO4 0x20
+#endif
+#ifndef TUN_F_USO6
+#define TUN_F_USO6 0x40
+#endif
+
+/* Default number of packets processed per batch, i.e. per used ring update
+ * and interrupt */
+#define DEFAULT_BATCH_SIZE 64
+
+/* Maximum number of events returned by one epoll_wait call */
+#define NET_MAX_EVENTS 64
+
+/* Tag in the epoll event data of kick eventfds, which distinguishes them from
+ * tap fds. Both carry a pointer to the netdev_fd, which is at least 4-byte
+ * aligned. */
+#define NET_EVENT_KICK 1UL
 
 struct netdev_fd
 {
     /* file-descriptor based device */
     int fd;
     /*
-     * Controlls the poll mask for fd. Can be acccessed concurrently from
-     * poll, tx, or rx routines but there is no need for syncronization
-     * because:
+     * Whether fd may have packets to read or room for packets to write. fd is
+     * polled edge-triggered, so these are set when the poller sees fd become
+     * readable or writable and cleared when RX or TX hit EAGAIN. They can be
+     * accessed concurrently from the poller, tx, or rx routines but there is
+     * no need for syncronization because:
      *
      * (a) TX and RX routines set different variables so even if they update
      * at the same time there is no race condition
      *
-     * (b) Even if poll and TX / RX update at the same time poll cannot
-     * stall: when poll resets the poll variable we know that TX / RX will
-     * run which means that eventually the poll variable will be set.
+     * (b) A flag is only cleared after fd returned EAGAIN, so any packet or
+     * room arriving afterwards causes a new edge that sets it again.
      */
-    int poll_tx, poll_rx;
-    /* control pipe */
-    int pipe[2];
+    int rx_ready, tx_ready;
+    /* eventfd to make the poller process the TX queue of the pair */
+    int kick_fd;
+    /* memory-mapped rings if fd is an AF_PACKET socket, NULL for a tap */
+    struct host_packet_ring* ring;
+    /* queue pair served through fd, and whether the tap queue of fd is
+     * attached, i.e. receives packets */
+    uint16_t pair;
+    int attached;
+    struct virtio_net_dev* net_dev;
+};
+
+/*
+ * Event loops polling the tap fds and kick eventfds of all net devices. Loop
+ * i serves queue pair i of every device, so that the queue pairs of a
+ * multi-queue device are processed in parallel while devices share threads.
+ */
+struct net_event_loop
+{
+    int epoll_fd;
+    pthread_t tid;
 };
 
 struct virtio_net_dev
@@ -69,9 +134,18 @@ struct virtio_net_dev
     struct virtio_dev dev;
     struct virtio_net_config config;
     pthread_mutex_t** queue_locks;
-    pthread_t poll_tid;
-    /* file descriptor used for virtio net device */
-    struct netdev_fd ndev_fd;
+    int num_queues;
+    uint16_t num_queue_pairs;
+    /* Set once the features acknowledged by the driver have been applied to
+     * the queues and the tap device */
+    int features_applied;
+    pthread_mutex_t features_lock;
+    /* Largest packet the tap device can pass to the driver with the applied
+     * offloads. Mergeable receive buffers are collected up to this length
+     * so that no packet is truncated. */
+    int rx_max_len;
+    /* file descriptors used for virtio net device, one per queue pair */
+    struct netdev_fd ndev_fds[HOST_MAX_NET_QUEUE_PAIRS];
 };
 
 #if DEBUG && VIRTIO_TEST_HOOK
@@ -83,6 +157,10 @@ static uint64_t virtio_net_rx_cnt;
 struct virtio_net_dev* registered_devs[MAX_NET_DEVS];
 static uint8_t registered_dev_idx = 0;
 static uint8_t has_vnet_hdr;
+static int net_batch_size;
+static uint64_t net_busy_poll_ns;
+static struct net_event_loop net_event_loops[HOST_MAX_NET_QUEUE_PAIRS];
+static int num_net_event_loops;
 
 /* In SGXLKL device id is enumerated in the following order
  * 1. Block devices (root device + additional devices)
@@ -112,162 +190,208 @@ static inline struct virtio_net_dev* get_virtio_netdev_instance(
 }
 
 /*
- * Function to get netdev_fd instance associated to virtio netdev instance
- */
-static inline struct netdev_fd* get_netdev_fd_instance(uint8_t netdev_id)
-{
-    struct virtio_net_dev* ndev_instance =
-        get_virtio_netdev_instance(netdev_id);
-    return &ndev_instance->ndev_fd;
-}
-
-/*
- * Function to register net device & hold reference of newly allocated device
+ * Function to register the fd of a queue pair of a net device with the event
+ * loop of the pair
  */
-static int register_net_device(struct virtio_net_dev* net_dev, int fd)
+static int register_net_device_fd(
+    struct virtio_net_dev* net_dev,
+    uint16_t pair,
+    int fd)
 {
-    /* hold the allocated virtio netdevice */
-    registered_devs[registered_dev_idx] = net_dev;
-    struct netdev_fd* nd_fd = &registered_devs[registered_dev_idx]->ndev_fd;
+    struct netdev_fd* nd_fd = &net_dev->ndev_fds[pair];
+    int epoll_fd = net_event_loops[pair].epoll_fd;
+    struct epoll_event ev;
 
     nd_fd->fd = fd;
+    nd_fd->net_dev = net_dev;
+    nd_fd->pair = pair;
+    nd_fd->attached = 1;
+    nd_fd->rx_ready = 1;
+    nd_fd->tx_ready = 1;
+
+    nd_fd->kick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (nd_fd->kick_fd < 0)
+    {
+        sgxlkl_host_fail(
+            "%s: eventfd call failed: %s", __func__, strerror(errno));
+        return 1;
+    }
 
-    int r = pipe(nd_fd->pipe);
-    if (r < 0)
+    /*
+     * Edge-triggered polling needs no re-arming after each event. The kick
+     * eventfd is never read: every write to it is a new edge, and its
+     * counter cannot realistically overflow.
+     */
+    ev.events = EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLET;
+    ev.data.u64 = (uintptr_t)nd_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
     {
-        sgxlkl_host_fail("%s: pipe call failed: %s", __func__, strerror(-r));
+        sgxlkl_host_fail(
+            "%s: epoll_ctl call failed: %s", __func__, strerror(errno));
+        close(nd_fd->kick_fd);
         return 1;
     }
 
-    r = fcntl(nd_fd->pipe[0], F_SETFL, O_NONBLOCK);
-    if (r < 0)
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = (uintptr_t)nd_fd | NET_EVENT_KICK;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, nd_fd->kick_fd, &ev) < 0)
     {
-        sgxlkl_host_fail("%s: fnctl call failed: %s", __func__, strerror(-r));
-        close(nd_fd->pipe[0]);
-        close(nd_fd->pipe[1]);
+        sgxlkl_host_fail(
+            "%s: epoll_ctl call failed: %s", __func__, strerror(errno));
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        close(nd_fd->kick_fd);
         return 1;
     }
     return 0;
 }
 
 /*
- * Function to poll the pipes to check the reception or transmission
+ * Function to wait for events on the fds of an event loop. Returns the number
+ * of events.
  */
-static int virtio_net_fd_net_poll(uint8_t netdev_id)
+static int net_event_wait(int epoll_fd, struct epoll_event* events)
 {
-    int ret;
-    struct netdev_fd* nd_fd = get_netdev_fd_instance(netdev_id);
+    int ret = 0;
 
-    struct pollfd pfds[2] = {
-        {
-            .fd = nd_fd->fd,
-        },
+    /* Busy-poll for a while before sleeping, which avoids the wake-up
+     * latency while packets keep arriving */
+    if (net_busy_poll_ns)
+    {
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do
         {
-            .fd = nd_fd->pipe[0],
-            .events = POLLIN,
-        },
-    };
-
-    if (nd_fd->poll_rx)
-        pfds[0].events |= POLLIN | POLLPRI;
-    if (nd_fd->poll_tx)
-        pfds[0].events |= POLLOUT;
+            ret = epoll_wait(epoll_fd, events, NET_MAX_EVENTS, 0);
+            if (ret != 0)
+                break;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while ((uint64_t)(now.tv_sec - start.tv_sec) * 1000000000UL +
+                     now.tv_nsec - start.tv_nsec <
+                 net_busy_poll_ns);
+    }
 
-    do
-    {
-        ret = poll(pfds, 2, -1);
-    } while (ret == -1 && errno == EINTR);
+    while (ret == 0 || (ret == -1 && errno == EINTR))
+        ret = epoll_wait(epoll_fd, events, NET_MAX_EVENTS, -1);
 
     if (ret < 0)
     {
-        sgxlkl_host_fail("%s: poll fd failed: %s", __func__, strerror(errno));
+        sgxlkl_host_fail(
+            "%s: epoll_wait failed: %s", __func__, strerror(errno));
         return 0;
     }
+    return ret;
+}
+
+/*
+ * Function to remove the fds of a queue pair from its event loop
+ */
+static void virtio_net_fd_net_poll_hup(struct netdev_fd* nd_fd)
+{
+    int epoll_fd = net_event_loops[nd_fd->pair].epoll_fd;
 
-    if (pfds[1].revents & (POLLHUP | POLLNVAL))
-        return DEV_NET_POLL_HUP;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, nd_fd->kick_fd, NULL);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, nd_fd->fd, NULL);
+    close(nd_fd->kick_fd);
+}
 
-    if (pfds[1].revents & POLLIN)
+/*
+ * Function to close the net device
+ */
+static void virtio_net_fd_net_free(struct netdev_fd* nd_fd)
+{
+    if (nd_fd->ring)
     {
-        char tmp[PIPE_BUF];
-        ret = read(nd_fd->pipe[0], tmp, PIPE_BUF);
-        if (ret == 0)
-            return DEV_NET_POLL_HUP;
-        if (ret < 0)
-        {
-            sgxlkl_host_err(
-                "%s: read from fd (%d) failed: %s",
-                __func__,
-                nd_fd->pipe[0],
-                strerror(errno));
-        }
+        host_packet_ring_destroy(nd_fd->ring);
+        free(nd_fd->ring);
+        nd_fd->ring = NULL;
     }
+    else
+        close(nd_fd->fd);
+}
 
-    ret = 0;
-    if (pfds[0].revents & (POLLIN | POLLPRI))
+/*
+ * Function to queue a packet in the TX ring of an AF_PACKET socket, with the
+ * return convention of writev
+ */
+static int net_packet_ring_tx(
+    struct netdev_fd* nd_fd,
+    struct iovec* iov,
+    int cnt)
+{
+    ssize_t ret = host_packet_ring_send(nd_fd->ring, iov, cnt);
+
+    if (ret == -EMSGSIZE)
     {
-        nd_fd->poll_rx = 0;
-        ret |= DEV_NET_POLL_RX;
+        /* Drop the packet, it can never be sent */
+        sgxlkl_host_err("%s: packet exceeds the interface MTU\n", __func__);
+        for (ret = 0; cnt > 0; cnt--, iov++)
+            ret += iov->iov_len;
     }
-
-    if (pfds[0].revents & POLLOUT)
+    else if (ret < 0)
     {
-        nd_fd->poll_tx = 0;
-        ret |= DEV_NET_POLL_TX;
+        errno = -ret;
+        return -1;
     }
     return ret;
 }
 
 /*
- * Function to close the pipe used for tx & rx
+ * Function to receive a packet from the RX ring of an AF_PACKET socket, with
+ * the return convention of readv
  */
-static void virtio_net_fd_net_poll_hup(uint8_t netdev_id)
+static int net_packet_ring_rx(
+    struct netdev_fd* nd_fd,
+    struct iovec* iov,
+    int cnt)
 {
-    struct netdev_fd* nd_fd = get_netdev_fd_instance(netdev_id);
-    close(nd_fd->pipe[0]);
-    close(nd_fd->pipe[1]);
+    ssize_t ret = host_packet_ring_recv(nd_fd->ring, iov, cnt);
+
+    if (ret < 0)
+    {
+        errno = -ret;
+        return -1;
+    }
+    return ret;
 }
 
 /*
- * Function to close the net device
+ * Function to make the kernel transmit the packets queued in the TX ring of
+ * an AF_PACKET socket
  */
-static void virtio_net_fd_net_free(uint8_t netdev_id)
+static void net_packet_ring_flush(struct netdev_fd* nd_fd)
 {
-    struct netdev_fd* nd_fd = get_netdev_fd_instance(netdev_id);
-    close(nd_fd->fd);
+    int ret = host_packet_ring_flush(nd_fd->ring);
+
+    /* The poller flushes again once the socket is writable */
+    if (ret == -EAGAIN)
+        nd_fd->tx_ready = 0;
+    else if (ret < 0)
+        sgxlkl_host_err(
+            "%s: failed to transmit packets: %s\n", __func__, strerror(-ret));
 }
 
 /*
  * Function to perform tx operation
  */
-static int virtio_net_fd_net_tx(uint8_t netdev_id, struct iovec* iov, int cnt)
+static int virtio_net_fd_net_tx(
+    struct netdev_fd* nd_fd,
+    struct iovec* iov,
+    int cnt)
 {
-    struct netdev_fd* nd_fd = get_netdev_fd_instance(netdev_id);
     int ret = 0;
     do
     {
-        ret = writev(nd_fd->fd, iov, cnt);
+        ret = nd_fd->ring ? net_packet_ring_tx(nd_fd, iov, cnt)
+                          : writev(nd_fd->fd, iov, cnt);
     } while (ret == -1 && errno == EINTR);
 
     if (ret < 0)
     {
-        char tmp;
-
         switch (errno)
         {
+            /* The poller processes the queue again once fd is writable */
             case EAGAIN:
-                nd_fd->poll_tx = 1;
-                int pipe_ret = write(nd_fd->pipe[1], &tmp, 1);
-
-                // Check if there was an error but the fd has not been closed
-                if (pipe_ret <= 0 && errno != EBADF)
-                    sgxlkl_host_fail(
-                        "%s: write to fd pipe failed: fd=%i ret=%i errno=%i %s",
-                        __func__,
-                        nd_fd->pipe[1],
-                        pipe_ret,
-                        errno,
-                        strerror(errno));
+                nd_fd->tx_ready = 0;
                 break;
 
             // Check if the fd has been closed and return error
@@ -290,36 +414,26 @@ static int virtio_net_fd_net_tx(uint8_t netdev_id, struct iovec* iov, int cnt)
 /*
  * Function to perform rx operation
  */
-static int virtio_net_fd_net_rx(uint8_t netdev_id, struct iovec* iov, int cnt)
+static int virtio_net_fd_net_rx(
+    struct netdev_fd* nd_fd,
+    struct iovec* iov,
+    int cnt)
 {
     int ret = 0;
-    struct netdev_fd* nd_fd = get_netdev_fd_instance(netdev_id);
 
     do
     {
-        ret = readv(nd_fd->fd, iov, cnt);
+        ret = nd_fd->ring ? net_packet_ring_rx(nd_fd, iov, cnt)
+                          : readv(nd_fd->fd, iov, cnt);
     } while (ret == -1 && errno == EINTR);
 
     if (ret < 0)
     {
-        char tmp;
-
         switch (errno)
         {
+            /* The poller processes the queue again once fd is readable */
             case EAGAIN:
-                nd_fd->poll_rx = 1;
-                int pipe_ret = write(nd_fd->pipe[1], &tmp, 1);
-
-                // Check if there was an error but the fd has not been closed
-                if (pipe_ret < 0 && errno != EBADF)
-                    sgxlkl_host_fail(
-                        "%s: write to fd pipe failed: fd=%i ret=%i errno=%i "
-                        "%s\n",
-                        __func__,
-                        nd_fd->pipe[1],
-                        pipe_ret,
-                        errno,
-                        strerror(errno));
+                nd_fd->rx_ready = 0;
                 break;
 
             // Check if the fd has been closed and return error
@@ -344,12 +458,137 @@ static int virtio_net_fd_net_rx(uint8_t netdev_id, struct iovec* iov, int cnt)
  */
 static int net_check_features(struct virtio_dev* dev)
 {
-    if (dev->driver_features == dev->device_features)
+    /* The driver may acknowledge a subset of the offered features */
+    if ((dev->driver_features & ~dev->device_features) == 0)
         return 0;
 
     return -EINVAL;
 }
 
+/*
+ * Function to get the tap offload flags matching the offloads the driver can
+ * receive. The tap device only passes GSO or partially checksummed packets
+ * to the driver if they are enabled.
+ */
+static unsigned int net_tap_offloads(uint64_t features)
+{
+    unsigned int offloads = 0;
+
+    /* Segmentation offloads require checksum offload */
+    if (!(features & BIT(VIRTIO_NET_F_GUEST_CSUM)))
+        return 0;
+
+    offloads |= TUN_F_CSUM;
+    if (features & BIT(VIRTIO_NET_F_GUEST_TSO4))
+        offloads |= TUN_F_TSO4;
+    if (features & BIT(VIRTIO_NET_F_GUEST_TSO6))
+        offloads |= TUN_F_TSO6;
+    if ((features & BIT(VIRTIO_NET_F_GUEST_ECN)) &&
+        (offloads & (TUN_F_TSO4 | TUN_F_TSO6)))
+        offloads |= TUN_F_TSO_ECN;
+    if (features & BIT(VIRTIO_NET_F_GUEST_UFO))
+        offloads |= TUN_F_UFO;
+    if (features & BIT(VIRTIO_NET_F_GUEST_USO4))
+        offloads |= TUN_F_USO4;
+    if (features & BIT(VIRTIO_NET_F_GUEST_USO6))
+        offloads |= TUN_F_USO6;
+    return offloads;
+}
+
+/*
+ * Function to get the MTU of the interface of a tap fd, or -1 if it cannot
+ * be determined
+ */
+static int net_tap_mtu(int fd)
+{
+    struct ifreq ifr;
+    int sock, ret = -1;
+
+    memset(&ifr, 0, sizeof(ifr));
+    if (ioctl(fd, TUNGETIFF, &ifr) < 0)
+        return -1;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return -1;
+    if (ioctl(sock, SIOCGIFMTU, &ifr) == 0)
+        ret = ifr.ifr_mtu;
+    close(sock);
+
+    return ret;
+}
+
+/*
+ * Function to apply the features acknowledged by the driver once it has set
+ * up the device: mergeable receive buffers and the tap offloads. Until
+ * then, the tap device only passes fully checksummed, unsegmented packets,
+ * which any driver can receive.
+ */
+static void net_apply_driver_features(struct virtio_net_dev* net_dev)
+{
+    if (!(net_dev->dev.status & VIRTIO_CONFIG_S_DRIVER_OK))
+        return;
+
+    pthread_mutex_lock(&net_dev->features_lock);
+    if (!net_dev->features_applied)
+    {
+        uint64_t features = net_dev->dev.driver_features;
+        unsigned int offloads = has_vnet_hdr ? net_tap_offloads(features) : 0;
+
+        /* Without segmentation offloads, waiting for 64 KB of receive
+         * buffers could stall reception if the driver posts less */
+        if (!(offloads & NET_TAP_GSO_OFFLOADS))
+        {
+            int mtu = net_tap_mtu(net_dev->ndev_fds[0].fd);
+            if (mtu > 0 && mtu < 65535)
+                net_dev->rx_max_len = NET_RX_LEN(mtu);
+        }
+
+        int merge_len = (features & BIT(VIRTIO_NET_F_MRG_RXBUF))
+                            ? net_dev->rx_max_len
+                            : 0;
+
+        for (uint16_t i = 0; i < net_dev->num_queue_pairs; i++)
+        {
+            virtio_set_queue_max_merge_len(
+                &net_dev->dev, RX_QUEUE_IDX(i), merge_len);
+
+            if (offloads &&
+                ioctl(net_dev->ndev_fds[i].fd, TUNSETOFFLOAD, offloads) < 0)
+                sgxlkl_host_err(
+                    "%s: failed to set tap offloads 0x%x: %s\n",
+                    __func__,
+                    offloads,
+                    strerror(errno));
+        }
+
+        sgxlkl_host_verbose(
+            "Network device features: 0x%lx, tap offloads: 0x%x, largest "
+            "received packet: %d bytes\n",
+            (unsigned long)features,
+            offloads,
+            net_dev->rx_max_len);
+
+        __sync_synchronize();
+        net_dev->features_applied = 1;
+    }
+    pthread_mutex_unlock(&net_dev->features_lock);
+}
+
+/*
+ * Function to check whether the tap device supports UDP segmentation
+ * offload, which depends on the host kernel
+ */
+static int net_tap_supports_uso(int fd)
+{
+    if (ioctl(fd, TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_USO4 | TUN_F_USO6) < 0)
+        return 0;
+
+    /* Offloads are enabled once the driver has acknowledged them */
+    ioctl(fd, TUNSETOFFLOAD, 0);
+    return 1;
+}
+
 /*
  * virtio callback function to acquire queue lock
  */
@@ -372,6 +611,75 @@ static void net_release_queue(struct virtio_dev* dev, int queue_idx)
     pthread_mutex_unlock(netdev->queue_locks[queue_idx]);
 }
 
+/*
+ * Function to attach the tap queues of the first num_pairs queue pairs and
+ * detach the others, so that the tap device only steers received packets to
+ * queue pairs used by the driver
+ */
+static int net_set_queue_pairs(
+    struct virtio_net_dev* net_dev,
+    uint16_t num_pairs)
+{
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+
+    for (uint16_t i = 0; i < net_dev->num_queue_pairs; i++)
+    {
+        struct netdev_fd* nd_fd = &net_dev->ndev_fds[i];
+        int attach = i < num_pairs;
+
+        if (nd_fd->attached == attach)
+            continue;
+
+        ifr.ifr_flags = attach ? IFF_ATTACH_QUEUE : IFF_DETACH_QUEUE;
+        if (ioctl(nd_fd->fd, TUNSETQUEUE, &ifr) < 0)
+        {
+            sgxlkl_host_err(
+                "%s: failed to %s tap queue %d: %s\n",
+                __func__,
+                attach ? "attach" : "detach",
+                i,
+                strerror(errno));
+            return -1;
+        }
+        nd_fd->attached = attach;
+    }
+
+    return 0;
+}
+
+/*
+ * Function to process a request on the control queue
+ */
+static int net_ctrl_enqueue(
+    struct virtio_net_dev* net_dev,
+    struct virtio_req* req)
+{
+    struct virtio_net_ctrl_hdr* hdr = req->buf[0].iov_base;
+    uint8_t* ack = req->buf[req->buf_count - 1].iov_base;
+    uint16_t num_pairs;
+
+    *ack = VIRTIO_NET_ERR;
+
+    if (req->buf_count == 3 && req->buf[0].iov_len >= sizeof(*hdr) &&
+        hdr->class == VIRTIO_NET_CTRL_MQ &&
+        hdr->cmd == VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET &&
+        req->buf[1].iov_len >= sizeof(num_pairs))
+    {
+        num_pairs = le16toh(*(uint16_t*)req->buf[1].iov_base);
+        if (num_pairs >= 1 && num_pairs <= net_dev->num_queue_pairs &&
+            net_set_queue_pairs(net_dev, num_pairs) == 0)
+        {
+            sgxlkl_host_verbose(
+                "Network device uses %d queue pair(s)\n", num_pairs);
+            *ack = VIRTIO_NET_OK;
+        }
+    }
+
+    virtio_req_complete(req, sizeof(*ack));
+    return 0;
+}
+
 /*
  * Virtio callback function to process the virtio request
  */
@@ -379,11 +687,22 @@ static int net_enqueue(struct virtio_dev* dev, int q, struct virtio_req* req)
 {
     struct virtio_net_hdr_v1* header;
     struct iovec* iov;
+    struct netdev_fd* nd_fd;
     int ret;
 
     int netdev_id = get_netdev_id(dev->vendor_id);
     assert(netdev_id >= 0);
 
+    struct virtio_net_dev* net_dev = get_virtio_netdev_instance(netdev_id);
+    if (q == 2 * net_dev->num_queue_pairs)
+        return net_ctrl_enqueue(net_dev, req);
+    if (q > 2 * net_dev->num_queue_pairs)
+    {
+        sgxlkl_host_fail("tried to push on non-existent queue");
+        return -1;
+    }
+    nd_fd = &net_dev->ndev_fds[QUEUE_PAIR(q)];
+
     header = req->buf[0].iov_base;
 
     /*
@@ -401,17 +720,27 @@ static int net_enqueue(struct virtio_dev* dev, int q, struct virtio_req* req)
     iov = req->buf;
 
     /* Pick which virtqueue to send the buffer(s) to */
-    if (q == TX_QUEUE_IDX)
+    if (!IS_RX_QUEUE(q))
     {
-        ret = virtio_net_fd_net_tx(netdev_id, iov, req->buf_count);
+        ret = virtio_net_fd_net_tx(nd_fd, iov, req->buf_count);
         if (ret < 0)
             return -1;
     }
-    else if (q == RX_QUEUE_IDX)
+    else
     {
         int i, len;
 
-        ret = virtio_net_fd_net_rx(netdev_id, iov, req->buf_count);
+        /*
+         * With mergeable RX buffers, a packet is spread over as many buffers
+         * as it needs. Wait for the driver to add buffers until the largest
+         * packet fits rather than truncate a packet, as the driver would
+         * drop it. The unused buffers are left for the next packet.
+         */
+        if ((dev->driver_features & BIT(VIRTIO_NET_F_MRG_RXBUF)) &&
+            req->total_len < (unsigned int)net_dev->rx_max_len)
+            return -1;
+
+        ret = virtio_net_fd_net_rx(nd_fd, iov, req->buf_count);
         if (ret < 0)
             return -1;
         if (has_vnet_hdr)
@@ -420,11 +749,13 @@ static int net_enqueue(struct virtio_dev* dev, int q, struct virtio_req* req)
              * If the number of bytes returned exactly matches the
              * total space in the iov then there is a good chance we
              * did not supply a large enough buffer for the whole
-             * pkt, i.e., pkt has been truncated.  This is only
-             * likely to happen under mergeable RX buffer mode.
+             * pkt, i.e., pkt has been truncated. This can only happen
+             * without mergeable RX buffers if the driver did not
+             * provide buffers for GSO packets.
              */
-            if (req->total_len == (unsigned int)ret)
-                sgxlkl_host_fail("PKT is likely truncated! len=%d\n", ret);
+            if (req->total_len == (unsigned int)ret &&
+                req->total_len < (unsigned int)net_dev->rx_max_len)
+                sgxlkl_host_err("PKT is likely truncated! len=%d\n", ret);
         }
         else
         {
@@ -440,14 +771,9 @@ static int net_enqueue(struct virtio_dev* dev, int q, struct virtio_req* req)
             len -= req->buf[i].iov_len;
         header->num_buffers = i;
 
-        if (dev->device_features & BIT(VIRTIO_NET_F_GUEST_CSUM))
+        if (dev->driver_features & BIT(VIRTIO_NET_F_GUEST_CSUM))
             header->flags |= VIRTIO_NET_HDR_F_DATA_VALID;
     }
-    else
-    {
-        sgxlkl_host_fail("tried to push on non-existent queue");
-        return -1;
-    }
 
     if (!has_vnet_hdr)
     {
@@ -505,39 +831,119 @@ static struct virtio_dev_ops host_net_ops = {
 };
 
 /*
- * Function to poll for the event on the tap interface
+ * Function to process all requests of a queue in batches of net_batch_size
+ * packets, with one used ring update and at most one interrupt per batch.
+ * With an AF_PACKET socket, the packets of a TX batch are also transmitted
+ * with a single system call.
  */
-void* poll_thread(void* arg)
+static void net_process_queue(struct virtio_net_dev* dev, uint32_t qidx)
 {
-    int netdev_id = *(int*)arg;
-    struct virtio_net_dev* dev = get_virtio_netdev_instance(netdev_id);
-    free(arg);
+    struct netdev_fd* nd_fd = NULL;
+    int n;
+
+    if (!dev->features_applied)
+        net_apply_driver_features(dev);
+
+    if (!IS_RX_QUEUE(qidx) && dev->ndev_fds[QUEUE_PAIR(qidx)].ring)
+        nd_fd = &dev->ndev_fds[QUEUE_PAIR(qidx)];
+
     do
     {
-        int ret = virtio_net_fd_net_poll(netdev_id);
-        if (ret < 0)
-        {
-            sgxlkl_host_info("virtio net poll error: %d\n", ret);
-            continue;
-        }
-        /* synchronization is handled in virtio_process_queue */
-        if (ret & DEV_NET_POLL_HUP)
-            break;
-        if (ret & DEV_NET_POLL_RX)
+        n = virtio_process_queue_batch(&dev->dev, qidx, net_batch_size);
+        if (nd_fd)
+            net_packet_ring_flush(nd_fd);
+    } while (n == net_batch_size);
+}
+
+/*
+ * Event loop thread polling the tap queues and kick eventfds of the queue
+ * pairs of the loop. Each wake-up returns a batch of events, for which the
+ * loop receives packets from the tap queues that became readable and
+ * transmits the packets of the pairs that were kicked by netdev_task or whose
+ * tap queue became writable.
+ */
+static void* net_event_loop_thread(void* arg)
+{
+    struct net_event_loop* loop = arg;
+    struct epoll_event events[NET_MAX_EVENTS];
+
+    for (;;)
+    {
+        int n = net_event_wait(loop->epoll_fd, events);
+
+        for (int i = 0; i < n; i++)
         {
-            virtio_process_queue(&dev->dev, RX_QUEUE_IDX);
+            uintptr_t data = events[i].data.u64;
+            struct netdev_fd* nd_fd = (void*)(data & ~NET_EVENT_KICK);
+            struct virtio_net_dev* dev = nd_fd->net_dev;
+            int rx = 0, tx = 0;
+
+            if (data & NET_EVENT_KICK)
+            {
+                /* The driver may also have refilled the RX queue while
+                 * received packets were waiting for buffers */
+                rx = nd_fd->rx_ready;
+                tx = 1;
+            }
+            else
+            {
+                if (events[i].events & (EPOLLIN | EPOLLPRI))
+                    rx = nd_fd->rx_ready = 1;
+                if (events[i].events & EPOLLOUT)
+                    tx = nd_fd->tx_ready = 1;
+            }
+
+            /* synchronization is handled in virtio_process_queue */
+            if (rx)
+            {
+                net_process_queue(dev, RX_QUEUE_IDX(nd_fd->pair));
 #if DEBUG && VIRTIO_TEST_HOOK
-            uint64_t vio_req_cnt = virtio_debug_net_rx_get_ring_count();
-            if ((vio_req_cnt) && !(virtio_net_rx_cnt++ % vio_req_cnt))
-                virtio_debug_set_evt_chn_state(true);
+                uint64_t vio_req_cnt = virtio_debug_net_rx_get_ring_count();
+                if ((vio_req_cnt) && !(virtio_net_rx_cnt++ % vio_req_cnt))
+                    virtio_debug_set_evt_chn_state(true);
 #endif
+            }
+            if (tx)
+                net_process_queue(dev, TX_QUEUE_IDX(nd_fd->pair));
         }
-        if (ret & DEV_NET_POLL_TX)
+    }
+    return NULL;
+}
+
+/*
+ * Function to start the event loops for the queue pairs of a net device,
+ * unless they have been started for a previous device
+ */
+static int net_start_event_loops(uint16_t num_queue_pairs)
+{
+    while (num_net_event_loops < num_queue_pairs)
+    {
+        struct net_event_loop* loop = &net_event_loops[num_net_event_loops];
+
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epoll_fd < 0)
         {
-            virtio_process_queue(&dev->dev, TX_QUEUE_IDX);
+            sgxlkl_host_fail(
+                "%s: epoll_create1 call failed: %s\n",
+                __func__,
+                strerror(errno));
+            return -1;
         }
-    } while (1);
-    return NULL;
+
+        if (host_thread_create(
+                &loop->tid,
+                HOST_THREAD_DEVICE,
+                "HOST_NETDEVICE",
+                net_event_loop_thread,
+                loop))
+        {
+            sgxlkl_host_fail("Failed to start the network poll task\n");
+            close(loop->epoll_fd);
+            return -1;
+        }
+        num_net_event_loops++;
+    }
+    return 0;
 }
 
 /*
@@ -565,8 +971,19 @@ int netdev_init(sgxlkl_host_state_t* host_state)
     // Clear the multicast bit (give a unicast MAC address)
     mac[0] &= 0xfe;
 
+    net_batch_size = host_state->config.net_batch_size;
+    if (net_batch_size <= 0 || net_batch_size > QUEUE_DEPTH)
+        net_batch_size = DEFAULT_BATCH_SIZE;
+    net_busy_poll_ns = host_state->config.net_busy_poll_us * 1000;
+
+    uint16_t num_queue_pairs = host_state->num_net_queue_pairs;
+    assert(num_queue_pairs >= 1 && num_queue_pairs <= HOST_MAX_NET_QUEUE_PAIRS);
+
+    /* The control queue only exists for multi-queue devices */
+    int num_queues = 2 * num_queue_pairs + (num_queue_pairs > 1 ? 1 : 0);
+
     size_t host_netdev_size = next_pow2(sizeof(struct virtio_net_dev));
-    size_t netdev_vq_size = NUM_QUEUES * sizeof(struct virtq);
+    size_t netdev_vq_size = num_queues * sizeof(struct virtq);
     netdev_vq_size = next_pow2(netdev_vq_size);
 
     if (!_netdev_id)
@@ -609,8 +1026,15 @@ int netdev_init(sgxlkl_host_state_t* host_state)
     memset(net_dev->dev.queue, 0, netdev_vq_size);
 
     /* assign the queue depth to each virt queue */
-    for (int i = 0; i < NUM_QUEUES; i++)
+    for (int i = 0; i < num_queues; i++)
+    {
         net_dev->dev.queue[i].num_max = QUEUE_DEPTH;
+        virtio_set_queue_coalescing(
+            &net_dev->dev,
+            i,
+            host_state->config.virtio_completion_batch,
+            host_state->config.virtio_completion_delay_us);
+    }
 
     /* set net device feature */
     net_dev->dev.device_id = VIRTIO_ID_NET;
@@ -622,14 +1046,36 @@ int netdev_init(sgxlkl_host_state_t* host_state)
     if (host_state->enclave_config.swiotlb)
         net_dev->dev.device_features |= BIT(VIRTIO_F_IOMMU_PLATFORM);
 
-    if (host_state->config.tap_offload)
+    if (host_state->config.packed_virtqueues)
+        net_dev->dev.device_features |= BIT(VIRTIO_F_RING_PACKED);
+
+    /*
+     * Offer the offloads the tap device supports in both directions. The
+     * driver acknowledges the ones it supports, which determine the tap
+     * offloads, see net_apply_driver_features.
+     */
+    if (host_state->config.tap_offload && !host_state->net_is_packet_socket)
     {
         has_vnet_hdr = 1;
         net_dev->dev.device_features |=
             BIT(VIRTIO_NET_F_CSUM) | BIT(VIRTIO_NET_F_GUEST_CSUM) |
             BIT(VIRTIO_NET_F_HOST_TSO4) | BIT(VIRTIO_NET_F_GUEST_TSO4) |
             BIT(VIRTIO_NET_F_HOST_TSO6) | BIT(VIRTIO_NET_F_GUEST_TSO6) |
+            BIT(VIRTIO_NET_F_HOST_ECN) | BIT(VIRTIO_NET_F_GUEST_ECN) |
+            BIT(VIRTIO_NET_F_HOST_UFO) | BIT(VIRTIO_NET_F_GUEST_UFO) |
             BIT(VIRTIO_NET_F_MRG_RXBUF);
+
+        if (net_tap_supports_uso(host_state->net_queue_fds[0]))
+            net_dev->dev.device_features |= BIT(VIRTIO_NET_F_HOST_USO) |
+                                            BIT(VIRTIO_NET_F_GUEST_USO4) |
+                                            BIT(VIRTIO_NET_F_GUEST_USO6);
+    }
+
+    if (num_queue_pairs > 1)
+    {
+        net_dev->dev.device_features |=
+            BIT(VIRTIO_NET_F_CTRL_VQ) | BIT(VIRTIO_NET_F_MQ);
+        net_dev->config.max_virtqueue_pairs = num_queue_pairs;
     }
 
     net_dev->dev.device_features |= BIT(VIRTIO_NET_F_MAC);
@@ -638,30 +1084,47 @@ int netdev_init(sgxlkl_host_state_t* host_state)
     net_dev->dev.config_data = &net_dev->config;
     net_dev->dev.config_len = sizeof(net_dev->config);
     net_dev->dev.ops = &host_net_ops;
-    net_dev->queue_locks = init_queue_locks(NUM_QUEUES);
+    net_dev->queue_locks = init_queue_locks(num_queues);
+    net_dev->num_queues = num_queues;
+    net_dev->num_queue_pairs = num_queue_pairs;
 
-    /*
-     * We may receive upto 64KB TSO packet so collect as many descriptors as
-     * there are available up to 64KB in total len.
-     */
-    if (net_dev->dev.device_features & BIT(VIRTIO_NET_F_MRG_RXBUF))
-        virtio_set_queue_max_merge_len(&net_dev->dev, RX_QUEUE_IDX, 65536);
+    pthread_mutex_init(&net_dev->features_lock, NULL);
+    net_dev->rx_max_len = NET_MAX_PACKET_LEN;
+
+    /* hold the allocated virtio netdevice */
+    registered_devs[registered_dev_idx] = net_dev;
+
+    if (net_start_event_loops(num_queue_pairs) < 0)
+        return -1;
 
-    /* Register the netdev fd */
-    register_net_device(net_dev, host_state->net_fd);
+    /* The rings must be set up before the poller sees the socket */
+    if (host_state->net_is_packet_socket)
+    {
+        int fd = host_state->net_queue_fds[0];
+        struct host_packet_ring* ring = calloc(1, sizeof(*ring));
+        int ret = ring ? host_packet_ring_init(ring, fd) : -ENOMEM;
 
-    int* netdev_id = (int*)malloc(sizeof(int));
-    assert(netdev_id != NULL);
+        if (ret < 0)
+        {
+            sgxlkl_host_fail(
+                "Failed to set up the packet socket rings: %s\n",
+                strerror(-ret));
+            return -1;
+        }
+        net_dev->ndev_fds[0].ring = ring;
+    }
 
-    *netdev_id = registered_dev_idx;
-    pthread_create(&net_dev->poll_tid, NULL, poll_thread, (void*)netdev_id);
+    /* Register the netdev fds */
+    for (uint16_t i = 0; i < num_queue_pairs; i++)
+        if (register_net_device_fd(net_dev, i, host_state->net_queue_fds[i]))
+            return -1;
 
-    if (net_dev->poll_tid == 0)
+    /* The driver uses a single queue pair until it selects more */
+    if (net_set_queue_pairs(net_dev, 1) < 0)
     {
-        sgxlkl_host_fail("Failed to start the network poll task\n");
+        sgxlkl_host_fail("Failed to set up the tap device queues\n");
         return -1;
     }
-    pthread_setname_np(net_dev->poll_tid, "HOST_NETDEVICE");
 
     /* Hold memory allocated for virtio netdev to be used in enclave.
      * currently one net device is supported, at somepoint when multiple devices
@@ -672,6 +1135,32 @@ int netdev_init(sgxlkl_host_state_t* host_state)
     return registered_dev_idx++;
 }
 
+/*
+ * Function to wake up the event loops of the queue pairs with packets to
+ * transmit, or with new receive buffers while received packets are waiting
+ */
+static void net_kick_queues(struct virtio_net_dev* netdev)
+{
+    uint64_t one = 1;
+
+    for (uint16_t i = 0; i < netdev->num_queue_pairs; i++)
+    {
+        struct netdev_fd* nd_fd = &netdev->ndev_fds[i];
+        int tx = nd_fd->tx_ready &&
+                 virtio_queue_has_avail(&netdev->dev, TX_QUEUE_IDX(i));
+        int rx = nd_fd->rx_ready &&
+                 virtio_queue_has_avail(&netdev->dev, RX_QUEUE_IDX(i));
+
+        if (!tx && !rx)
+            continue;
+
+        if (write(nd_fd->kick_fd, &one, sizeof(one)) < 0 && errno != EAGAIN &&
+            errno != EBADF)
+            sgxlkl_host_fail(
+                "%s: write to eventfd failed: %s\n", __func__, strerror(errno));
+    }
+}
+
 /*
  * network device host task to process the request from guest.
  */
@@ -686,7 +1175,14 @@ void* netdev_task(void* arg)
     for (;;)
     {
         vio_host_process_enclave_event(cfg->dev_id, -1);
-        virtio_process_queue(&netdev->dev, evt_chn->qidx_p);
+        if (netdev->num_queue_pairs > 1)
+        {
+            /* Notifications may be for any queue, so check all of them */
+            net_kick_queues(netdev);
+            virtio_process_queue(&netdev->dev, 2 * netdev->num_queue_pairs);
+        }
+        else
+            net_process_queue(netdev, evt_chn->qidx_p);
 #if DEBUG && VIRTIO_TEST_HOOK
         uint64_t vio_req_cnt = virtio_debug_net_tx_get_ring_count();
         if ((vio_req_cnt) && !(virtio_net_tx_cnt++ % vio_req_cnt))
@@ -696,12 +1192,15 @@ void* netdev_task(void* arg)
 }
 
 /*
- * Function to stop the polling thread for stopping the network interface
+ * Function to stop polling the tap queues for stopping the network interface.
+ * The event loops are shared with other net devices and keep running.
  */
 void net_dev_remove(uint8_t netdev_id)
 {
     struct virtio_net_dev* net_dev = get_virtio_netdev_instance(netdev_id);
-    virtio_net_fd_net_poll_hup(netdev_id);
-    virtio_net_fd_net_free(netdev_id);
-    pthread_join(net_dev->poll_tid, NULL);
+    for (uint16_t i = 0; i < net_dev->num_queue_pairs; i++)
+    {
+        virtio_net_fd_net_poll_hup(&net_dev->ndev_fds[i]);
+        virtio_net_fd_net_free(&net_dev->ndev_fds[i]);
+    }
 }
@@ -0,0 +1,1092 @@
+#define _GNU_SOURCE
+
+#include <endian.h>
+#include <errno.h>
+#include <host/host_state.h>
+#include <host/host_threads.h>
+#include <host/sgxlkl_util.h>
+#include <host/vio_host_event_channel.h>
+#include <host/virtio_vsock.h>
+#include <limits.h>
+#include <poll.h>
+#include <shared/env.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Virtio vsock device. Stream connections of the enclave to the host
+ * (context ID 2) are mapped to Unix domain sockets:
+ *
+ * - A connection of the enclave to port P connects to the Unix socket
+ *   <vsock_uds_path>_P on the host.
+ * - A host process connects to the Unix socket <vsock_uds_path> and writes
+ *   "CONNECT <port>\n" to connect to a listening socket of the enclave. Once
+ *   the enclave accepts the connection, the host process reads
+ *   "OK <host port>\n" and the connection carries the stream from then on.
+ */
+
+/* Receive, transmit and event queue */
+#define NUM_QUEUES 3
+#define QUEUE_DEPTH 128
+
+#define RX_QUEUE_ID 0
+#define TX_QUEUE_ID 1
+
+/* time in milliseconds */
+#define WAIT_FOR_EVENT_TIMEOUT 10
+
+#define VSOCK_MAX_CONNS 128
+
+/* Buffer space of a connection for data from the enclave that the host
+ * socket has not accepted yet, advertised to the enclave as its credit */
+#define VSOCK_BUF_ALLOC (256 * 1024)
+
+/* Buffer space freed by writes to the host socket is reported to the
+ * enclave once this much is unreported */
+#define VSOCK_CREDIT_UPDATE_THRESHOLD (VSOCK_BUF_ALLOC / 4)
+
+/* Ports of the host end of connections from the host */
+#define VSOCK_HOST_PORT_BASE (1U << 30)
+
+/* Maximum length of the "CONNECT <port>\n" line */
+#define VSOCK_CONNECT_LINE_MAX 32
+
+enum vsock_conn_state
+{
+    VSOCK_CONN_FREE = 0,
+    /* Connection from the host, waiting for its CONNECT line */
+    VSOCK_CONN_HANDSHAKE,
+    /* Connection from the host, waiting for the enclave to accept it */
+    VSOCK_CONN_CONNECTING,
+    VSOCK_CONN_CONNECTED,
+    /* Connection reset, waiting for the RST to be sent to the enclave */
+    VSOCK_CONN_CLOSING,
+};
+
+/* Control packets waiting to be sent to the enclave */
+#define VSOCK_PENDING_REQUEST 0x1
+#define VSOCK_PENDING_RESPONSE 0x2
+#define VSOCK_PENDING_CREDIT_UPDATE 0x4
+#define VSOCK_PENDING_SHUTDOWN 0x8
+
+#define VSOCK_SHUTDOWN_MASK \
+    (VIRTIO_VSOCK_SHUTDOWN_RCV | VIRTIO_VSOCK_SHUTDOWN_SEND)
+
+struct vsock_conn
+{
+    enum vsock_conn_state state;
+    /* Incremented whenever the connection slot is freed */
+    uint32_t gen;
+    int fd;
+    uint32_t guest_port;
+    uint32_t host_port;
+    uint32_t pending;
+
+    /* Receive buffer space of the enclave end and number of bytes it has
+     * consumed, as last reported by the enclave */
+    uint32_t peer_buf_alloc;
+    uint32_t peer_fwd_cnt;
+    /* Number of bytes sent to the enclave */
+    uint32_t rx_cnt;
+
+    /* The host socket may have data to read */
+    bool readable;
+    /* The host socket will not send more data */
+    bool host_eof;
+    /* Shutdown flags received from the enclave */
+    uint32_t guest_shutdown;
+
+    /* Data from the enclave the host socket has not accepted yet */
+    char* tx_buf;
+    uint32_t tx_head;
+    uint32_t tx_len;
+    /* Number of bytes from the enclave written to the host socket, and the
+     * count last reported to the enclave */
+    uint32_t fwd_cnt;
+    uint32_t fwd_cnt_sent;
+
+    /* CONNECT line of a connection from the host */
+    char line[VSOCK_CONNECT_LINE_MAX];
+    size_t line_len;
+};
+
+/* Virtio vsock device structure */
+struct virtio_vsock_dev
+{
+    struct virtio_dev dev;
+    struct virtio_vsock_config config;
+};
+
+/* Connection state of the device, which is not shared with the enclave */
+struct vsock_state
+{
+    const char* uds_path;
+    int listen_fd;
+    /* eventfd to make the poll thread update the set of polled sockets */
+    int kick_fd;
+    pthread_t poll_tid;
+    pthread_mutex_t qlocks[NUM_QUEUES];
+    /* Protects the connections */
+    pthread_mutex_t lock;
+    struct vsock_conn conns[VSOCK_MAX_CONNS];
+    /* Connection to look at first for data to send to the enclave */
+    unsigned rx_next;
+    uint32_t next_host_port;
+};
+
+/* Local variable to hold the settings locally */
+static host_dev_config_t* _cfg = NULL;
+static struct virtio_vsock_dev* _vsock_dev = NULL;
+static struct vsock_state _vsock;
+
+/*
+ * Function to make the poll thread update the set of polled sockets
+ */
+static void vsock_kick(struct vsock_state* vs)
+{
+    uint64_t one = 1;
+
+    if (write(vs->kick_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        sgxlkl_host_warn("%s: eventfd write failed: %d\n", __func__, errno);
+}
+
+static struct vsock_conn* vsock_conn_find(
+    struct vsock_state* vs,
+    uint32_t guest_port,
+    uint32_t host_port)
+{
+    for (int i = 0; i < VSOCK_MAX_CONNS; i++)
+    {
+        struct vsock_conn* conn = &vs->conns[i];
+
+        if (conn->state != VSOCK_CONN_FREE && conn->guest_port == guest_port &&
+            conn->host_port == host_port)
+            return conn;
+    }
+    return NULL;
+}
+
+static struct vsock_conn* vsock_conn_alloc(
+    struct vsock_state* vs,
+    enum vsock_conn_state state,
+    uint32_t guest_port,
+    uint32_t host_port)
+{
+    for (int i = 0; i < VSOCK_MAX_CONNS; i++)
+    {
+        struct vsock_conn* conn = &vs->conns[i];
+        uint32_t gen = conn->gen;
+
+        if (conn->state != VSOCK_CONN_FREE)
+            continue;
+
+        memset(conn, 0, sizeof(*conn));
+        conn->gen = gen;
+        conn->state = state;
+        conn->fd = -1;
+        conn->guest_port = guest_port;
+        conn->host_port = host_port;
+        return conn;
+    }
+    return NULL;
+}
+
+static void vsock_conn_close_fd(struct vsock_conn* conn)
+{
+    if (conn->fd >= 0)
+        close(conn->fd);
+    conn->fd = -1;
+    free(conn->tx_buf);
+    conn->tx_buf = NULL;
+    conn->tx_len = 0;
+}
+
+static void vsock_conn_free(struct vsock_conn* conn)
+{
+    vsock_conn_close_fd(conn);
+    conn->state = VSOCK_CONN_FREE;
+    conn->gen++;
+}
+
+/*
+ * Function to close the host socket of a connection and reset the enclave
+ * end of the connection
+ */
+static void vsock_conn_reset(struct vsock_conn* conn)
+{
+    vsock_conn_close_fd(conn);
+    conn->state = VSOCK_CONN_CLOSING;
+    conn->pending = 0;
+}
+
+/*
+ * Function to reset a connection of the enclave that may not exist on the
+ * host, e.g. in response to a packet for an unknown connection
+ */
+static void vsock_send_rst(
+    struct vsock_state* vs,
+    struct vsock_conn* conn,
+    uint32_t guest_port,
+    uint32_t host_port)
+{
+    if (conn)
+        vsock_conn_reset(conn);
+    else if (!vsock_conn_alloc(vs, VSOCK_CONN_CLOSING, guest_port, host_port))
+        sgxlkl_host_warn("vsock: too many connections, dropping reset\n");
+}
+
+/*
+ * Function to get the number of bytes that can be sent to the enclave end of
+ * a connection
+ */
+static uint32_t vsock_conn_peer_credit(struct vsock_conn* conn)
+{
+    uint32_t in_flight = conn->rx_cnt - conn->peer_fwd_cnt;
+
+    return conn->peer_buf_alloc > in_flight ? conn->peer_buf_alloc - in_flight
+                                            : 0;
+}
+
+/*
+ * Function to report freed buffer space to the enclave once enough of it is
+ * unreported. Smaller amounts are reported with the next packet.
+ */
+static void vsock_conn_check_credit(struct vsock_conn* conn)
+{
+    if (conn->fwd_cnt - conn->fwd_cnt_sent >= VSOCK_CREDIT_UPDATE_THRESHOLD)
+        conn->pending |= VSOCK_PENDING_CREDIT_UPDATE;
+}
+
+/*
+ * Function to write the buffered data of a connection to the host socket.
+ * Once all data is written, the shutdown of the enclave end is passed on.
+ */
+static void vsock_conn_drain(struct vsock_conn* conn)
+{
+    while (conn->tx_len)
+    {
+        uint32_t len = VSOCK_BUF_ALLOC - conn->tx_head;
+        ssize_t ret;
+
+        if (len > conn->tx_len)
+            len = conn->tx_len;
+
+        do
+        {
+            ret = send(
+                conn->fd, conn->tx_buf + conn->tx_head, len, MSG_NOSIGNAL);
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret < 0)
+        {
+            if (errno != EAGAIN)
+                vsock_conn_reset(conn);
+            return;
+        }
+
+        conn->tx_head = (conn->tx_head + ret) % VSOCK_BUF_ALLOC;
+        conn->tx_len -= ret;
+        conn->fwd_cnt += ret;
+    }
+    vsock_conn_check_credit(conn);
+
+    if (conn->guest_shutdown == VSOCK_SHUTDOWN_MASK)
+        vsock_conn_reset(conn);
+    else if (conn->guest_shutdown & VIRTIO_VSOCK_SHUTDOWN_SEND)
+        shutdown(conn->fd, SHUT_WR);
+}
+
+/*
+ * Function to write the len bytes of data of an RW packet in req to the host
+ * socket, buffering what the socket does not accept
+ */
+static void vsock_conn_write(
+    struct vsock_conn* conn,
+    struct virtio_req* req,
+    uint32_t len)
+{
+    size_t skip = sizeof(struct virtio_vsock_hdr);
+    ssize_t ret = 0;
+
+    if (len > req->total_len - skip)
+        len = req->total_len - skip;
+
+    /* The enclave must not send more than its credit */
+    if (conn->tx_len + len > VSOCK_BUF_ALLOC)
+    {
+        vsock_conn_reset(conn);
+        return;
+    }
+
+    if (!conn->tx_len)
+    {
+        struct iovec iov[VIRTIO_REQ_MAX_MERGE_BUFS];
+        struct msghdr msg = {
+            .msg_iov = iov,
+            .msg_iovlen = virtio_req_iov(req, skip, len, iov),
+        };
+
+        do
+        {
+            ret = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret < 0)
+        {
+            if (errno != EAGAIN)
+            {
+                vsock_conn_reset(conn);
+                return;
+            }
+            ret = 0;
+        }
+        conn->fwd_cnt += ret;
+        skip += ret;
+        len -= ret;
+    }
+
+    if (len && !conn->tx_buf)
+    {
+        conn->tx_buf = malloc(VSOCK_BUF_ALLOC);
+        if (!conn->tx_buf)
+        {
+            vsock_conn_reset(conn);
+            return;
+        }
+        conn->tx_head = 0;
+    }
+
+    while (len)
+    {
+        uint32_t tail = (conn->tx_head + conn->tx_len) % VSOCK_BUF_ALLOC;
+        uint32_t n = VSOCK_BUF_ALLOC - tail;
+
+        if (n > len)
+            n = len;
+
+        virtio_req_copy(req, skip, conn->tx_buf + tail, n, false);
+        conn->tx_len += n;
+        skip += n;
+        len -= n;
+    }
+
+    vsock_conn_check_credit(conn);
+}
+
+/*
+ * Function to connect the enclave to the Unix socket of a host port
+ */
+static void vsock_connect(
+    struct vsock_state* vs,
+    const struct virtio_vsock_hdr* hdr,
+    uint32_t guest_port,
+    uint32_t host_port)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct vsock_conn* conn;
+    int fd, len;
+
+    conn = vsock_conn_alloc(vs, VSOCK_CONN_CLOSING, guest_port, host_port);
+    if (!conn)
+    {
+        sgxlkl_host_warn("vsock: too many connections, refusing request\n");
+        return;
+    }
+
+    len = snprintf(
+        addr.sun_path, sizeof(addr.sun_path), "%s_%u", vs->uds_path, host_port);
+    if (len < 0 || len >= sizeof(addr.sun_path))
+        return;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return;
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return;
+    }
+
+    conn->fd = fd;
+    conn->state = VSOCK_CONN_CONNECTED;
+    conn->pending = VSOCK_PENDING_RESPONSE;
+    conn->peer_buf_alloc = le32toh(hdr->buf_alloc);
+    conn->peer_fwd_cnt = le32toh(hdr->fwd_cnt);
+}
+
+/*
+ * Function to handle a packet of the enclave
+ */
+static void vsock_handle_tx(
+    struct vsock_state* vs,
+    struct virtio_req* req,
+    const struct virtio_vsock_hdr* hdr)
+{
+    uint16_t op = le16toh(hdr->op);
+    uint32_t guest_port = le32toh(hdr->src_port);
+    uint32_t host_port = le32toh(hdr->dst_port);
+    uint32_t flags = le32toh(hdr->flags);
+    struct vsock_conn* conn = vsock_conn_find(vs, guest_port, host_port);
+
+    if (le16toh(hdr->type) != VIRTIO_VSOCK_TYPE_STREAM ||
+        le64toh(hdr->dst_cid) != VSOCK_HOST_CID)
+    {
+        if (op != VIRTIO_VSOCK_OP_RST)
+            vsock_send_rst(vs, conn, guest_port, host_port);
+        return;
+    }
+
+    /* A reset connection only waits for its RST to be sent */
+    if (conn && conn->state == VSOCK_CONN_CLOSING)
+        return;
+
+    if (!conn && op != VIRTIO_VSOCK_OP_REQUEST)
+    {
+        if (op != VIRTIO_VSOCK_OP_RST)
+            vsock_send_rst(vs, NULL, guest_port, host_port);
+        return;
+    }
+
+    if (conn)
+    {
+        conn->peer_buf_alloc = le32toh(hdr->buf_alloc);
+        conn->peer_fwd_cnt = le32toh(hdr->fwd_cnt);
+    }
+
+    switch (op)
+    {
+        case VIRTIO_VSOCK_OP_REQUEST:
+            if (conn)
+                vsock_conn_reset(conn);
+            else
+                vsock_connect(vs, hdr, guest_port, host_port);
+            break;
+        case VIRTIO_VSOCK_OP_RESPONSE:
+            if (conn->state != VSOCK_CONN_CONNECTING)
+            {
+                vsock_conn_reset(conn);
+                break;
+            }
+            conn->state = VSOCK_CONN_CONNECTED;
+            {
+                char ok[VSOCK_CONNECT_LINE_MAX];
+                int len = snprintf(ok, sizeof(ok), "OK %u\n", host_port);
+
+                /* The socket buffer of a new connection is empty */
+                if (send(conn->fd, ok, len, MSG_NOSIGNAL) != len)
+                    vsock_conn_reset(conn);
+            }
+            break;
+        case VIRTIO_VSOCK_OP_RST:
+            vsock_conn_free(conn);
+            break;
+        case VIRTIO_VSOCK_OP_SHUTDOWN:
+            /* Once the enclave has shut down both directions, the
+             * connection is reset after writing the buffered data */
+            conn->guest_shutdown |= flags & VSOCK_SHUTDOWN_MASK;
+            if (conn->state == VSOCK_CONN_CONNECTED)
+                vsock_conn_drain(conn);
+            else if (conn->guest_shutdown == VSOCK_SHUTDOWN_MASK)
+                vsock_conn_reset(conn);
+            break;
+        case VIRTIO_VSOCK_OP_RW:
+            if (conn->state != VSOCK_CONN_CONNECTED ||
+                (conn->guest_shutdown & VIRTIO_VSOCK_SHUTDOWN_SEND))
+                vsock_conn_reset(conn);
+            else
+                vsock_conn_write(conn, req, le32toh(hdr->len));
+            break;
+        case VIRTIO_VSOCK_OP_CREDIT_UPDATE:
+            /* The poll thread reads the host socket again if it has
+             * stopped for lack of credit */
+            break;
+        case VIRTIO_VSOCK_OP_CREDIT_REQUEST:
+            conn->pending |= VSOCK_PENDING_CREDIT_UPDATE;
+            break;
+        default:
+            vsock_conn_reset(conn);
+    }
+}
+
+static void vsock_fill_hdr(
+    struct vsock_conn* conn,
+    struct virtio_vsock_hdr* hdr,
+    uint16_t op,
+    uint32_t len)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->src_cid = htole64(VSOCK_HOST_CID);
+    hdr->dst_cid = htole64(VSOCK_GUEST_CID);
+    hdr->src_port = htole32(conn->host_port);
+    hdr->dst_port = htole32(conn->guest_port);
+    hdr->len = htole32(len);
+    hdr->type = htole16(VIRTIO_VSOCK_TYPE_STREAM);
+    hdr->op = htole16(op);
+    hdr->buf_alloc = htole32(VSOCK_BUF_ALLOC);
+    hdr->fwd_cnt = htole32(conn->fwd_cnt);
+
+    /* Every packet reports the freed buffer space */
+    conn->fwd_cnt_sent = conn->fwd_cnt;
+    conn->pending &= ~VSOCK_PENDING_CREDIT_UPDATE;
+}
+
+/*
+ * Function to build the next packet of a connection for the enclave in req.
+ * Returns the length of the packet data, or -1 if the connection has nothing
+ * to send.
+ */
+static ssize_t vsock_conn_rx(
+    struct vsock_conn* conn,
+    struct virtio_req* req,
+    struct virtio_vsock_hdr* hdr)
+{
+    size_t space = req->total_len - sizeof(*hdr);
+
+    switch (conn->state)
+    {
+        case VSOCK_CONN_CLOSING:
+            vsock_fill_hdr(conn, hdr, VIRTIO_VSOCK_OP_RST, 0);
+            vsock_conn_free(conn);
+            return 0;
+        case VSOCK_CONN_CONNECTING:
+            if (!(conn->pending & VSOCK_PENDING_REQUEST))
+                return -1;
+            conn->pending &= ~VSOCK_PENDING_REQUEST;
+            vsock_fill_hdr(conn, hdr, VIRTIO_VSOCK_OP_REQUEST, 0);
+            return 0;
+        case VSOCK_CONN_CONNECTED:
+            break;
+        default:
+            return -1;
+    }
+
+    if (conn->pending & VSOCK_PENDING_RESPONSE)
+    {
+        conn->pending &= ~VSOCK_PENDING_RESPONSE;
+        vsock_fill_hdr(conn, hdr, VIRTIO_VSOCK_OP_RESPONSE, 0);
+        return 0;
+    }
+
+    if (conn->readable && !conn->host_eof && space)
+    {
+        uint32_t credit = vsock_conn_peer_credit(conn);
+        struct iovec iov[VIRTIO_REQ_MAX_MERGE_BUFS];
+        ssize_t ret;
+
+        if (credit)
+        {
+            int iovcnt = virtio_req_iov(
+                req, sizeof(*hdr), space < credit ? space : credit, iov);
+
+            do
+            {
+                ret = readv(conn->fd, iov, iovcnt);
+            } while (ret == -1 && errno == EINTR);
+
+            if (ret > 0)
+            {
+                conn->rx_cnt += ret;
+                vsock_fill_hdr(conn, hdr, VIRTIO_VSOCK_OP_RW, ret);
+                return ret;
+            }
+
+            conn->readable = false;
+            if (ret == 0)
+            {
+                conn->host_eof = true;
+                conn->pending |= VSOCK_PENDING_SHUTDOWN;
+            }
+            else if (errno != EAGAIN)
+            {
+                vsock_fill_hdr(conn, hdr, VIRTIO_VSOCK_OP_RST, 0);
+                vsock_conn_free(conn);
+                return 0;
+            }
+        }
+    }
+
+    if (conn->pending & VSOCK_PENDING_SHUTDOWN)
+    {
+        conn->pending &= ~VSOCK_PENDING_SHUTDOWN;
+        vsock_fill_hdr(conn, hdr, VIRTIO_VSOCK_OP_SHUTDOWN, 0);
+        hdr->flags = htole32(VIRTIO_VSOCK_SHUTDOWN_SEND);
+        return 0;
+    }
+
+    if (conn->pending & VSOCK_PENDING_CREDIT_UPDATE)
+    {
+        vsock_fill_hdr(conn, hdr, VIRTIO_VSOCK_OP_CREDIT_UPDATE, 0);
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Function to fill a receive buffer of the enclave with the next packet of
+ * any connection, taking turns between the connections
+ */
+static int vsock_rx_enqueue(struct vsock_state* vs, struct virtio_req* req)
+{
+    struct virtio_vsock_hdr hdr;
+    ssize_t len = -1;
+
+    if (req->total_len < sizeof(hdr))
+    {
+        virtio_req_complete(req, 0);
+        return 0;
+    }
+
+    pthread_mutex_lock(&vs->lock);
+    for (int i = 0; i < VSOCK_MAX_CONNS && len < 0; i++)
+    {
+        unsigned idx = (vs->rx_next + i) % VSOCK_MAX_CONNS;
+
+        len = vsock_conn_rx(&vs->conns[idx], req, &hdr);
+        if (len >= 0)
+            vs->rx_next = (idx + 1) % VSOCK_MAX_CONNS;
+    }
+    pthread_mutex_unlock(&vs->lock);
+
+    if (len < 0)
+        return -1;
+
+    virtio_req_copy(req, 0, &hdr, sizeof(hdr), true);
+    virtio_req_complete(req, sizeof(hdr) + len);
+    return 0;
+}
+
+/*
+ * Function to process a packet of the enclave
+ */
+static int vsock_tx_enqueue(struct vsock_state* vs, struct virtio_req* req)
+{
+    struct virtio_vsock_hdr hdr;
+
+    if (virtio_req_copy(req, 0, &hdr, sizeof(hdr), false) == sizeof(hdr))
+    {
+        pthread_mutex_lock(&vs->lock);
+        vsock_handle_tx(vs, req, &hdr);
+        pthread_mutex_unlock(&vs->lock);
+    }
+
+    virtio_req_complete(req, 0);
+    return 0;
+}
+
+/*
+ * Function to process the virtio request
+ */
+static int vsock_enqueue(struct virtio_dev* dev, int q, struct virtio_req* req)
+{
+    if (q == RX_QUEUE_ID)
+        return vsock_rx_enqueue(&_vsock, req);
+
+    if (q == TX_QUEUE_ID)
+        return vsock_tx_enqueue(&_vsock, req);
+
+    /* The device does not send any events */
+    return -1;
+}
+
+/*
+ * Function to read the CONNECT line of a connection from the host. Reads a
+ * byte at a time to leave any data that follows the line in the socket.
+ * Returns true once the connection request is to be sent to the enclave.
+ */
+static bool vsock_conn_handshake(
+    struct vsock_state* vs,
+    struct vsock_conn* conn)
+{
+    uint32_t port, host_port;
+    char c;
+
+    for (;;)
+    {
+        ssize_t ret = read(conn->fd, &c, 1);
+
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0 && errno == EAGAIN)
+            return false;
+
+        if (ret <= 0 || conn->line_len == sizeof(conn->line) - 1)
+        {
+            vsock_conn_free(conn);
+            return false;
+        }
+
+        if (c == '\n')
+            break;
+
+        conn->line[conn->line_len++] = c;
+    }
+
+    conn->line[conn->line_len] = '\0';
+    if (sscanf(conn->line, "CONNECT %u", &port) != 1)
+    {
+        vsock_conn_free(conn);
+        return false;
+    }
+
+    do
+    {
+        host_port = vs->next_host_port++;
+        if (vs->next_host_port < VSOCK_HOST_PORT_BASE)
+            vs->next_host_port = VSOCK_HOST_PORT_BASE;
+    } while (vsock_conn_find(vs, port, host_port));
+
+    conn->guest_port = port;
+    conn->host_port = host_port;
+    conn->state = VSOCK_CONN_CONNECTING;
+    conn->pending = VSOCK_PENDING_REQUEST;
+    return true;
+}
+
+/*
+ * Function to accept the pending connections from the host
+ */
+static void vsock_accept(struct vsock_state* vs)
+{
+    for (;;)
+    {
+        struct vsock_conn* conn;
+        int fd = accept4(
+            vs->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return;
+        }
+
+        conn = vsock_conn_alloc(vs, VSOCK_CONN_HANDSHAKE, 0, 0);
+        if (!conn)
+        {
+            sgxlkl_host_warn("vsock: too many connections, refusing one\n");
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+    }
+}
+
+/*
+ * Poll thread, which waits for the host sockets to become readable or
+ * writable and moves data from the host sockets to the enclave
+ */
+static void* vsock_poll_task(void* arg)
+{
+    struct vsock_state* vs = arg;
+    struct virtio_dev* dev = &_vsock_dev->dev;
+    struct pollfd fds[VSOCK_MAX_CONNS + 2];
+    struct vsock_conn* conns[VSOCK_MAX_CONNS + 2];
+    uint32_t gens[VSOCK_MAX_CONNS + 2];
+
+    while (1)
+    {
+        bool rx = false;
+        int nfds = 0, ret;
+
+        fds[nfds++] = (struct pollfd){.fd = vs->kick_fd, .events = POLLIN};
+        fds[nfds++] = (struct pollfd){.fd = vs->listen_fd, .events = POLLIN};
+
+        pthread_mutex_lock(&vs->lock);
+        for (int i = 0; i < VSOCK_MAX_CONNS; i++)
+        {
+            struct vsock_conn* conn = &vs->conns[i];
+            short events = 0;
+
+            if (conn->fd < 0)
+                continue;
+
+            if (conn->state == VSOCK_CONN_HANDSHAKE)
+                events = POLLIN;
+            else if (conn->state == VSOCK_CONN_CONNECTED)
+            {
+                if (!conn->readable && !conn->host_eof &&
+                    vsock_conn_peer_credit(conn))
+                    events |= POLLIN;
+                if (conn->tx_len)
+                    events |= POLLOUT;
+            }
+
+            /* Sockets of connections from the host are also polled while
+             * the enclave accepts them, to notice if they are closed */
+            if (!events && conn->state != VSOCK_CONN_CONNECTING)
+                continue;
+
+            conns[nfds] = conn;
+            gens[nfds] = conn->gen;
+            fds[nfds++] = (struct pollfd){.fd = conn->fd, .events = events};
+        }
+        pthread_mutex_unlock(&vs->lock);
+
+        do
+        {
+            ret = poll(fds, nfds, -1);
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret < 0)
+            sgxlkl_host_fail("%s: poll failed: %d\n", __func__, errno);
+
+        pthread_mutex_lock(&vs->lock);
+        if (fds[0].revents)
+        {
+            uint64_t val;
+            if (read(vs->kick_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+                sgxlkl_host_warn("%s: eventfd read failed\n", __func__);
+        }
+
+        if (fds[1].revents)
+            vsock_accept(vs);
+
+        for (int i = 2; i < nfds; i++)
+        {
+            struct vsock_conn* conn = conns[i];
+            short revents = fds[i].revents;
+
+            /* Skip connections closed or reused while polling */
+            if (!revents || conn->gen != gens[i] || conn->fd != fds[i].fd)
+                continue;
+
+            switch (conn->state)
+            {
+                case VSOCK_CONN_HANDSHAKE:
+                    rx |= vsock_conn_handshake(vs, conn);
+                    break;
+                case VSOCK_CONN_CONNECTING:
+                    if (revents & (POLLHUP | POLLERR))
+                    {
+                        vsock_conn_reset(conn);
+                        rx = true;
+                    }
+                    break;
+                case VSOCK_CONN_CONNECTED:
+                    if (revents & POLLOUT)
+                        vsock_conn_drain(conn);
+                    if (revents & (POLLIN | POLLHUP | POLLERR))
+                        conn->readable = true;
+                    rx = true;
+                    break;
+                default:
+                    break;
+            }
+        }
+        pthread_mutex_unlock(&vs->lock);
+
+        if (rx)
+            virtio_process_queue(dev, RX_QUEUE_ID);
+    }
+
+    return NULL;
+}
+
+/*
+ * Virtio callback function to acquire the lock before processing the request
+ */
+static void vsock_acquire_queue(struct virtio_dev* dev, int queue_idx)
+{
+    pthread_mutex_lock(&_vsock.qlocks[queue_idx]);
+}
+
+/*
+ * Virtio callback function to release the lock once the processing is completed
+ */
+static void vsock_release_queue(struct virtio_dev* dev, int queue_idx)
+{
+    pthread_mutex_unlock(&_vsock.qlocks[queue_idx]);
+}
+
+/*
+ * Function to check the features supported
+ */
+static int vsock_check_features(struct virtio_dev* dev)
+{
+    if ((dev->driver_features & ~dev->device_features) == 0)
+        return 0;
+
+    return -EINVAL;
+}
+
+static struct virtio_dev_ops host_vsock_ops = {
+    .check_features = vsock_check_features,
+    .enqueue = vsock_enqueue,
+    .acquire_queue = vsock_acquire_queue,
+    .release_queue = vsock_release_queue,
+};
+
+/*
+ * Function to create the Unix socket that host processes connect to
+ */
+static int vsock_listen(const char* path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        sgxlkl_host_fail("vsock: socket path %s too long\n", path);
+    strcpy(addr.sun_path, path);
+
+    /* Remove the socket left behind by a previous run */
+    if (!stat(path, &st) && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0)
+        sgxlkl_host_fail(
+            "vsock: failed to listen on %s: %s\n", path, strerror(errno));
+
+    return fd;
+}
+
+/*
+ * Function to initialize the vsock device based on the user config
+ * This function allocates the memory for virtio device & virtio ring buffer.
+ * The shared memory is shared between host & enclave
+ */
+int virtio_vsock_init(sgxlkl_host_state_t* host_state, host_dev_config_t* cfg)
+{
+    struct vsock_state* vs = &_vsock;
+    void* vsock_vq_mem = NULL;
+
+    size_t host_vsock_size = next_pow2(sizeof(struct virtio_vsock_dev));
+    size_t vsock_vq_size = next_pow2(NUM_QUEUES * sizeof(struct virtq));
+
+    /* Vsock host device configuration */
+    _cfg = cfg;
+
+    /* Allocate memory for vsock device */
+    _vsock_dev = mmap(
+        0,
+        host_vsock_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS,
+        -1,
+        0);
+
+    if (_vsock_dev == MAP_FAILED)
+    {
+        sgxlkl_host_fail("Host vsock device mem alloc failed\n");
+        return -1;
+    }
+
+    /* Allocate memory for virtio queue */
+    vsock_vq_mem = mmap(
+        0,
+        vsock_vq_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS,
+        -1,
+        0);
+
+    if (vsock_vq_mem == MAP_FAILED)
+    {
+        sgxlkl_host_fail("Host vsock device virtio queue mem alloc failed\n");
+        return -1;
+    }
+
+    struct virtio_dev* dev = &_vsock_dev->dev;
+
+    dev->queue = vsock_vq_mem;
+    memset(dev->queue, 0, vsock_vq_size);
+
+    /* assign the queue depth to each virt queue */
+    for (int i = 0; i < NUM_QUEUES; i++)
+    {
+        dev->queue[i].num_max = QUEUE_DEPTH;
+        virtio_set_queue_coalescing(
+            dev,
+            i,
+            host_state->config.virtio_completion_batch,
+            host_state->config.virtio_completion_delay_us);
+        pthread_mutex_init(&vs->qlocks[i], NULL);
+    }
+
+    _vsock_dev->config.guest_cid = htole64(VSOCK_GUEST_CID);
+    dev->config_data = &_vsock_dev->config;
+    dev->config_len = sizeof(_vsock_dev->config);
+
+    /* set vsock device feature */
+    dev->device_id = VIRTIO_ID_VSOCK;
+    dev->vendor_id = _cfg->dev_id;
+    dev->device_features =
+        BIT(VIRTIO_F_VERSION_1) | BIT(VIRTIO_RING_F_EVENT_IDX);
+
+    if (host_state->enclave_config.mode != SW_DEBUG_MODE)
+        dev->device_features |= BIT(VIRTIO_F_IOMMU_PLATFORM);
+
+    if (host_state->config.packed_virtqueues)
+        dev->device_features |= BIT(VIRTIO_F_RING_PACKED);
+
+    dev->ops = &host_vsock_ops;
+
+    for (int i = 0; i < VSOCK_MAX_CONNS; i++)
+        vs->conns[i].fd = -1;
+    pthread_mutex_init(&vs->lock, NULL);
+    vs->uds_path = host_state->config.vsock_uds_path;
+    vs->next_host_port = VSOCK_HOST_PORT_BASE;
+    vs->listen_fd = vsock_listen(vs->uds_path);
+
+    vs->kick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (vs->kick_fd < 0)
+        sgxlkl_host_fail("%s: eventfd call failed: %d\n", __func__, errno);
+
+    /* Start the poll thread for the host sockets */
+    if (host_thread_create(
+            &vs->poll_tid,
+            HOST_THREAD_DEVICE,
+            "HOST_VSOCK_POLL",
+            vsock_poll_task,
+            vs))
+        sgxlkl_host_fail("Failed to start the host vsock poll task\n");
+
+    host_state->shared_memory.virtio_vsock_mem = dev;
+
+    return 0;
+}
+
+/*
+ * Host vsock task for monitoring the virtio events from host
+ * and processing the request
+ */
+void* vsock_task(void* arg)
+{
+    int timeout_ms = WAIT_FOR_EVENT_TIMEOUT;
+    struct virtio_dev* dev = &_vsock_dev->dev;
+
+    pthread_mutex_init(&(_cfg->lock), NULL);
+    pthread_cond_init(&(_cfg->cond), NULL);
+
+    while (1)
+    {
+        vio_host_process_enclave_event(_cfg->dev_id, timeout_ms);
+
+        if (vio_host_check_guest_shutdown_evt())
+            continue;
+
+        /* Packets of the enclave may change the sockets to poll, e.g. by
+         * returning credit, and queue control packets for the enclave */
+        if (virtio_process_queue_batch(dev, TX_QUEUE_ID, INT_MAX))
+            vsock_kick(&_vsock);
+
+        virtio_process_queue(dev, RX_QUEUE_ID);
+    }
+}
+
+void virtio_vsock_cleanup(void)
+{
+    if (_vsock_dev)
+        unlink(_vsock.uds_path);
+}
@@ -2,6 +2,7 @@
 #define ENCLAVE_MEM_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/sysinfo.h>
 #include <sys/types.h>
 #include <time.h>
@@ -49,6 +50,53 @@ extern int mmap_files; // Allow MAP_PRIVATE or MAP_SHARED?
  */
 void enclave_mem_info(size_t* total, size_t* free);
 
+/**
+ * Snapshot of the enclave mmap allocator state. Page counts are in units of
+ * PAGE_SIZE. The counters are maintained in all build types and are cheap
+ * enough to be read at any time.
+ */
+typedef struct enclave_mem_stats
+{
+    size_t total_pages;        /* Pages managed by the mmap allocator */
+    size_t used_pages;         /* Pages currently mapped */
+    size_t free_pages;         /* Pages currently unmapped */
+    size_t peak_used_pages;    /* Maximum of used_pages seen so far */
+    size_t largest_free_pages; /* Largest contiguous range of free pages */
+    size_t free_extents;       /* Number of contiguous free ranges */
+
+    /* Fragmentation index in hundredths of a percent (0-10000): the share of
+     * free memory that is not part of the largest free extent */
+    size_t frag_index;
+
+    uint64_t num_fixed;     /* Successful MAP_FIXED allocations */
+    uint64_t num_hinted;    /* Allocations placed at the address hint */
+    uint64_t num_searched;  /* Allocations placed by searching the bitmap */
+    uint64_t num_anonymous; /* Anonymous mappings requested via mmap() */
+    uint64_t num_file;      /* File-backed mappings requested via mmap() */
+    uint64_t num_failed;    /* Allocations that failed with ENOMEM */
+    uint64_t num_munmap;    /* munmap calls on the enclave memory range */
+
+    uint64_t zeroed_bytes;    /* Bytes explicitly zeroed on allocation */
+    uint64_t mprotect_ocalls; /* mprotect ocalls issued by enclave_mmap */
+} enclave_mem_stats_t;
+
+/**
+ * Fill in stats with the current state of the enclave mmap allocator
+ */
+void enclave_mem_get_stats(enclave_mem_stats_t* stats);
+
+/**
+ * Format the current allocator state as "key: value" lines into buf, in the
+ * style of /proc/meminfo. Returns the number of characters that would have
+ * been written (as snprintf).
+ */
+int enclave_mem_format_stats(char* buf, size_t len);
+
+/**
+ * Record the type of a mapping requested through the mmap() system call
+ */
+void enclave_mem_count_mapping(int file_backed);
+
 long syscall_SYS_munmap(void* addr, size_t length);
 
 long syscall_SYS_mremap(
@@ -20,6 +20,7 @@ typedef struct sgxlkl_enclave_disk_state
     int fd;                 /* File descriptor of the disk */
     size_t capacity;        /* Capacity of the disk */
     bool mounted;           /* Tracks whether the disk has been mounted */
+    bool placeholder;       /* Empty placeholder mounted below a lazy disk */
 } sgxlkl_enclave_disk_state_t;
 
 typedef struct
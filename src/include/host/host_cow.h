@@ -0,0 +1,84 @@
+#ifndef HOST_COW_H
+#define HOST_COW_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*
+ * Copy-on-write disk backend. A disk is served from a read-only base image
+ * that can be shared by many enclaves, plus a per-instance delta file that
+ * holds the clusters written by this instance. The delta file is sparse:
+ * cluster i is stored at a fixed offset in the data area, so that only
+ * written clusters take up space, and a bitmap in the delta file records
+ * which clusters have been written. Partial writes to a cluster that is
+ * still in the base image copy the cluster into the delta file first.
+ *
+ * Layout of the delta file:
+ *   header (HOST_COW_CLUSTER_SIZE bytes)
+ *   bitmap (one bit per cluster, padded to the cluster size)
+ *   data   (one cluster per cluster of the disk)
+ *
+ * Bits are only set in the delta file by host_cow_fsync, once the data of
+ * their clusters is durable. After a crash, clusters written since the last
+ * fsync may thus be read from the base image again, but a cluster is never
+ * marked as written without its data.
+ *
+ * The header records the size of the base image and a hash of its start and
+ * its end, so that a delta file is not applied to another image. The base
+ * image must not change once delta files refer to it.
+ */
+
+#define HOST_COW_CLUSTER_SIZE 4096
+
+struct host_cow;
+
+/*
+ * Set up the copy-on-write backend for the base image base_fd of base_size
+ * bytes and the delta file fd. An empty delta file is initialized, an
+ * existing one is checked against the base image. Returns 0 on success or
+ * a negative errno value (-EINVAL if the delta file is invalid).
+ */
+int host_cow_open(
+    struct host_cow** cow,
+    int base_fd,
+    uint64_t base_size,
+    int fd);
+
+/*
+ * Write the bitmap, release the backend and close the delta file. The base
+ * image is left open.
+ */
+void host_cow_close(struct host_cow* cow);
+
+/*
+ * Read or write the disk as preadv/pwritev. Returns the number of bytes
+ * transferred or -1 with errno set.
+ */
+ssize_t host_cow_preadv(
+    struct host_cow* cow,
+    const struct iovec* iov,
+    int iovcnt,
+    off_t offset);
+ssize_t host_cow_pwritev(
+    struct host_cow* cow,
+    const struct iovec* iov,
+    int iovcnt,
+    off_t offset);
+
+/*
+ * Make all writes durable: the data first, then the bitmap. Returns 0 or -1
+ * with errno set.
+ */
+int host_cow_fsync(struct host_cow* cow);
+
+/*
+ * Number of clusters stored in the delta file and number of clusters
+ * copied from the base image by partial writes
+ */
+void host_cow_get_stats(
+    struct host_cow* cow,
+    uint64_t* num_allocated,
+    uint64_t* num_copied);
+
+#endif /* HOST_COW_H */
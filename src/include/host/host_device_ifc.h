@@ -22,6 +22,24 @@ int blk_device_init(
  */
 void* blkdevice_thread(void* args);
 
+/*
+ * Print the readahead statistics of a block device (verbose output only)
+ */
+void blk_device_print_stats(size_t disk_index);
+
+/*
+ * Serve a block device from a pool of at most max_threads disk I/O threads
+ * shared by all block devices added this way, instead of running
+ * blkdevice_thread for it. Threads are started as the load requires.
+ */
+void blk_reactor_add_device(host_dev_config_t* cfg, size_t max_threads);
+
+/*
+ * Print the queueing statistics of the block devices served by the shared
+ * disk I/O threads (verbose output only)
+ */
+void blk_reactor_print_stats(void);
+
 /* Network device interface */
 /*
  * Function to initialize the network device configuration and setup the virtio
@@ -52,6 +70,60 @@ int virtio_console_init(
  */
 void* console_task(void* arg);
 
+/*
+ * Write out the console output buffered on the host, if console output
+ * buffering is enabled
+ */
+void virtio_console_flush(void);
+
+/* Vsock device interface */
+
+/* Function to initialize the vsock device configuration and setup the virtio
+ * device and queue which is shared with guest for virtio processing
+ */
+int virtio_vsock_init(
+    sgxlkl_host_state_t* host_state,
+    host_dev_config_t* host_cfg);
+
+/*
+ * Vsock device backend task which listens for the guest request using event
+ * channel and process the request and notify the guest using ecall
+ */
+void* vsock_task(void* arg);
+
+/*
+ * Function to remove the Unix socket of the vsock device
+ */
+void virtio_vsock_cleanup(void);
+
+/* 9p device interface */
+
+/* Function to initialize the 9p device configuration and setup the virtio
+ * device and queue which is shared with guest for virtio processing
+ */
+int virtio_9p_init(
+    sgxlkl_host_state_t* host_state,
+    host_dev_config_t* host_cfg);
+
+/*
+ * 9p device backend task which listens for the guest request using event
+ * channel and process the request and notify the guest using ecall
+ */
+void* p9_task(void* arg);
+
+/* Virtio bounce buffer statistics */
+
+/*
+ * Function to start accounting the I/O of the devices through the bounce
+ * buffer area shared with the enclave
+ */
+void virtio_bounce_stats_init(void* base, size_t size, size_t num_devs);
+
+/*
+ * Print the bounce buffer statistics of all devices (verbose output only)
+ */
+void virtio_print_bounce_stats(void);
+
 /* Timer device interface */
 
 /* Function to initialize the timer device configuration and set up shared
@@ -0,0 +1,56 @@
+#ifndef HOST_IO_URING_H
+#define HOST_IO_URING_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+ * Minimal io_uring wrapper for the host device backends, implemented on top
+ * of the raw system calls so that no additional library is required. If the
+ * host kernel or the build environment do not support io_uring,
+ * host_uring_init fails with -ENOSYS and callers fall back to synchronous
+ * system calls.
+ */
+
+#define HOST_URING_OP_READV 1
+#define HOST_URING_OP_WRITEV 2
+#define HOST_URING_OP_FSYNC 3
+
+struct host_uring;
+
+/*
+ * Create a ring with space for at least entries submissions.
+ * Returns 0 on success or a negative errno value.
+ */
+int host_uring_init(struct host_uring** ring, unsigned entries);
+
+void host_uring_destroy(struct host_uring* ring);
+
+/*
+ * Queue a readv/writev/fsync operation. The iovec array must remain valid
+ * until the operation completes. iov, iovcnt and offset are ignored for
+ * fsync. Returns 0 or -EBUSY if the submission queue is full.
+ */
+int host_uring_prep(
+    struct host_uring* ring,
+    int op,
+    int fd,
+    const struct iovec* iov,
+    unsigned iovcnt,
+    uint64_t offset,
+    void* user_data);
+
+/*
+ * Submit all queued operations and wait until at least wait_nr operations
+ * have completed. Returns the number of submitted operations or a negative
+ * errno value.
+ */
+int host_uring_submit(struct host_uring* ring, unsigned wait_nr);
+
+/*
+ * Retrieve the next completion without blocking. Returns 1 and fills in
+ * user_data and res if a completion was available, 0 otherwise.
+ */
+int host_uring_reap(struct host_uring* ring, void** user_data, int* res);
+
+#endif /* HOST_IO_URING_H */
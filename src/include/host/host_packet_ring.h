@@ -0,0 +1,84 @@
+#ifndef HOST_PACKET_RING_H
+#define HOST_PACKET_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+ * AF_PACKET network backend with memory-mapped RX and TX rings (TPACKET_V3).
+ * Packets are copied between the rings shared with the host kernel and the
+ * virtio rings, so that sending or receiving a packet does not require a
+ * system call. The kernel hands over received packets in blocks, and queued
+ * packets are transmitted with a single system call per batch.
+ */
+
+struct host_packet_ring
+{
+    int fd;
+
+    /* Receive ring: blocks of packets filled by the kernel */
+    uint8_t* rx_map;
+    size_t rx_block_size;
+    unsigned rx_num_blocks;
+    unsigned rx_block_idx;
+    /* Next packet and number of packets left in the current block */
+    uint8_t* rx_pkt;
+    uint32_t rx_pkts_left;
+
+    /* Transmit ring: fixed-size frames filled by us */
+    uint8_t* tx_map;
+    size_t tx_frame_size;
+    unsigned tx_num_frames;
+    unsigned tx_frame_idx;
+    /* Number of frames queued since the last flush */
+    unsigned tx_pending;
+
+    size_t map_size;
+};
+
+/*
+ * Open an AF_PACKET socket bound to the network interface ifname, e.g. one
+ * end of a veth pair, in promiscuous mode. Returns the socket or a negative
+ * errno value.
+ */
+int host_packet_socket_open(const char* ifname);
+
+/*
+ * Set up and map the RX and TX rings of the packet socket fd.
+ * Returns 0 on success or a negative errno value.
+ */
+int host_packet_ring_init(struct host_packet_ring* ring, int fd);
+
+/* Unmap the rings and close the socket */
+void host_packet_ring_destroy(struct host_packet_ring* ring);
+
+/*
+ * Copy the next received packet into iov. Packets longer than iov are
+ * truncated. Returns the number of bytes copied or -EAGAIN if no packet is
+ * available.
+ */
+ssize_t host_packet_ring_recv(
+    struct host_packet_ring* ring,
+    const struct iovec* iov,
+    int iovcnt);
+
+/*
+ * Queue the packet in iov for transmission. Packets are only sent by
+ * host_packet_ring_flush. Returns the packet length, -EAGAIN if the TX ring
+ * is full or -EMSGSIZE if the packet does not fit a frame.
+ */
+ssize_t host_packet_ring_send(
+    struct host_packet_ring* ring,
+    const struct iovec* iov,
+    int iovcnt);
+
+/*
+ * Make the kernel transmit the queued packets without waiting for them to be
+ * sent. Returns 0 or a negative errno value, in which case the packets
+ * remain queued and are sent by the next flush. -EAGAIN means that the
+ * socket is out of send buffer space; flush again once it is writable.
+ */
+int host_packet_ring_flush(struct host_packet_ring* ring);
+
+#endif /* HOST_PACKET_RING_H */
@@ -6,6 +6,7 @@
 #include <shared/shared_memory.h>
 
 #define HOST_MAX_DISKS 32
+#define HOST_MAX_NET_QUEUE_PAIRS 8
 
 typedef struct sgxlkl_host_disk_state
 {
@@ -13,9 +14,10 @@ typedef struct sgxlkl_host_disk_state
         mount_config; /* Pointer to disk config (for mounts)*/
     const sgxlkl_host_root_config_t*
         root_config; /* Pointer to root disk config (for root only) */
-    int fd;          /* File descriptor */
-    char* mmap;      /* Memory map */
-    size_t size;     /* Size of disk */
+    int fd;               /* File descriptor */
+    char* mmap;           /* Memory map */
+    size_t size;          /* Size of disk */
+    struct host_cow* cow; /* Copy-on-write delta of the image, or NULL */
 } sgxlkl_host_disk_state_t;
 
 typedef struct sgxlkl_host_state
@@ -26,6 +28,14 @@ typedef struct sgxlkl_host_state
     /* File descriptor of the network device */
     int net_fd;
 
+    /* File descriptors of the network device, one per queue pair of a
+     * multi-queue tap device (the first one is net_fd) */
+    size_t num_net_queue_pairs;
+    int net_queue_fds[HOST_MAX_NET_QUEUE_PAIRS];
+
+    /* Whether net_fd is an AF_PACKET socket rather than a tap device */
+    int net_is_packet_socket;
+
     /* Host-side state of disks */
     size_t num_disks;
     sgxlkl_host_disk_state_t disks[HOST_MAX_DISKS];
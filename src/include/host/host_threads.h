@@ -0,0 +1,54 @@
+#ifndef HOST_THREADS_H
+#define HOST_THREADS_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ * Helper threads of the launcher, i.e. all host threads other than the
+ * ethreads. Each class of threads can be pinned to a set of CPUs and given
+ * a scheduling policy, so that the helper threads do not compete with the
+ * ethreads for their cores. The CPU time used by each thread is printed at
+ * exit.
+ */
+
+typedef enum host_thread_class
+{
+    /* Virtio device tasks and their worker threads */
+    HOST_THREAD_DEVICE,
+    /* Timer device task */
+    HOST_THREAD_TIMER,
+    HOST_THREAD_CLASS_COUNT
+} host_thread_class_t;
+
+/*
+ * Set the CPU affinity and scheduling of a class of threads for all threads
+ * of the class created afterwards. cores is an array of cores_len CPU IDs,
+ * as returned by parse_cpu_affinity_params. sched has the format
+ * "<policy>[:<priority>]", where policy is one of "other", "batch", "idle",
+ * "fifo" and "rr" and priority is the real-time priority for "fifo" and
+ * "rr" and the nice value otherwise. An empty sched keeps the default.
+ */
+void host_threads_configure(
+    host_thread_class_t cls,
+    const int* cores,
+    size_t cores_len,
+    const char* sched);
+
+/*
+ * Create a thread of the given class with the given name. Returns 0 or an
+ * error number as pthread_create.
+ */
+int host_thread_create(
+    pthread_t* thread,
+    host_thread_class_t cls,
+    const char* name,
+    void* (*start_routine)(void*),
+    void* arg);
+
+/*
+ * Print the CPU time used by each thread created with host_thread_create
+ */
+void host_threads_print_cpu_time(void);
+
+#endif /* HOST_THREADS_H */
@@ -3,32 +3,58 @@
 
 #define SGXLKL_APP_CONFIG "SGXLKL_APP_CONFIG"
 #define SGXLKL_CMDLINE "SGXLKL_CMDLINE"
+#define SGXLKL_CONSOLE_BUFFER_SIZE "SGXLKL_CONSOLE_BUFFER_SIZE"
+#define SGXLKL_CONSOLE_FLUSH_DELAY_MS "SGXLKL_CONSOLE_FLUSH_DELAY_MS"
+#define SGXLKL_CONSOLE_SPIN_US "SGXLKL_CONSOLE_SPIN_US"
 #define SGXLKL_CWD "SGXLKL_CWD"
 #define SGXLKL_DEBUGMOUNT "SGXLKL_DEBUGMOUNT"
+#define SGXLKL_DEVICE_SPIN_US "SGXLKL_DEVICE_SPIN_US"
+#define SGXLKL_DEVICE_THREADS_AFFINITY "SGXLKL_DEVICE_THREADS_AFFINITY"
+#define SGXLKL_DEVICE_THREADS_SCHED "SGXLKL_DEVICE_THREADS_SCHED"
+#define SGXLKL_DISK_IO_THREADS "SGXLKL_DISK_IO_THREADS"
+#define SGXLKL_DISK_MMAP_IO "SGXLKL_DISK_MMAP_IO"
 #define SGXLKL_ESPINS "SGXLKL_ESPINS"
 #define SGXLKL_ESLEEP "SGXLKL_ESLEEP"
 #define SGXLKL_ETHREADS "SGXLKL_ETHREADS"
 #define SGXLKL_ETHREADS_AFFINITY "SGXLKL_ETHREADS_AFFINITY"
 #define SGXLKL_GW4 "SGXLKL_GW4"
 #define SGXLKL_HD "SGXLKL_HD"
+#define SGXLKL_HD_COW "SGXLKL_HD_COW"
 #define SGXLKL_HD_KEY "SGXLKL_HD_KEY"
+#define SGXLKL_HD_NUM_QUEUES "SGXLKL_HD_NUM_QUEUES"
+#define SGXLKL_HD_QUEUE_DEPTH "SGXLKL_HD_QUEUE_DEPTH"
 #define SGXLKL_HD_RO "SGXLKL_HD_RO"
+#define SGXLKL_HD_SPIN_US "SGXLKL_HD_SPIN_US"
 #define SGXLKL_HDS "SGXLKL_HDS"
 #define SGXLKL_HD_VERITY "SGXLKL_HD_VERITY"
 #define SGXLKL_HD_VERITY_OFFSET "SGXLKL_HD_VERITY_OFFSET"
 #define SGXLKL_HOSTNAME "SGXLKL_HOSTNAME"
 #define SGXLKL_HOSTNET "SGXLKL_HOSTNET"
+#define SGXLKL_HOST_DIR "SGXLKL_HOST_DIR"
+#define SGXLKL_HOST_DIR_SPIN_US "SGXLKL_HOST_DIR_SPIN_US"
+#define SGXLKL_IO_URING "SGXLKL_IO_URING"
 #define SGXLKL_IP4 "SGXLKL_IP4"
 #define SGXLKL_KERNEL_VERBOSE "SGXLKL_KERNEL_VERBOSE"
 #define SGXLKL_MASK4 "SGXLKL_MASK4"
 #define SGXLKL_MAX_USER_THREADS "SGXLKL_MAX_USER_THREADS"
 #define SGXLKL_MMAP_FILES "SGXLKL_MMAP_FILES"
+#define SGXLKL_NET_BATCH_SIZE "SGXLKL_NET_BATCH_SIZE"
+#define SGXLKL_NET_BUSY_POLL_US "SGXLKL_NET_BUSY_POLL_US"
+#define SGXLKL_NET_SPIN_US "SGXLKL_NET_SPIN_US"
+#define SGXLKL_PACKED_VIRTQUEUES "SGXLKL_PACKED_VIRTQUEUES"
+#define SGXLKL_PACKET_DEVICE "SGXLKL_PACKET_DEVICE"
 #define SGXLKL_PRINT_APP_RUNTIME "SGXLKL_PRINT_APP_RUNTIME"
+#define SGXLKL_PRINT_MEM_STATS "SGXLKL_PRINT_MEM_STATS"
+#define SGXLKL_READAHEAD_WINDOW "SGXLKL_READAHEAD_WINDOW"
 #define SGXLKL_STACK_SIZE "SGXLKL_STACK_SIZE"
+#define SGXLKL_SWIOTLB_SIZE "SGXLKL_SWIOTLB_SIZE"
 #define SGXLKL_SYSCTL "SGXLKL_SYSCTL"
 #define SGXLKL_TAP "SGXLKL_TAP"
 #define SGXLKL_TAP_MTU "SGXLKL_TAP_MTU"
+#define SGXLKL_TAP_NUM_QUEUES "SGXLKL_TAP_NUM_QUEUES"
 #define SGXLKL_TAP_OFFLOAD "SGXLKL_TAP_OFFLOAD"
+#define SGXLKL_TIMER_THREAD_AFFINITY "SGXLKL_TIMER_THREAD_AFFINITY"
+#define SGXLKL_TIMER_THREAD_SCHED "SGXLKL_TIMER_THREAD_SCHED"
 #define SGXLKL_TRACE_HOST_SYSCALL "SGXLKL_TRACE_HOST_SYSCALL"
 #define SGXLKL_TRACE_INTERNAL_SYSCALL "SGXLKL_TRACE_INTERNAL_SYSCALL"
 #define SGXLKL_TRACE_LKL_SYSCALL "SGXLKL_TRACE_LKL_SYSCALL"
@@ -39,6 +65,10 @@
 #define SGXLKL_TRACE_SYSCALL "SGXLKL_TRACE_SYSCALL"
 #define SGXLKL_TRACE_THREAD "SGXLKL_TRACE_THREAD"
 #define SGXLKL_VERBOSE "SGXLKL_VERBOSE"
+#define SGXLKL_VIRTIO_COMPLETION_BATCH "SGXLKL_VIRTIO_COMPLETION_BATCH"
+#define SGXLKL_VIRTIO_COMPLETION_DELAY_US "SGXLKL_VIRTIO_COMPLETION_DELAY_US"
+#define SGXLKL_VSOCK_SPIN_US "SGXLKL_VSOCK_SPIN_US"
+#define SGXLKL_VSOCK_UDS_PATH "SGXLKL_VSOCK_UDS_PATH"
 #define SGXLKL_WG_IP "SGXLKL_WG_IP"
 #define SGXLKL_WG_PORT "SGXLKL_WG_PORT"
 #define SGXLKL_WG_KEY "SGXLKL_WG_KEY"
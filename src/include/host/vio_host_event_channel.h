@@ -7,6 +7,8 @@
 
 #define HOST_NETWORK_DEV_COUNT 1
 #define HOST_CONSOLE_DEV_COUNT 1
+#define HOST_VSOCK_DEV_COUNT 1
+#define HOST_9P_DEV_COUNT 1
 
 typedef struct host_evt_channel
 {
@@ -22,15 +24,30 @@ typedef struct host_dev_config
     evt_t evt_processed;
     pthread_mutex_t lock;
     pthread_cond_t cond;
+
+    /* Enclave side of the device configuration, for its statistics */
+    enc_dev_config_t* enc_dev_cfg;
+
+    /* Time for which the device thread spins on its event channel before
+     * blocking, during which the enclave does not need an ocall to notify
+     * it. Counts of waits ended while spinning and of blocking waits. */
+    uint64_t spin_ns;
+    uint64_t num_spin_wakeups;
+    uint64_t num_sleeps;
+
+    /* Called instead of waking up the device thread if the device is served
+     * by a shared pool of threads */
+    void (*wakeup)(uint8_t dev_id);
 } host_dev_config_t;
 
 /*
  * Function to initialize the host device configuration. This function
  * allocates the required memory for host & enclave event channel & setup
- * bounce buffer for virtio
+ * bounce buffer for virtio of swiotlb_size bytes (0 for the default size)
  */
 int initialize_host_device_configuration(
     bool swiotlb,
+    size_t swiotlb_size,
     sgxlkl_shared_memory_t* cfg,
     host_dev_config_t** host_dev_cfg,
     enc_dev_config_t** enc_dev_config,
@@ -41,10 +58,12 @@ int initialize_host_device_configuration(
  *
  * @dev_cfg : device configuration
  * @evt_channel_num : total number of event channels
+ * @evt_chn_pending : bitmap of devices with events for the enclave
  */
 void vio_host_initialize_device_cfg(
     host_dev_config_t* dev_cfg,
-    uint8_t evt_channel_num);
+    uint8_t evt_channel_num,
+    uint64_t* evt_chn_pending);
 
 /*
  * Function to wait for an event from guest(enclave)
@@ -54,6 +73,25 @@ void vio_host_initialize_device_cfg(
  */
 void vio_host_process_enclave_event(uint8_t dev_id, int timeout_ms);
 
+/*
+ * Function to ask the guest to notify the device of its next event, for
+ * devices served without a thread of their own. Unlike
+ * vio_host_process_enclave_event, it does not wait for the event. Returns 1
+ * if the device will be notified, or 0 if events have arrived since they
+ * were last processed, in which case they are marked as processed.
+ *
+ * @dev_id : Device identifier
+ */
+int vio_host_arm_enclave_event(uint8_t dev_id);
+
+/*
+ * Function to stop the notifications requested with
+ * vio_host_arm_enclave_event and to mark all events as processed.
+ *
+ * @dev_id : Device identifier
+ */
+void vio_host_disarm_enclave_event(uint8_t dev_id);
+
 /*
  * Function to notify guest when the virtio processing is completed.
  * It will only notify host when the guest task is sleeping.
@@ -69,6 +107,29 @@ void vio_host_notify_host_event(uint8_t dev_id);
  */
 void sgxlkl_host_handle_device_request(uint8_t dev_id);
 
+/*
+ * Function to set the time for which a device thread spins on its event
+ * channel before blocking.
+ *
+ * @dev_id : Device identifier
+ * @spin_us : spin time in microseconds, 0 to block right away
+ */
+void vio_host_set_device_spin(uint8_t dev_id, uint64_t spin_us);
+
+/*
+ * Function to set the callback that handles the wake-ups of a device served
+ * by a shared pool of threads.
+ *
+ * @dev_id : Device identifier
+ * @wakeup : callback called with the device identifier
+ */
+void vio_host_set_device_wakeup(uint8_t dev_id, void (*wakeup)(uint8_t dev_id));
+
+/*
+ * Function to print the wake-up statistics of all devices.
+ */
+void vio_host_print_dev_stats(void);
+
 /*
  * Function to dump the event channel statistics.
  */
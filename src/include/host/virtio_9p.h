@@ -0,0 +1,70 @@
+#ifndef __VIRTIO_9P_H__
+#define __VIRTIO_9P_H__
+
+#include <host/virtio_dev.h>
+#include <host/virtio_types.h>
+#include <shared/virtio_ring_buff.h>
+#include <stdint.h>
+
+/* The device config provides a mount tag */
+#define VIRTIO_9P_MOUNT_TAG 0
+
+#define VIRTIO_9P_TAG_MAX 32
+
+/* 9P2000.L message types, a reply has the type of its request plus one */
+#define P9_RLERROR 7
+#define P9_TSTATFS 8
+#define P9_TLOPEN 12
+#define P9_TLCREATE 14
+#define P9_TSYMLINK 16
+#define P9_TMKNOD 18
+#define P9_TRENAME 20
+#define P9_TREADLINK 22
+#define P9_TGETATTR 24
+#define P9_TSETATTR 26
+#define P9_TXATTRWALK 30
+#define P9_TXATTRCREATE 32
+#define P9_TREADDIR 40
+#define P9_TFSYNC 50
+#define P9_TLOCK 52
+#define P9_TGETLOCK 54
+#define P9_TLINK 70
+#define P9_TMKDIR 72
+#define P9_TRENAMEAT 74
+#define P9_TUNLINKAT 76
+#define P9_TVERSION 100
+#define P9_TATTACH 104
+#define P9_TFLUSH 108
+#define P9_TWALK 110
+#define P9_TREAD 116
+#define P9_TWRITE 118
+#define P9_TCLUNK 120
+#define P9_TREMOVE 122
+
+/* Size of the size, type and tag fields that start each message */
+#define P9_HDR_SIZE 7
+
+/* Maximum number of names in a walk request */
+#define P9_MAXWELEM 16
+
+/* Types of qids */
+#define P9_QTDIR 0x80
+#define P9_QTSYMLINK 0x02
+#define P9_QTFILE 0x00
+
+/* Attributes of a getattr reply */
+#define P9_GETATTR_BASIC 0x000007ffULL
+
+#define P9_LOCK_SUCCESS 0
+#define P9_LOCK_TYPE_UNLCK 2
+
+/* File system type reported by statfs */
+#define P9_MAGIC 0x01021997
+
+struct virtio_9p_config
+{
+    __virtio16 tag_len;
+    uint8_t tag[VIRTIO_9P_TAG_MAX];
+} __attribute__((packed));
+
+#endif //__VIRTIO_9P_H__
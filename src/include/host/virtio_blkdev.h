@@ -16,12 +16,22 @@
 
 #define VIRTIO_REQ_MAX_BUFS (MAX_SKB_FRAGS + 2)
 
+/* Feature bits */
+#define VIRTIO_BLK_F_SIZE_MAX 1      /* max segment size in size_max */
+#define VIRTIO_BLK_F_SEG_MAX 2       /* max number of segments in seg_max */
+#define VIRTIO_BLK_F_FLUSH 9         /* FLUSH is supported */
+#define VIRTIO_BLK_F_MQ 12           /* support more than one vq */
+#define VIRTIO_BLK_F_DISCARD 13      /* DISCARD is supported */
+#define VIRTIO_BLK_F_WRITE_ZEROES 14 /* WRITE ZEROES is supported */
+
 struct virtio_blk_outhdr
 {
 #define LKL_DEV_BLK_TYPE_READ 0
 #define LKL_DEV_BLK_TYPE_WRITE 1
 #define LKL_DEV_BLK_TYPE_FLUSH 4
 #define LKL_DEV_BLK_TYPE_FLUSH_OUT 5
+#define LKL_DEV_BLK_TYPE_DISCARD 11
+#define LKL_DEV_BLK_TYPE_WRITE_ZEROES 13
     /* VIRTIO_BLK_T* */
     uint32_t type;
     /* io priority. */
@@ -30,6 +40,19 @@ struct virtio_blk_outhdr
     uint64_t sector;
 };
 
+/* Data segment of DISCARD and WRITE_ZEROES requests */
+struct virtio_blk_discard_write_zeroes
+{
+    /* First sector of the range */
+    uint64_t sector;
+    /* Number of sectors in the range */
+    uint32_t num_sectors;
+    /* Flags, only VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP is defined */
+    uint32_t flags;
+};
+
+#define VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP 0x1
+
 struct virtio_blk_req_trailer
 {
     uint8_t status;
@@ -70,6 +93,23 @@ struct virtio_blk_config
 
     /* number of vqs, only available when LKL_VIRTIO_BLK_F_MQ is set */
     uint16_t num_queues;
+
+    /* the next 3 entries are guarded by VIRTIO_BLK_F_DISCARD */
+    /* maximum discard sectors for one segment. */
+    uint32_t max_discard_sectors;
+    /* maximum number of discard segments in a discard command. */
+    uint32_t max_discard_seg;
+    /* discard commands must be aligned to this number of sectors. */
+    uint32_t discard_sector_alignment;
+
+    /* the next 3 entries are guarded by VIRTIO_BLK_F_WRITE_ZEROES */
+    /* maximum write zeroes sectors for one segment. */
+    uint32_t max_write_zeroes_sectors;
+    /* maximum number of segments in a write zeroes command. */
+    uint32_t max_write_zeroes_seg;
+    /* set if a write zeroes command may result in deallocation. */
+    uint8_t write_zeroes_may_unmap;
+    uint8_t unused1[3];
 } __attribute__((packed));
 
 #define LKL_DEV_BLK_STATUS_OK 0
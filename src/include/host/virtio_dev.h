@@ -2,6 +2,8 @@
 #define __VIRTIO_DEV_H__
 
 #include <linux/virtio_ids.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <sys/uio.h>
 
 #define BIT(x) (1ULL << x)
@@ -9,13 +11,21 @@
 #define VIRTIO_F_VERSION_1 32
 #define VIRTIO_RING_F_EVENT_IDX 29
 #define VIRTIO_F_IOMMU_PLATFORM 33
+#define VIRTIO_F_RING_PACKED 34
+
+/* Device status bit set by the driver once the device is set up */
+#define VIRTIO_CONFIG_S_DRIVER_OK 4
+
+/* Maximum number of buffers of a request spanning several mergeable receive
+ * buffers, enough for a 64 KB packet in buffers of an Ethernet frame each */
+#define VIRTIO_REQ_MAX_MERGE_BUFS 64
 
 struct virtio_dev;
 
 struct virtio_req
 {
     uint16_t buf_count;
-    struct iovec buf[32];
+    struct iovec buf[VIRTIO_REQ_MAX_MERGE_BUFS];
     uint32_t total_len;
 };
 
@@ -25,9 +35,10 @@ struct virtio_dev_ops
     /**
      * enqueue - queues the request for processing
      *
-     * Note that the current implementation assumes that the requests are
-     * processed synchronous and, as such, @virtio_req_complete must be
-     * called by from this function.
+     * Requests are processed synchronously by default and, as such,
+     * @virtio_req_complete must be called by from this function. A device
+     * can instead call @virtio_req_detach and complete the returned request
+     * at a later time, in any order.
      *
      * @dev - virtio device
      * @q   - queue index
@@ -71,8 +82,32 @@ struct virtio_dev
 };
 
 void virtio_req_complete(struct virtio_req* req, uint32_t len);
+struct virtio_req* virtio_req_detach(struct virtio_req* req);
+int virtio_req_iov(
+    const struct virtio_req* req,
+    size_t skip,
+    size_t len,
+    struct iovec* iov);
+size_t virtio_req_copy(
+    const struct virtio_req* req,
+    size_t skip,
+    void* data,
+    size_t len,
+    bool to_req);
 void virtio_process_queue(struct virtio_dev* dev, uint32_t qidx);
+int virtio_process_queue_batch(
+    struct virtio_dev* dev,
+    uint32_t qidx,
+    int max_reqs);
+int virtio_queue_has_avail(struct virtio_dev* dev, uint32_t qidx);
+void virtio_queue_batch_begin(struct virtio_dev* dev, uint32_t qidx);
+void virtio_queue_batch_end(struct virtio_dev* dev, uint32_t qidx);
 void virtio_set_queue_max_merge_len(struct virtio_dev* dev, int q, int len);
+void virtio_set_queue_coalescing(
+    struct virtio_dev* dev,
+    int q,
+    uint32_t max_reqs,
+    uint32_t max_delay_us);
 
 #define container_of(ptr, type, member) \
     (type*)((char*)(ptr) - __builtin_offsetof(type, member))
@@ -33,6 +33,10 @@
 #define VIRTIO_NET_F_CTRL_VLAN 19      /* Control channel VLAN filtering */
 #define VIRTIO_NET_F_CTRL_RX_EXTRA 20  /* Extra RX mode control support */
 #define VIRTIO_NET_F_GUEST_ANNOUNCE 21 /* Guest can announce device on the */
+#define VIRTIO_NET_F_MQ 22             /* Device supports multiqueue */
+#define VIRTIO_NET_F_GUEST_USO4 54     /* Guest can handle USOv4 in. */
+#define VIRTIO_NET_F_GUEST_USO6 55     /* Guest can handle USOv6 in. */
+#define VIRTIO_NET_F_HOST_USO 56       /* Host can handle USO in. */
 
 struct virtio_net_hdr_v1
 {
@@ -43,6 +47,7 @@ struct virtio_net_hdr_v1
 #define VIRTIO_NET_HDR_GSO_TCPV4 1  /* GSO frame, IPv4 TCP (TSO) */
 #define VIRTIO_NET_HDR_GSO_UDP 3    /* GSO frame, IPv4 UDP (UFO) */
 #define VIRTIO_NET_HDR_GSO_TCPV6 4  /* GSO frame, IPv6 TCP */
+#define VIRTIO_NET_HDR_GSO_UDP_L4 5 /* GSO frame, IPv4 & IPv6 UDP (USO) */
 #define VIRTIO_NET_HDR_GSO_ECN 0x80 /* TCP has ECN set */
     uint8_t gso_type;
     __virtio16 hdr_len;     /* Ethernet + IP + tcp/udp hdrs */
@@ -78,4 +83,21 @@ struct virtio_net_config
     uint8_t duplex;
 } __attribute__((packed));
 
+/*
+ * Control virtqueue command header, followed by command-specific data and a
+ * one-byte ack written by the device
+ */
+struct virtio_net_ctrl_hdr
+{
+    uint8_t class;
+    uint8_t cmd;
+} __attribute__((packed));
+
+#define VIRTIO_NET_OK 0
+#define VIRTIO_NET_ERR 1
+
+/* Set the number of queue pairs used by the driver (if VIRTIO_NET_F_MQ) */
+#define VIRTIO_NET_CTRL_MQ 4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+
 #endif //__VIRTIO_NETDEV_H__
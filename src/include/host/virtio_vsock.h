@@ -0,0 +1,50 @@
+#ifndef __VIRTIO_VSOCK_H__
+#define __VIRTIO_VSOCK_H__
+
+#include <host/virtio_dev.h>
+#include <host/virtio_types.h>
+#include <shared/virtio_ring_buff.h>
+#include <stdint.h>
+
+/* Well-known context IDs of the host and of the enclave */
+#define VSOCK_HOST_CID 2
+#define VSOCK_GUEST_CID 3
+
+#define VIRTIO_VSOCK_TYPE_STREAM 1
+
+/* Packet operations */
+#define VIRTIO_VSOCK_OP_INVALID 0
+#define VIRTIO_VSOCK_OP_REQUEST 1
+#define VIRTIO_VSOCK_OP_RESPONSE 2
+#define VIRTIO_VSOCK_OP_RST 3
+#define VIRTIO_VSOCK_OP_SHUTDOWN 4
+#define VIRTIO_VSOCK_OP_RW 5
+#define VIRTIO_VSOCK_OP_CREDIT_UPDATE 6
+#define VIRTIO_VSOCK_OP_CREDIT_REQUEST 7
+
+/* Flags of VIRTIO_VSOCK_OP_SHUTDOWN packets */
+#define VIRTIO_VSOCK_SHUTDOWN_RCV 1  /* Sender will not receive more data */
+#define VIRTIO_VSOCK_SHUTDOWN_SEND 2 /* Sender will not send more data */
+
+struct virtio_vsock_hdr
+{
+    __virtio64 src_cid;
+    __virtio64 dst_cid;
+    __virtio32 src_port;
+    __virtio32 dst_port;
+    __virtio32 len;
+    __virtio16 type;
+    __virtio16 op;
+    __virtio32 flags;
+    /* Receive buffer space of the sender and number of bytes it has
+     * consumed, which give the credit of the receiver */
+    __virtio32 buf_alloc;
+    __virtio32 fwd_cnt;
+} __attribute__((packed));
+
+struct virtio_vsock_config
+{
+    __virtio64 guest_cid;
+} __attribute__((packed));
+
+#endif //__VIRTIO_VSOCK_H__
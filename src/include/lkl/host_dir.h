@@ -0,0 +1,25 @@
+#ifndef _LKL_HOST_DIR_H
+#define _LKL_HOST_DIR_H
+
+#include "shared/sgxlkl_enclave_config.h"
+
+/* tmpfs directory of the unnamed files that hold verified copies of the
+ * files opened from the host directory */
+#define SGXLKL_HOST_DIR_COPY_DIR "/run/sgxlkl"
+
+/**
+ * Mount the host directory shared through the 9p device read-only at
+ * cfg->destination.
+ *
+ * If cfg->manifest_hash is set, the manifest in the host directory is read
+ * and checked against it, and an openat override is registered that only
+ * allows regular files listed in the manifest to be opened. Each open of
+ * such a file reads it from the host once into an unnamed file in
+ * SGXLKL_HOST_DIR_COPY_DIR, checks the copy against the manifest and
+ * returns a read-only descriptor for the copy, so that the host cannot
+ * change the data once it is verified. The copy takes up enclave memory
+ * until the last descriptor for it is closed.
+ */
+void lkl_mount_host_dir(const sgxlkl_enclave_host_dir_config_t* cfg);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _LKL_SYSCALL_OVERRIDES_MEMINFO_H
+#define _LKL_SYSCALL_OVERRIDES_MEMINFO_H
+
+/* Path at which applications can read the enclave memory statistics */
+#define SGXLKL_MEMINFO_PATH "/proc/sgxlkl/meminfo"
+
+/* tmpfs directory of the unnamed files that back SGXLKL_MEMINFO_PATH */
+#define SGXLKL_MEMINFO_BACKING_DIR "/run/sgxlkl"
+
+/**
+ * Register an openat override that serves SGXLKL_MEMINFO_PATH. procfs
+ * entries cannot be created from outside the kernel, so each open of the
+ * path creates an unnamed file in SGXLKL_MEMINFO_BACKING_DIR with the current
+ * enclave mmap statistics and returns that instead. Concurrent readers thus
+ * each see their own complete snapshot.
+ */
+void syscall_register_meminfo_overrides();
+
+#endif
@@ -23,4 +23,14 @@ extern int lkl_virtio_netdev_add(struct virtio_dev* netdev);
  */
 extern int lkl_virtio_console_add(struct virtio_dev* console);
 
+/*
+ * Function to register the vsock device with mmio drivers and acquire irq
+ */
+extern int lkl_virtio_vsock_add(struct virtio_dev* vsock);
+
+/*
+ * Function to register the 9p device with mmio drivers and acquire irq
+ */
+extern int lkl_virtio_9p_add(struct virtio_dev* p9);
+
 #endif //__LKL_VIRTIO_DEVICE_H__
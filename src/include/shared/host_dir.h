@@ -0,0 +1,27 @@
+#ifndef SGXLKL_HOST_DIR_H
+#define SGXLKL_HOST_DIR_H
+
+/*
+ * The host directory is shared read-only with the enclave through a virtio
+ * 9p device, which is served by a host thread and mounted by the enclave
+ * with the 9p file system.
+ */
+
+/* Mount tag of the 9p device */
+#define SGXLKL_HOST_DIR_TAG "sgxlkl_host_dir"
+
+/*
+ * Maximum 9p message size. A read reply fills one page per descriptor, so
+ * this keeps the descriptor chain of a request within the number of buffers
+ * the host handles per request.
+ */
+#define SGXLKL_HOST_DIR_MSIZE (48 * 1024)
+
+/*
+ * Name of the manifest in the host directory. Each line holds the hex-encoded
+ * SHA-256 hash of a file and its path relative to the host directory, as
+ * written by sha256sum.
+ */
+#define SGXLKL_HOST_DIR_MANIFEST ".sgxlkl-manifest"
+
+#endif /* SGXLKL_HOST_DIR_H */
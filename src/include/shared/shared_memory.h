@@ -10,9 +10,12 @@ typedef struct sgxlkl_shared_memory
     /* Shared memory for virtio implementation */
     void* virtio_net_dev_mem; /* Virtio network device */
     void* virtio_console_mem; /* Virtio console device */
+    void* virtio_vsock_mem;   /* Virtio vsock device */
+    void* virtio_9p_mem;      /* Virtio 9p device of the host directory */
 
     size_t evt_channel_num;           /* Number of event channels */
     enc_dev_config_t* enc_dev_config; /* Device configuration */
+    uint64_t* evt_chn_pending;        /* Bitmap of devices with events */
 
     void* virtio_swiotlb;       /* Memory for setting up bounce buffer */
     size_t virtio_swiotlb_size; /* Bounce buffer size */
@@ -7,6 +7,12 @@
 
 typedef uint64_t evt_t;
 
+/* Number of words of the pending-device bitmap for n event channels. The
+ * host sets the bit of a device when it signals an event while the enclave
+ * device task is waiting, so that the enclave scheduler only needs to look
+ * at the devices whose bit is set. */
+#define VIO_EVT_CHN_PENDING_WORDS(n) (((n) + 63) / 64)
+
 typedef struct enc_evt_channel
 {
     evt_t enclave_evt_channel;
@@ -19,6 +25,11 @@ typedef struct enc_dev_config
     uint8_t dev_id;
     enc_evt_channel_t* enc_evt_chn;
     evt_t evt_processed;
+
+    /* Requests notified to the host device, and the number of them that
+     * needed an ocall to wake up the host device thread */
+    uint64_t num_notifications;
+    uint64_t num_ocalls;
 } enc_dev_config_t;
 
 #endif //_VIO_EVENT_CHANNEL_H
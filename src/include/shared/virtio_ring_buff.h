@@ -22,6 +22,38 @@ struct virtq_desc
     uint16_t next;
 };
 
+/* Packed virtqueues: the descriptor is available if its AVAIL flag matches
+ * the driver wrap counter and its USED flag does not, and used if both flags
+ * match the device wrap counter. */
+#define LKL_VRING_PACKED_DESC_F_AVAIL 7
+#define LKL_VRING_PACKED_DESC_F_USED 15
+
+struct virtq_packed_desc
+{
+    /* Buffer address (guest-physical). */
+    uint64_t addr;
+    /* Buffer length, or the length written to it for used descriptors. */
+    uint32_t len;
+    /* Buffer ID, returned in the used descriptor. */
+    uint16_t id;
+    /* The flags as indicated above. */
+    uint16_t flags;
+};
+
+/* Event suppression flags of packed virtqueues */
+#define LKL_VRING_PACKED_EVENT_FLAG_ENABLE 0
+#define LKL_VRING_PACKED_EVENT_FLAG_DISABLE 1
+/* Only notify once the descriptor at off_wrap has been made available/used */
+#define LKL_VRING_PACKED_EVENT_FLAG_DESC 2
+/* Bit of off_wrap holding the wrap counter of the descriptor offset */
+#define LKL_VRING_PACKED_EVENT_F_WRAP_CTR 15
+
+struct virtq_packed_event
+{
+    uint16_t off_wrap;
+    uint16_t flags;
+};
+
 struct virtq_avail
 {
     uint16_t flags;
@@ -56,6 +88,31 @@ struct virtq
     _Atomic(struct virtq_used*) used;
     uint16_t last_avail_idx;
     uint16_t last_used_idx_signaled;
+
+    /* Set while a batch of requests is processed, in which case used entries
+     * are only published, up to batch_used_idx, when the batch is flushed */
+    uint16_t batching;
+    uint16_t batch_used_idx;
+
+    /* Packed virtqueues (VIRTIO_F_RING_PACKED) use desc as the descriptor
+     * ring, avail as the driver and used as the device event suppression
+     * area. last_avail_idx is the next descriptor to process, used_idx the
+     * next descriptor to mark as used. The wrap counters start at 1 and are
+     * set up by the device when it first processes the queue. */
+    uint16_t packed_ready;
+    uint16_t avail_wrap_counter;
+    uint16_t used_idx;
+    uint16_t used_wrap_counter;
+
+    /* Completion coalescing within a batch: the used entries are published
+     * and signalled early once batch_max_reqs requests have completed or the
+     * oldest unpublished completion is batch_max_delay_us old (0: no limit).
+     * batch_pending counts the unpublished completions since batch_start_ns.
+     */
+    uint32_t batch_max_reqs;
+    uint32_t batch_max_delay_us;
+    uint32_t batch_pending;
+    uint64_t batch_start_ns;
 };
 
 #endif
@@ -0,0 +1,409 @@
+#include <lkl.h>
+#include <lkl_host.h>
+#include <mbedtls/sha256.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "enclave/enclave_util.h"
+#include "lkl/host_dir.h"
+#include "shared/env.h"
+#include "shared/host_dir.h"
+
+/* Length of a hex-encoded SHA-256 hash */
+#define HASH_HEX_LEN 64
+
+/* Upper bound for the size of the manifest */
+#define MANIFEST_MAX_SIZE (16 * 1024 * 1024)
+
+/* Size of the buffer used to hash and copy files */
+#define HASH_BUF_SIZE (64 * 1024)
+
+/* Flags of an open of a host directory file that carry over to its copy */
+#define COPY_OPEN_FLAGS (LKL_O_CLOEXEC | LKL_O_NONBLOCK)
+
+struct manifest_entry
+{
+    /* Path relative to the host directory */
+    const char* path;
+    /* Hex-encoded SHA-256 hash of the file contents */
+    const char* hash;
+};
+
+/* Mount point of the host directory, without trailing slashes */
+static char* mnt_point;
+static size_t mnt_point_len;
+
+/* Device of the mounted host directory */
+static dev_t mnt_dev;
+
+/* Manifest contents and its entries, sorted by path */
+static char* manifest;
+static struct manifest_entry* entries;
+static size_t num_entries;
+
+/**
+ * The original LKL handler for the openat system call.
+ */
+static long (*orig_openat)(int dfd, const char* path, int flags, int mode);
+
+/**
+ * The LKL handlers used to check and copy opened files. As in the meminfo
+ * override, these are called directly because doing a system call from
+ * within a system call is not allowed.
+ */
+static long (*fstat_fn)(int fd, struct stat* st);
+static long (*pread_fn)(int fd, void* buf, size_t count, off_t pos);
+static long (*pwrite_fn)(int fd, const void* buf, size_t count, off_t pos);
+static long (*readlinkat_fn)(int dfd, const char* path, char* buf, int size);
+static long (*close_fn)(int fd);
+
+static int entry_cmp(const void* a, const void* b)
+{
+    return strcmp(
+        ((const struct manifest_entry*)a)->path,
+        ((const struct manifest_entry*)b)->path);
+}
+
+static void sha256_hex(
+    mbedtls_sha256_context* ctx,
+    char hex[HASH_HEX_LEN + 1])
+{
+    uint8_t hash[32];
+
+    if (mbedtls_sha256_finish_ret(ctx, hash) != 0)
+        sgxlkl_fail("Failed to hash host directory file\n");
+    bytes_to_hex(hex, HASH_HEX_LEN + 1, hash, sizeof(hash));
+}
+
+/* Read the manifest of the mounted host directory into memory */
+static size_t read_manifest(char* path)
+{
+    size_t size = 0, cap = 0;
+    long fd, ret;
+
+    fd = lkl_sys_open(path, LKL_O_RDONLY, 0);
+    if (fd < 0)
+        sgxlkl_fail(
+            "Failed to open host directory manifest %s: %s\n",
+            path,
+            lkl_strerror(fd));
+
+    do
+    {
+        if (size == cap)
+        {
+            cap = cap ? cap * 2 : HASH_BUF_SIZE;
+            if (cap > MANIFEST_MAX_SIZE)
+                sgxlkl_fail("Host directory manifest %s is too large\n", path);
+            if (!(manifest = realloc(manifest, cap + 1)))
+                sgxlkl_fail("Out of memory\n");
+        }
+
+        ret = lkl_sys_read(fd, manifest + size, cap - size);
+        if (ret < 0)
+            sgxlkl_fail(
+                "Failed to read host directory manifest %s: %s\n",
+                path,
+                lkl_strerror(ret));
+        size += ret;
+    } while (ret > 0);
+
+    lkl_sys_close(fd);
+    manifest[size] = '\0';
+
+    return size;
+}
+
+/*
+ * Parse the manifest, which consists of lines in the format written by
+ * sha256sum, i.e. the hash, a space, a space or '*' and the path.
+ */
+static void parse_manifest(size_t size)
+{
+    size_t cap = 0;
+    char* line = manifest;
+
+    while (line < manifest + size)
+    {
+        char* end = strchr(line, '\n');
+        if (!end)
+            end = manifest + size;
+        *end = '\0';
+
+        if (*line)
+        {
+            char* path = line + HASH_HEX_LEN + 2;
+
+            if (strlen(line) <= HASH_HEX_LEN + 2 || line[HASH_HEX_LEN] != ' ' ||
+                (line[HASH_HEX_LEN + 1] != ' ' &&
+                 line[HASH_HEX_LEN + 1] != '*') ||
+                strspn(line, "0123456789abcdefABCDEF") != HASH_HEX_LEN)
+                sgxlkl_fail("Invalid host directory manifest line: %s\n", line);
+
+            while (strncmp(path, "./", 2) == 0)
+                path += 2;
+
+            if (num_entries == cap)
+            {
+                cap = cap ? cap * 2 : 64;
+                entries = realloc(entries, cap * sizeof(*entries));
+                if (!entries)
+                    sgxlkl_fail("Out of memory\n");
+            }
+
+            line[HASH_HEX_LEN] = '\0';
+            entries[num_entries].path = path;
+            entries[num_entries].hash = line;
+            num_entries++;
+        }
+
+        line = end + 1;
+    }
+
+    qsort(entries, num_entries, sizeof(*entries), entry_cmp);
+}
+
+/*
+ * Copy the contents of the open host file fd into an unnamed file in
+ * SGXLKL_HOST_DIR_COPY_DIR while hashing them. Returns the descriptor of the
+ * copy, opened for writing, or a negative error.
+ */
+static long copy_file(int fd, char hex[HASH_HEX_LEN + 1])
+{
+    mbedtls_sha256_context ctx;
+    off_t pos = 0;
+    long copy_fd, ret;
+
+    char* buf = malloc(HASH_BUF_SIZE);
+    if (!buf)
+        return -LKL_ENOMEM;
+
+    copy_fd = orig_openat(
+        LKL_AT_FDCWD,
+        SGXLKL_HOST_DIR_COPY_DIR,
+        LKL_O_RDWR | LKL_O_TMPFILE | LKL_O_CLOEXEC,
+        0400);
+    if (copy_fd < 0)
+    {
+        free(buf);
+        return copy_fd;
+    }
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+
+    while ((ret = pread_fn(fd, buf, HASH_BUF_SIZE, pos)) > 0)
+    {
+        mbedtls_sha256_update_ret(&ctx, (unsigned char*)buf, ret);
+
+        long len = ret;
+        ret = pwrite_fn(copy_fd, buf, len, pos);
+        if (ret >= 0 && ret != len)
+            ret = -LKL_ENOSPC;
+        if (ret < 0)
+            break;
+        pos += len;
+    }
+
+    if (ret == 0)
+        sha256_hex(&ctx, hex);
+
+    mbedtls_sha256_free(&ctx);
+    free(buf);
+
+    if (ret < 0)
+    {
+        close_fn(copy_fd);
+        return ret;
+    }
+
+    return copy_fd;
+}
+
+/*
+ * Check a file opened from the host directory against the manifest. Only
+ * regular files are checked, directories and symlinks are not covered by
+ * the manifest.
+ *
+ * The host could serve other data whenever the file is read again, e.g.
+ * once its pages have been evicted from the page cache. A regular file is
+ * thus read from the host only once, into an unnamed file in enclave
+ * memory, which is checked and then opened read-only in place of fd.
+ * Returns the descriptor to use for the file (fd itself if it is not
+ * checked) or a negative error.
+ */
+static long verify_fd(int fd, int flags)
+{
+    char fd_path[32], path[PATH_MAX];
+    char hex[HASH_HEX_LEN + 1];
+    struct manifest_entry key, *entry;
+    struct stat st;
+    long ret, copy_fd;
+
+    if (fstat_fn(fd, &st) < 0 || st.st_dev != mnt_dev || !S_ISREG(st.st_mode))
+        return fd;
+
+    snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", fd);
+    ret = readlinkat_fn(LKL_AT_FDCWD, fd_path, path, sizeof(path) - 1);
+    if (ret < 0)
+        return ret;
+    path[ret] = '\0';
+
+    if (strncmp(path, mnt_point, mnt_point_len) != 0 ||
+        path[mnt_point_len] != '/')
+        return -LKL_EACCES;
+
+    key.path = path + mnt_point_len + 1;
+    entry = bsearch(&key, entries, num_entries, sizeof(*entries), entry_cmp);
+    if (!entry)
+    {
+        sgxlkl_warn("%s is not in the host directory manifest\n", path);
+        return -LKL_EACCES;
+    }
+
+    if ((copy_fd = copy_file(fd, hex)) < 0)
+        return copy_fd;
+
+    if (strcasecmp(hex, entry->hash) != 0)
+    {
+        sgxlkl_warn("%s does not match the host directory manifest\n", path);
+        close_fn(copy_fd);
+        return -LKL_EIO;
+    }
+
+    /* Reopen the copy read-only, as the host file was opened */
+    snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%ld", copy_fd);
+    ret = orig_openat(
+        LKL_AT_FDCWD, fd_path, LKL_O_RDONLY | (flags & COPY_OPEN_FLAGS), 0);
+    close_fn(copy_fd);
+
+    return ret;
+}
+
+static long syscall_openat_override(
+    int dfd,
+    const char* path,
+    int flags,
+    int mode)
+{
+    long fd = orig_openat(dfd, path, flags, mode);
+
+    /* O_PATH descriptors cannot be used to read the file */
+    if (fd < 0 || (flags & LKL_O_PATH))
+        return fd;
+
+    long ret = verify_fd(fd, flags);
+    if (ret != fd)
+        close_fn(fd);
+
+    return ret;
+}
+
+static void verify_manifest(const char* manifest_hash, size_t size)
+{
+    mbedtls_sha256_context ctx;
+    char hex[HASH_HEX_LEN + 1];
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    mbedtls_sha256_update_ret(&ctx, (unsigned char*)manifest, size);
+    sha256_hex(&ctx, hex);
+    mbedtls_sha256_free(&ctx);
+
+    if (strcasecmp(hex, manifest_hash) != 0)
+        sgxlkl_fail(
+            "Host directory manifest hash mismatch: expected %s, got %s\n",
+            manifest_hash,
+            hex);
+}
+
+void lkl_mount_host_dir(const sgxlkl_enclave_host_dir_config_t* cfg)
+{
+    char path[PATH_MAX], opts[128];
+    struct stat st;
+    long ret, fd;
+
+    mnt_point = strdup(cfg->destination);
+    if (!mnt_point)
+        sgxlkl_fail("Out of memory\n");
+    mnt_point_len = strlen(mnt_point);
+    while (mnt_point_len > 1 && mnt_point[mnt_point_len - 1] == '/')
+        mnt_point[--mnt_point_len] = '\0';
+
+    SGXLKL_VERBOSE("Mounting host directory at %s\n", mnt_point);
+
+    ret = lkl_sys_mkdir(mnt_point, 0755);
+    if (ret < 0 && ret != -LKL_EEXIST)
+        sgxlkl_fail("Unable to mkdir %s: %s\n", mnt_point, lkl_strerror(ret));
+
+    /*
+     * Without a manifest, file data is kept in the page cache with
+     * cache=loose. Otherwise, verified files are served from a copy in
+     * enclave memory, so that caching the host data as well would only take
+     * up memory.
+     */
+    snprintf(
+        opts,
+        sizeof(opts),
+        "trans=virtio,version=9p2000.L,cache=%s,msize=%d",
+        cfg->manifest_hash ? "none" : "loose",
+        SGXLKL_HOST_DIR_MSIZE);
+    ret = lkl_sys_mount(
+        SGXLKL_HOST_DIR_TAG,
+        mnt_point,
+        "9p",
+        LKL_MS_RDONLY | LKL_MS_NOSUID | LKL_MS_NODEV,
+        opts);
+    if (ret < 0)
+        sgxlkl_fail(
+            "Failed to mount host directory at %s: %s\n",
+            mnt_point,
+            lkl_strerror(ret));
+
+    if (!cfg->manifest_hash)
+    {
+        sgxlkl_warn(
+            "host_dir.manifest_hash is not set, the contents of %s are not "
+            "verified\n",
+            mnt_point);
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", mnt_point, SGXLKL_HOST_DIR_MANIFEST);
+    size_t size = read_manifest(path);
+    verify_manifest(cfg->manifest_hash, size);
+    parse_manifest(size);
+
+    SGXLKL_VERBOSE("Host directory manifest lists %zu files\n", num_entries);
+
+    fstat_fn = (void*)lkl_replace_syscall(__lkl__NR_fstat, NULL);
+    lkl_replace_syscall(__lkl__NR_fstat, (lkl_syscall_handler_t)fstat_fn);
+    pread_fn = (void*)lkl_replace_syscall(__lkl__NR_pread64, NULL);
+    lkl_replace_syscall(__lkl__NR_pread64, (lkl_syscall_handler_t)pread_fn);
+    pwrite_fn = (void*)lkl_replace_syscall(__lkl__NR_pwrite64, NULL);
+    lkl_replace_syscall(__lkl__NR_pwrite64, (lkl_syscall_handler_t)pwrite_fn);
+    readlinkat_fn = (void*)lkl_replace_syscall(__lkl__NR_readlinkat, NULL);
+    lkl_replace_syscall(
+        __lkl__NR_readlinkat, (lkl_syscall_handler_t)readlinkat_fn);
+    close_fn = (void*)lkl_replace_syscall(__lkl__NR_close, NULL);
+    lkl_replace_syscall(__lkl__NR_close, (lkl_syscall_handler_t)close_fn);
+
+    fd = lkl_sys_open(mnt_point, LKL_O_RDONLY | LKL_O_DIRECTORY, 0);
+    if (fd < 0 || fstat_fn(fd, &st) < 0)
+        sgxlkl_fail("Failed to stat host directory %s\n", mnt_point);
+    lkl_sys_close(fd);
+    mnt_dev = st.st_dev;
+
+    ret = lkl_sys_mkdir(SGXLKL_HOST_DIR_COPY_DIR, 0700);
+    if (ret < 0 && ret != -LKL_EEXIST)
+        sgxlkl_fail(
+            "Unable to mkdir %s: %s\n",
+            SGXLKL_HOST_DIR_COPY_DIR,
+            lkl_strerror(ret));
+
+    orig_openat = (void*)lkl_replace_syscall(
+        __lkl__NR_openat, (lkl_syscall_handler_t)syscall_openat_override);
+}
@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #define _GNU_SOURCE // Needed for strchrnul
 #include <lkl.h>
+#include <lkl/linux/ethtool.h>
+#include <lkl/linux/sockios.h>
 #include <lkl_host.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -26,6 +28,7 @@
 
 #define USE_CRYPT_SETUP
 
+#include "enclave/enclave_mem.h"
 #include "enclave/enclave_oe.h"
 #include "enclave/enclave_util.h"
 #include "enclave/sgxlkl_t.h"
@@ -38,6 +41,7 @@
 #include "lkl/ext4_create.h"
 #include "lkl/posix-host.h"
 #include "lkl/setup.h"
+#include "lkl/syscall-overrides-meminfo.h"
 #include "lkl/syscall-overrides.h"
 #include "lkl/virtio_device.h"
 #include "lkl/virtio_net.h"
@@ -96,7 +100,8 @@ extern struct timespec sgxlkl_app_starttime;
 /* Function to setup bounce buffer in LKL */
 extern void initialize_enclave_event_channel(
     enc_dev_config_t* enc_dev_config,
-    size_t evt_channel_num);
+    size_t evt_channel_num,
+    uint64_t* evt_chn_pending);
 
 extern void lkl_virtio_netdev_remove(void);
 
@@ -284,7 +289,7 @@ static int lkl_mount_blockdev(
     {
         if (err == -LKL_ENOENT)
             err = lkl_sys_mkdir("/mnt", 0755);
-        if (err < 0)
+        if (err < 0 && err != -LKL_EEXIST)
             goto fail;
     }
 
@@ -601,15 +606,51 @@ static void lkl_mount_virtual()
     lkl_mount_sysfs();
     lkl_prepare_rootfs("/run", 0700);
     lkl_mount_runfs();
+    lkl_prepare_rootfs(SGXLKL_MEMINFO_BACKING_DIR, 0755);
     lkl_mknods();
 }
 
-static void lkl_mount_disk(
-    disk_config_t* disk,
-    char device,
-    const char* mnt_point,
-    size_t disk_index)
+/* A disk that is activated and then mounted */
+typedef struct lkl_disk_mount
+{
+    disk_config_t cfg;
+    char device;
+    const char* mnt_point;
+    size_t disk_index;
+    /* Device to mount, set once the disk has been activated */
+    char dev_str[sizeof("/dev/mapper/verityX")];
+    /* Time at which the activation started and its duration */
+    struct timespec start;
+    uint64_t activate_ms;
+    struct lthread* thread;
+} lkl_disk_mount_t;
+
+/*
+ * Serializes the creation of new disks, as key generation, LUKS formatting
+ * and ext4 creation use global state.
+ */
+static struct lkl_sem* disk_create_sem;
+
+/* Background thread that mounts the lazy disks */
+static struct lthread* lazy_mount_thread;
+
+static uint64_t elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1000 +
+           (now.tv_nsec - start.tv_nsec) / 1000000;
+}
+
+/*
+ * Set up the device-mapper targets of a disk, creating it first if needed.
+ * Disks are activated concurrently, so this must not modify global state
+ * other than under disk_create_sem.
+ */
+static void lkl_activate_disk(lkl_disk_mount_t* m)
 {
+    disk_config_t* disk = &m->cfg;
+    char device = m->device;
     char dev_str_raw[] = {"/dev/vdX"};
     char dev_str_enc[] = {"/dev/mapper/cryptX"};
     char dev_str_verity[] = {"/dev/mapper/verityX"};
@@ -619,17 +660,14 @@ static void lkl_mount_disk(
     char* dev_str = dev_str_raw;
 
     SGXLKL_VERBOSE(
-        "lkl_mount_disk(dev=\"%s\", mnt=\"%s\", ro=%i)\n",
+        "lkl_activate_disk(dev=\"%s\", mnt=\"%s\", ro=%i)\n",
         dev_str,
-        mnt_point,
+        m->mnt_point,
         disk->readonly);
 
     struct lkl_crypt_device lkl_cd;
     lkl_cd.disk_path = dev_str;
     lkl_cd.readonly = disk->readonly;
-    lkl_cd.disk_config = *disk;
-
-    (void)lkl_cd;
 
     if (disk->create && disk->fresh_key)
     {
@@ -638,25 +676,19 @@ static void lkl_mount_disk(
         disk->key = malloc(disk->key_len);
         if (disk->key == NULL)
             sgxlkl_fail("Could not allocate memory for disk encryption key\n");
+        sgxlkl_host_ops.sem_down(disk_create_sem);
         for (size_t i = 0; i < disk->key_len; i++)
             /* TODO: keys should be set up prior to reaching this function.
              * Also, if we need fresh keys at all, they should be generated
              * properly, e.g. by using the DRNG instructions or mbedTLS for RSA
              * keys. */
             disk->key[i] = rand();
+        sgxlkl_host_ops.sem_up(disk_create_sem);
     }
 
-    int lkl_trace_lkl_syscall_bak = sgxlkl_trace_lkl_syscall;
-    int lkl_trace_internal_syscall_bak = sgxlkl_trace_internal_syscall;
+    lkl_cd.disk_config = *disk;
 
-    if ((sgxlkl_trace_lkl_syscall || sgxlkl_trace_internal_syscall) &&
-        (disk->roothash || is_encrypted_cfg(disk)))
-    {
-        sgxlkl_trace_lkl_syscall = 0;
-        sgxlkl_trace_internal_syscall = 0;
-        SGXLKL_VERBOSE("Disk encryption/integrity enabled: Temporarily "
-                       "disabling tracing to reduce noise.\n");
-    }
+    (void)lkl_cd;
 
     if (disk->roothash != NULL)
     {
@@ -683,7 +715,9 @@ static void lkl_mount_disk(
         {
             SGXLKL_VERBOSE("Creating empty crypto disk\n");
 #ifdef USE_CRYPT_SETUP
+            sgxlkl_host_ops.sem_down(disk_create_sem);
             lkl_create_crypto_disk_thread(&lkl_cd);
+            sgxlkl_host_ops.sem_up(disk_create_sem);
 #endif
         }
 
@@ -696,15 +730,6 @@ static void lkl_mount_disk(
         dev_str = dev_str_enc;
     }
 
-    if ((lkl_trace_lkl_syscall_bak && !sgxlkl_trace_lkl_syscall) ||
-        (lkl_trace_internal_syscall_bak && !sgxlkl_trace_internal_syscall))
-    {
-        SGXLKL_VERBOSE(
-            "Disk encryption/integrity enabled: Re-enabling tracing.\n");
-        sgxlkl_trace_lkl_syscall = lkl_trace_lkl_syscall_bak;
-        sgxlkl_trace_internal_syscall = lkl_trace_internal_syscall_bak;
-    }
-
     if (disk->create)
     {
         size_t fs_size = disk->size;
@@ -728,22 +753,218 @@ static void lkl_mount_disk(
             "make_ext4_dev(block_size=\"%d\", num_blocks=\"%lld\")\n",
             CREATED_DISK_EXT4_BLOCK_SIZE,
             num_blocks);
+        sgxlkl_host_ops.sem_down(disk_create_sem);
         result =
             make_ext4_dev(dev_str, CREATED_DISK_EXT4_BLOCK_SIZE, num_blocks);
+        sgxlkl_host_ops.sem_up(disk_create_sem);
         if (result != 0)
             sgxlkl_fail("make_ext4_dev()=%s\n", result);
     }
 
-    const int err = lkl_mount_blockdev(
-        dev_str, mnt_point, "ext4", disk->readonly ? LKL_MS_RDONLY : 0, NULL);
+    strcpy(m->dev_str, dev_str);
+}
+
+static void* lkl_activate_disk_thread(void* arg)
+{
+    lkl_disk_mount_t* m = arg;
+
+    lkl_activate_disk(m);
+    m->activate_ms = elapsed_ms(m->start);
+
+    return NULL;
+}
+
+/*
+ * Activate a group of disks in parallel, as the key derivation and the
+ * device-mapper setup of each disk take a while, and then mount them in
+ * order, so that a mount point may be nested within an earlier one. Tracing
+ * is left alone for background mounts, as the application is running then.
+ */
+static void lkl_mount_disk_group(
+    lkl_disk_mount_t* disks,
+    size_t num_disks,
+    bool background)
+{
+    bool quiet = false;
+
+    if (!disk_create_sem)
+        disk_create_sem = sgxlkl_host_ops.sem_alloc(1);
+
+    int lkl_trace_lkl_syscall_bak = sgxlkl_trace_lkl_syscall;
+    int lkl_trace_internal_syscall_bak = sgxlkl_trace_internal_syscall;
+
+    for (size_t i = 0; i < num_disks && !background; i++)
+        quiet |= disks[i].cfg.roothash || is_encrypted_cfg(&disks[i].cfg);
+
+    if ((sgxlkl_trace_lkl_syscall || sgxlkl_trace_internal_syscall) && quiet)
+    {
+        sgxlkl_trace_lkl_syscall = 0;
+        sgxlkl_trace_internal_syscall = 0;
+        SGXLKL_VERBOSE("Disk encryption/integrity enabled: Temporarily "
+                       "disabling tracing to reduce noise.\n");
+    }
+
+    for (size_t i = 0; i < num_disks; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &disks[i].start);
+
+        // The last disk is activated by this thread
+        if (i == num_disks - 1)
+            lkl_activate_disk_thread(&disks[i]);
+        else if (
+            lthread_create(
+                &disks[i].thread, NULL, lkl_activate_disk_thread, &disks[i]) !=
+            0)
+            sgxlkl_fail("Could not create disk activation thread\n");
+    }
+
+    for (size_t i = 0; i + 1 < num_disks; i++)
+    {
+        int ret = lthread_join(disks[i].thread, NULL, -1);
+        if (ret)
+            sgxlkl_fail("lthread_join failed: %s\n", lkl_strerror(ret));
+    }
+
+    if ((lkl_trace_lkl_syscall_bak && !sgxlkl_trace_lkl_syscall) ||
+        (lkl_trace_internal_syscall_bak && !sgxlkl_trace_internal_syscall))
+    {
+        SGXLKL_VERBOSE(
+            "Disk encryption/integrity enabled: Re-enabling tracing.\n");
+        sgxlkl_trace_lkl_syscall = lkl_trace_lkl_syscall_bak;
+        sgxlkl_trace_internal_syscall = lkl_trace_internal_syscall_bak;
+    }
+
+    for (size_t i = 0; i < num_disks; i++)
+    {
+        lkl_disk_mount_t* m = &disks[i];
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        const int err = lkl_mount_blockdev(
+            m->dev_str,
+            m->mnt_point,
+            "ext4",
+            m->cfg.readonly ? LKL_MS_RDONLY : 0,
+            NULL);
+        if (err < 0)
+            sgxlkl_fail(
+                "lkl_mount_blockdev()=%s (%d)\n", lkl_strerror(err), err);
+
+        sgxlkl_enclave_state.disk_state[m->disk_index].mounted = true;
+
+        SGXLKL_VERBOSE(
+            "Disk %s mounted at %s: activated in %llu ms, mounted in %llu "
+            "ms\n",
+            m->dev_str,
+            m->mnt_point,
+            (unsigned long long)m->activate_ms,
+            (unsigned long long)elapsed_ms(start));
+    }
+}
+
+static void lkl_mount_disk(
+    disk_config_t* disk,
+    char device,
+    const char* mnt_point,
+    size_t disk_index)
+{
+    lkl_disk_mount_t m = {.cfg = *disk,
+                          .device = device,
+                          .mnt_point = mnt_point,
+                          .disk_index = disk_index};
+
+    lkl_mount_disk_group(&m, 1, false);
+    *disk = m.cfg;
+}
+
+/*
+ * Mount an empty read-only tmpfs at the mount point of a lazy disk, so that
+ * the application cannot write files there that the disk would hide once
+ * it is mounted on top. Mount points nested in another lazy disk cannot be
+ * created yet, but are already covered by its placeholder.
+ */
+static void lkl_mount_lazy_placeholder(size_t disk_index, const char* mnt_point)
+{
+    int err = lkl_sys_mkdir(mnt_point, 0755);
+    if (err == 0 || err == -LKL_EEXIST)
+        err = lkl_sys_mount(
+            "none",
+            (char*)mnt_point,
+            "tmpfs",
+            LKL_MS_RDONLY | LKL_MS_NOSUID | LKL_MS_NODEV | LKL_MS_NOEXEC,
+            "mode=0000");
     if (err < 0)
-        sgxlkl_fail("lkl_mount_blockdev()=%s (%d)\n", lkl_strerror(err), err);
+    {
+        SGXLKL_VERBOSE(
+            "No placeholder for lazy disk at %s: %s\n",
+            mnt_point,
+            lkl_strerror(err));
+        return;
+    }
+
+    sgxlkl_enclave_state.disk_state[disk_index].placeholder = true;
+}
+
+static void* lkl_lazy_mount_thread(void* arg)
+{
+    lkl_disk_mount_t* disks = arg;
+    size_t num_disks = 0;
+
+    lthread_set_funcname(lthread_self(), "sgx-lkl-lazy-mount");
+
+    while (disks[num_disks].mnt_point)
+        num_disks++;
+
+    lkl_mount_disk_group(disks, num_disks, true);
+    SGXLKL_VERBOSE("Mounted %zu lazy disks\n", num_disks);
+
+    free(disks);
+    return NULL;
+}
+
+static disk_config_t mount_disk_config(
+    const sgxlkl_enclave_mount_config_t* mount)
+{
+    disk_config_t cfg = {.create = mount->create,
+                         .destination = mount->destination,
+                         .key_len = mount->key_len,
+                         .key = mount->key,
+                         .key_id = mount->key_id,
+                         .fresh_key = mount->fresh_key,
+                         .readonly = mount->readonly,
+                         .roothash = mount->roothash,
+                         .roothash_offset = mount->roothash_offset,
+                         .size = mount->size,
+                         .overlay = false};
+    return cfg;
+}
+
+/*
+ * Mount the disk that holds the upper layer of the root overlay at
+ * mnt_point. The disk is not mounted at its own mount point and is not
+ * unmounted separately at exit, as it stays in use by the root overlay.
+ */
+static void lkl_mount_overlay_disk(
+    const sgxlkl_enclave_mount_config_t* mounts,
+    size_t overlay_idx,
+    const char* mnt_point)
+{
+    disk_config_t cfg = mount_disk_config(&mounts[overlay_idx]);
+    size_t dsk_idx = overlay_idx + 1;
+
+    if (cfg.readonly || cfg.roothash)
+        sgxlkl_fail(
+            "Overlay disk %s must be writable\n",
+            mounts[overlay_idx].destination);
 
-    sgxlkl_enclave_state.disk_state[disk_index].mounted = true;
+    lkl_mount_disk(&cfg, 'a' + dsk_idx, mnt_point, dsk_idx);
+    sgxlkl_enclave_state.disk_state[dsk_idx].mounted = false;
 }
 
 static void lkl_mount_root_disk(
     const sgxlkl_enclave_root_config_t* root,
+    const sgxlkl_enclave_mount_config_t* mounts,
+    int overlay_idx,
     size_t disk_index)
 {
     int err = 0;
@@ -791,14 +1012,25 @@ static void lkl_mount_root_disk(
 
     if (root->overlay)
     {
-        oe_host_printf("Creating writable in-memory overlay for rootfs\n");
-        SGXLKL_VERBOSE("Creating writable in-memory overlay for rootfs.\n");
         const char mnt_point_overlay[] = "/mnt/oda";
         const char mnt_point_overlay_upper[] = "/mnt/oda-upper";
         const char overlay_upper_dir[] = "/mnt/oda-upper/upper";
         const char overlay_work_dir[] = "/mnt/oda-upper/work";
         lkl_prepare_rootfs(mnt_point_overlay_upper, 0755);
-        lkl_mount_overlay_tmpfs(mnt_point_overlay_upper);
+        if (overlay_idx >= 0)
+        {
+            oe_host_printf(
+                "Creating writable overlay on disk %s for rootfs\n",
+                mounts[overlay_idx].destination);
+            lkl_mount_overlay_disk(
+                mounts, overlay_idx, mnt_point_overlay_upper);
+        }
+        else
+        {
+            oe_host_printf("Creating writable in-memory overlay for rootfs\n");
+            SGXLKL_VERBOSE("Creating writable in-memory overlay for rootfs.\n");
+            lkl_mount_overlay_tmpfs(mnt_point_overlay_upper);
+        }
         lkl_prepare_rootfs(overlay_upper_dir, 0755);
         lkl_prepare_rootfs(overlay_work_dir, 0755);
         lkl_prepare_rootfs(mnt_point_overlay, 0755);
@@ -845,6 +1077,7 @@ static void lkl_mount_root_disk(
     lkl_mount_mntfs();
     lkl_mount_sysfs();
     lkl_mount_runfs();
+    lkl_prepare_rootfs(SGXLKL_MEMINFO_BACKING_DIR, 0755);
     lkl_mount_procfs();
 }
 
@@ -865,7 +1098,50 @@ void lkl_mount_disks(
     if (lkl_add_disks(root, mounts, num_mounts) != 0)
         sgxlkl_fail("Add root disk failed. Aborting...\n");
 
-    lkl_mount_root_disk(root, 0);
+    // The upper layer of the root overlay may live on one of the secondary
+    // disks instead of in enclave memory
+    int overlay_idx = -1;
+    if (root->overlay_disk)
+    {
+        for (size_t i = 0; i < num_mounts && i < 25; i++)
+        {
+            if (strcmp(mounts[i].destination, root->overlay_disk) == 0)
+                overlay_idx = i;
+        }
+        if (overlay_idx < 0)
+            sgxlkl_fail(
+                "Overlay disk %s not found in mounts\n", root->overlay_disk);
+        if (!root->overlay)
+        {
+            sgxlkl_warn(
+                "Overlay disk %s ignored as the root overlay is disabled\n",
+                root->overlay_disk);
+            overlay_idx = -1;
+        }
+    }
+
+    lkl_mount_root_disk(root, mounts, overlay_idx, 0);
+
+    // We assign dev paths from /dev/vda to /dev/vdz, assuming we won't need
+    // support for more than 26 disks.
+    if (num_mounts > 25)
+    {
+        sgxlkl_warn(
+            "Too many disks (maximum is 26). Failed to mount disk %d at "
+            "%s.\n",
+            26,
+            mounts[25].destination);
+        // Adjust number to number of mounted disks.
+        num_mounts = 25;
+    }
+
+    // Lazy disks are mounted by a background thread once the other disks are
+    // mounted. The list is terminated by an entry without mount point.
+    lkl_disk_mount_t* disks = calloc(num_mounts + 1, sizeof(*disks));
+    lkl_disk_mount_t* lazy_disks = calloc(num_mounts + 1, sizeof(*disks));
+    size_t num_disks = 0, num_lazy_disks = 0;
+    if (!disks || !lazy_disks)
+        sgxlkl_fail("Could not allocate memory for disk mount state\n");
 
     for (size_t mnt_idx = 0; mnt_idx < num_mounts; mnt_idx++)
     {
@@ -873,33 +1149,38 @@ void lkl_mount_disks(
 
         SGXLKL_ASSERT(strcmp(mounts[mnt_idx].destination, "/") != 0);
 
-        // We assign dev paths from /dev/vda to /dev/vdz, assuming we won't need
-        // support for more than 26 disks.
-        if ('a' + dsk_idx > 'z')
-        {
-            sgxlkl_warn(
-                "Too many disks (maximum is 26). Failed to mount disk %d at "
-                "%s.\n",
-                dsk_idx,
-                mounts[mnt_idx].destination);
-            // Adjust number to number of mounted disks.
-            num_mounts = 25;
-            return;
-        }
-        disk_config_t cfg = {.create = mounts[mnt_idx].create,
-                             .destination = mounts[mnt_idx].destination,
-                             .key_len = mounts[mnt_idx].key_len,
-                             .key = mounts[mnt_idx].key,
-                             .key_id = mounts[mnt_idx].key_id,
-                             .fresh_key = mounts[mnt_idx].fresh_key,
-                             .readonly = mounts[mnt_idx].readonly,
-                             .roothash = mounts[mnt_idx].roothash,
-                             .roothash_offset = mounts[mnt_idx].roothash_offset,
-                             .size = mounts[mnt_idx].size,
-                             .overlay = false};
-        lkl_mount_disk(&cfg, 'a' + dsk_idx, cfg.destination, dsk_idx);
+        // Already mounted as the upper layer of the root overlay
+        if ((int)mnt_idx == overlay_idx)
+            continue;
+
+        disk_config_t cfg = mount_disk_config(&mounts[mnt_idx]);
+        lkl_disk_mount_t* m = mounts[mnt_idx].lazy
+                                  ? &lazy_disks[num_lazy_disks++]
+                                  : &disks[num_disks++];
+        m->cfg = cfg;
+        m->device = 'a' + dsk_idx;
+        m->mnt_point = cfg.destination;
+        m->disk_index = dsk_idx;
     }
 
+    if (num_disks > 0)
+        lkl_mount_disk_group(disks, num_disks, false);
+    free(disks);
+
+    if (num_lazy_disks > 0)
+    {
+        for (size_t i = 0; i < num_lazy_disks; i++)
+            lkl_mount_lazy_placeholder(
+                lazy_disks[i].disk_index, lazy_disks[i].mnt_point);
+
+        if (lthread_create(
+                &lazy_mount_thread, NULL, lkl_lazy_mount_thread, lazy_disks) !=
+            0)
+            sgxlkl_fail("Could not create lazy mount thread\n");
+    }
+    else
+        free(lazy_disks);
+
     if (cwd)
     {
         SGXLKL_VERBOSE("Set working directory: %s\n", cwd);
@@ -915,6 +1196,48 @@ void lkl_mount_disks(
     }
 }
 
+/*
+ * Make the network interface use all queue pairs offered by a multi-queue
+ * device. The virtio-net driver only enables as many queue pairs as there
+ * are CPUs, which is one for LKL.
+ */
+static void _enable_net_queue_pairs(int ifidx)
+{
+    struct lkl_ifreq ifr;
+    struct lkl_ethtool_channels channels = {.cmd = LKL_ETHTOOL_GCHANNELS};
+    int sock, res;
+
+    sock = lkl_sys_socket(LKL_AF_INET, LKL_SOCK_DGRAM, 0);
+    if (sock < 0)
+        return;
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.lkl_ifr_ifindex = ifidx;
+    res = lkl_sys_ioctl(sock, LKL_SIOCGIFNAME, (long)&ifr);
+    if (res < 0)
+        goto out;
+
+    ifr.lkl_ifr_data = (void*)&channels;
+    res = lkl_sys_ioctl(sock, LKL_SIOCETHTOOL, (long)&ifr);
+    if (res < 0 || channels.max_combined <= channels.combined_count)
+        goto out;
+
+    channels.cmd = LKL_ETHTOOL_SCHANNELS;
+    channels.combined_count = channels.max_combined;
+    res = lkl_sys_ioctl(sock, LKL_SIOCETHTOOL, (long)&ifr);
+    if (res < 0)
+        sgxlkl_warn(
+            "Failed to enable %d network queue pairs: %s\n",
+            channels.max_combined,
+            lkl_strerror(res));
+    else
+        SGXLKL_VERBOSE(
+            "Enabled %d network queue pairs\n", channels.max_combined);
+
+out:
+    lkl_sys_close(sock);
+}
+
 static uint32_t _parse_ip4(const char* str)
 {
     struct in_addr ia_tmp = {0};
@@ -941,6 +1264,7 @@ void lkl_poststart_net(int net_dev_id)
         {
             sgxlkl_fail("lkl_if_up(eth0): %s\n", lkl_strerror(res));
         }
+        _enable_net_queue_pairs(ifidx);
         if (cfg->net_gw4 > 0)
         {
             uint32_t gw4 = _parse_ip4(cfg->net_gw4);
@@ -1214,6 +1538,13 @@ static void* lkl_termination_thread(void* args)
             runtime.tv_nsec);
     }
 
+    if (cfg->print_mem_stats)
+    {
+        char meminfo[1024];
+        enclave_mem_format_stats(meminfo, sizeof(meminfo));
+        sgxlkl_info("Enclave memory statistics:\n%s", meminfo);
+    }
+
     // Switch back to root so we can unmount all filesystems
     SGXLKL_VERBOSE("calling lkl_sys_chdir(/)\n");
     int ret = lkl_sys_chdir("/");
@@ -1229,23 +1560,48 @@ static void* lkl_termination_thread(void* args)
     display_mount_table();
 #endif
 
+    // Wait for lazy disks that are still being mounted
+    if (lazy_mount_thread)
+    {
+        SGXLKL_VERBOSE("Waiting for lazy disks to be mounted\n");
+        lthread_join(lazy_mount_thread, NULL, -1);
+    }
+
     // Unmount mounts
     long res;
     for (int i = cfg->num_mounts - 1; i >= 0; i--)
     {
-        if (!sgxlkl_enclave_state.disk_state[i].mounted)
+        // The root disk has disk index 0
+        sgxlkl_enclave_disk_state_t* state =
+            &sgxlkl_enclave_state.disk_state[i + 1];
+        if (!state->mounted && !state->placeholder)
             continue;
 
         sgxlkl_enclave_mount_config_t* disk_i = &cfg->mounts[i];
-        SGXLKL_VERBOSE(
-            "calling lkl_umount_timeout(\"%s\", 0, %i)\n",
-            disk_i->destination,
-            UMOUNT_DISK_TIMEOUT);
-        res = lkl_umount_timeout(disk_i->destination, 0, UMOUNT_DISK_TIMEOUT);
-        if (res < 0)
+        if (state->mounted)
         {
-            sgxlkl_warn(
-                "Could not unmount disk %d, %s\n", i, lkl_strerror(res));
+            SGXLKL_VERBOSE(
+                "calling lkl_umount_timeout(\"%s\", 0, %i)\n",
+                disk_i->destination,
+                UMOUNT_DISK_TIMEOUT);
+            res = lkl_umount_timeout(
+                disk_i->destination, 0, UMOUNT_DISK_TIMEOUT);
+            if (res < 0)
+            {
+                sgxlkl_warn(
+                    "Could not unmount disk %d, %s\n", i, lkl_strerror(res));
+            }
+        }
+
+        // Lazy disks are mounted on top of their placeholder
+        if (state->placeholder)
+        {
+            res = lkl_sys_umount(disk_i->destination, 0);
+            if (res < 0)
+                sgxlkl_warn(
+                    "Could not unmount placeholder of disk %d, %s\n",
+                    i,
+                    lkl_strerror(res));
         }
 
         if (!cfg->root.readonly)
@@ -1278,6 +1634,14 @@ static void* lkl_termination_thread(void* args)
     if (res < 0)
         sgxlkl_warn("Could not unmount root disk, %s\n", lkl_strerror(res));
 
+    // The disk with the upper layer of the root overlay is only reachable
+    // through the detached root, so flush its file system explicitly
+    if (cfg->root.overlay && cfg->root.overlay_disk)
+    {
+        SGXLKL_VERBOSE("calling lkl_sys_sync()\n");
+        lkl_sys_sync();
+    }
+
 #ifdef DEBUG
     display_mount_table();
 #endif
@@ -1420,11 +1784,20 @@ void lkl_start_init()
     sgxlkl_mtu = cfg->tap_mtu;
 
     SGXLKL_VERBOSE("calling initialize_enclave_event_channel()\n");
-    initialize_enclave_event_channel(shm->enc_dev_config, shm->evt_channel_num);
+    initialize_enclave_event_channel(
+        shm->enc_dev_config, shm->evt_channel_num, shm->evt_chn_pending);
 
     // Register console device
     lkl_virtio_console_add(shm->virtio_console_mem);
 
+    // Register vsock device if the host provides one
+    if (shm->virtio_vsock_mem)
+        lkl_virtio_vsock_add(shm->virtio_vsock_mem);
+
+    // Register 9p device of the host directory if the host provides one
+    if (shm->virtio_9p_mem)
+        lkl_virtio_9p_add(shm->virtio_9p_mem);
+
     // Register network tap if given one
     int net_dev_id = -1;
     if (shm->virtio_net_dev_mem)
@@ -60,11 +60,14 @@ long syscall_SYS_mmap(
     // Anonymous mapping/allocation
     else if (flags & MAP_ANONYMOUS)
     {
+        enclave_mem_count_mapping(0);
         return (long)enclave_mmap(addr, length, flags & MAP_FIXED, prot, 1);
     }
     // File-backed mapping (if allowed)
     else if ((fd >= 0) && enclave_mmap_files_flags_supported(flags))
     {
+        enclave_mem_count_mapping(1);
+
         void* mem =
             enclave_mmap(addr, length, flags & MAP_FIXED, prot | PROT_WRITE, 0);
 
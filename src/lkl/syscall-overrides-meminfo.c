@@ -0,0 +1,85 @@
+#include <lkl.h>
+#include <lkl_host.h>
+#include <string.h>
+
+#include "enclave/enclave_mem.h"
+#include "enclave/enclave_util.h"
+#include "lkl/syscall-overrides-meminfo.h"
+
+/* Large enough for the output of enclave_mem_format_stats() */
+#define MEMINFO_BUF_LEN 1024
+
+/**
+ * The original LKL handler for the openat system call.
+ */
+static long (*orig_openat)(int dfd, const char* path, int flags, int mode);
+
+/**
+ * The LKL handlers for pwrite64 and close. As in the mmap override, these
+ * are called directly because doing a system call from within a system call
+ * is not allowed.
+ */
+static long (*pwrite_fn)(int fd, const void* buf, size_t count, long pos);
+static long (*close_fn)(int fd);
+
+/*
+ * Create an unnamed file with a fresh snapshot of the statistics and return
+ * a descriptor for it. The snapshot is written at offset 0 without moving
+ * the file offset, so the caller reads it from the start.
+ */
+static long meminfo_open(int flags)
+{
+    char buf[MEMINFO_BUF_LEN];
+    long fd, ret;
+
+    int len = enclave_mem_format_stats(buf, sizeof(buf));
+    if (len < 0)
+        return -LKL_EINVAL;
+    if (len >= (int)sizeof(buf))
+        len = sizeof(buf) - 1;
+
+    fd = orig_openat(
+        LKL_AT_FDCWD,
+        SGXLKL_MEMINFO_BACKING_DIR,
+        LKL_O_RDWR | LKL_O_TMPFILE | (flags & LKL_O_CLOEXEC),
+        0444);
+    if (fd < 0)
+        return fd;
+
+    ret = pwrite_fn(fd, buf, len, 0);
+    if (ret < 0)
+    {
+        close_fn(fd);
+        return ret;
+    }
+
+    return fd;
+}
+
+static long syscall_openat_override(
+    int dfd,
+    const char* path,
+    int flags,
+    int mode)
+{
+    if (path && strcmp(path, SGXLKL_MEMINFO_PATH) == 0)
+    {
+        if ((flags & LKL_O_ACCMODE) != LKL_O_RDONLY)
+            return -LKL_EACCES;
+
+        return meminfo_open(flags);
+    }
+
+    return orig_openat(dfd, path, flags, mode);
+}
+
+void syscall_register_meminfo_overrides()
+{
+    pwrite_fn = (void*)lkl_replace_syscall(__lkl__NR_pwrite64, NULL);
+    lkl_replace_syscall(__lkl__NR_pwrite64, (lkl_syscall_handler_t)pwrite_fn);
+    close_fn = (void*)lkl_replace_syscall(__lkl__NR_close, NULL);
+    lkl_replace_syscall(__lkl__NR_close, (lkl_syscall_handler_t)close_fn);
+
+    orig_openat = (void*)lkl_replace_syscall(
+        __lkl__NR_openat, (lkl_syscall_handler_t)syscall_openat_override);
+}
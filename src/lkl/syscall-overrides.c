@@ -4,6 +4,7 @@
 #include "lkl/posix-host.h"
 #include "lkl/syscall-overrides-fstat.h"
 #include "lkl/syscall-overrides-mem.h"
+#include "lkl/syscall-overrides-meminfo.h"
 #include "lkl/syscall-overrides-sysinfo.h"
 
 /**
@@ -260,4 +261,7 @@ void register_lkl_syscall_overrides()
 #else
     syscall_register_mem_overrides(false);
 #endif
+
+    // Serve the enclave memory statistics at SGXLKL_MEMINFO_PATH
+    syscall_register_meminfo_overrides();
 }
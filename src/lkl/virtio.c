@@ -148,11 +148,12 @@ static inline void virtio_write_driver_features(
 /*
  * blk_check_features: check device and driver features
  * dev: device structure pointer
- * return: if device and driver features are same return 0
+ * return: if the driver features are a subset of the device features, e.g.
+ * the driver does not support some of the offered offloads, return 0
  */
 static int blk_check_features(struct virtio_dev* dev)
 {
-    if (dev->driver_features == dev->device_features)
+    if ((dev->driver_features & ~dev->device_features) == 0)
         return 0;
 
     return -LKL_EINVAL;
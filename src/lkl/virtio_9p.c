@@ -0,0 +1,27 @@
+#include <linux/virtio_mmio.h>
+#include "enclave/enclave_oe.h"
+#include "enclave/enclave_util.h"
+#include "lkl/virtio.h"
+
+/*
+ * Function to generate an interrupt for LKL kernel to reap the virtQ data
+ */
+static void lkl_deliver_irq(uint64_t dev_id)
+{
+    struct virtio_dev* dev =
+        sgxlkl_enclave_state.shared_memory.virtio_9p_mem;
+
+    dev->int_status |= VIRTIO_MMIO_INT_VRING;
+
+    lkl_trigger_irq(dev->irq);
+}
+
+/*
+ * Function to add a new 9p device to LKL
+ */
+int lkl_virtio_9p_add(struct virtio_dev* p9)
+{
+    int mmio_size = VIRTIO_MMIO_CONFIG + p9->config_len;
+
+    return lkl_virtio_dev_setup(p9, mmio_size, &lkl_deliver_irq);
+}
@@ -0,0 +1,27 @@
+#include <linux/virtio_mmio.h>
+#include "enclave/enclave_oe.h"
+#include "enclave/enclave_util.h"
+#include "lkl/virtio.h"
+
+/*
+ * Function to generate an interrupt for LKL kernel to reap the virtQ data
+ */
+static void lkl_deliver_irq(uint64_t dev_id)
+{
+    struct virtio_dev* dev =
+        sgxlkl_enclave_state.shared_memory.virtio_vsock_mem;
+
+    dev->int_status |= VIRTIO_MMIO_INT_VRING;
+
+    lkl_trigger_irq(dev->irq);
+}
+
+/*
+ * Function to add a new vsock device to LKL
+ */
+int lkl_virtio_vsock_add(struct virtio_dev* vsock)
+{
+    int mmio_size = VIRTIO_MMIO_CONFIG + vsock->config_len;
+
+    return lkl_virtio_dev_setup(vsock, mmio_size, &lkl_deliver_irq);
+}
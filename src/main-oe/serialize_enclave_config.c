@@ -155,16 +155,17 @@ static json_obj_t* encode_root(
     const sgxlkl_enclave_root_config_t* root)
 {
     _Static_assert(
-        sizeof(sgxlkl_enclave_root_config_t) == 48,
+        sizeof(sgxlkl_enclave_root_config_t) == 56,
         "sgxlkl_enclave_root_config_t size has changed");
 
-    json_obj_t* r = create_json_objects(key, 6);
+    json_obj_t* r = create_json_objects(key, 7);
     r->objects[0] = encode_hex_string("key", root->key, root->key_len);
     r->objects[1] = create_json_string("key_id", root->key_id);
     r->objects[2] = create_json_string("roothash", root->roothash);
     r->objects[3] = encode_uint64("roothash_offset", root->roothash_offset);
     r->objects[4] = encode_boolean("readonly", root->readonly);
     r->objects[5] = encode_boolean("overlay", root->overlay);
+    r->objects[6] = create_json_string("overlay_disk", root->overlay_disk);
     return r;
 }
 
@@ -177,10 +178,10 @@ static json_obj_t* encode_mounts(
     for (size_t i = 0; i < num_mounts; i++)
     {
         _Static_assert(
-            sizeof(sgxlkl_enclave_mount_config_t) == 320,
+            sizeof(sgxlkl_enclave_mount_config_t) == 328,
             "sgxlkl_enclave_disk_config_t size has changed");
 
-        r->array[i] = create_json_objects(NULL, 9);
+        r->array[i] = create_json_objects(NULL, 10);
         r->array[i]->objects[0] =
             create_json_string("destination", mounts[i].destination);
         r->array[i]->objects[1] =
@@ -197,6 +198,7 @@ static json_obj_t* encode_mounts(
             encode_boolean("readonly", mounts[i].readonly);
         r->array[i]->objects[7] = encode_boolean("create", mounts[i].create);
         r->array[i]->objects[8] = encode_uint64("size", mounts[i].size);
+        r->array[i]->objects[9] = encode_boolean("lazy", mounts[i].lazy);
     }
     return r;
 }
@@ -258,13 +260,29 @@ static json_obj_t* encode_image_sizes(
 static json_obj_t* encode_io(char* key, const sgxlkl_io_config_t* io)
 {
     _Static_assert(
-        sizeof(sgxlkl_io_config_t) == 3,
+        sizeof(sgxlkl_io_config_t) == 4,
         "sgxlkl_image_sizes_config_t size has changed");
 
-    json_obj_t* r = create_json_objects(key, 3);
+    json_obj_t* r = create_json_objects(key, 4);
     r->objects[0] = encode_boolean("console", io->console);
     r->objects[1] = encode_boolean("block", io->block);
     r->objects[2] = encode_boolean("network", io->network);
+    r->objects[3] = encode_boolean("vsock", io->vsock);
+    return r;
+}
+
+static json_obj_t* encode_host_dir(
+    char* key,
+    const sgxlkl_enclave_host_dir_config_t* host_dir)
+{
+    _Static_assert(
+        sizeof(sgxlkl_enclave_host_dir_config_t) == 16,
+        "sgxlkl_enclave_host_dir_config_t size has changed");
+
+    json_obj_t* r = create_json_objects(key, 2);
+    r->objects[0] = create_json_string("destination", host_dir->destination);
+    r->objects[1] =
+        create_json_string("manifest_hash", host_dir->manifest_hash);
     return r;
 }
 
@@ -449,7 +467,7 @@ void serialize_enclave_config(
     // Catch modifications to sgxlkl_enclave_config_t early. If this fails,
     // the code above/below needs adjusting for the added/removed settings.
     _Static_assert(
-        sizeof(sgxlkl_enclave_config_t) == 464,
+        sizeof(sgxlkl_enclave_config_t) == 488,
         "sgxlkl_enclave_config_t size has changed");
 
 #define FPFBOOL(N) root->objects[cnt++] = encode_boolean(#N, config->N)
@@ -489,6 +507,7 @@ void serialize_enclave_config(
     FPFBOOL(fsgsbase);
     FPFBOOL(verbose);
     FPFBOOL(kernel_verbose);
+    FPFBOOL(print_mem_stats);
     FPFS(kernel_cmd);
     FPFS(sysctl);
     FPFBOOL(swiotlb);
@@ -514,6 +533,8 @@ void serialize_enclave_config(
 
     root->objects[cnt++] = encode_io("io", &config->io);
 
+    root->objects[cnt++] = encode_host_dir("host_dir", &config->host_dir);
+
     root->size = cnt;
 
     sort_json(root);
@@ -5,8 +5,28 @@
 #include <stdlib.h>
 #include <sys/mman.h>
 
-#define SWIOTLB_BUFFER_SIZE (64UL << 20)
-#define SWIOTLB_SIZE SWIOTLB_BUFFER_SIZE + (8UL << 20)
+#define SWIOTLB_DEFAULT_BUFFER_SIZE (64UL << 20)
+#define SWIOTLB_MIN_BUFFER_SIZE (4UL << 20)
+#define SWIOTLB_EXTRA_SIZE (8UL << 20)
+/* The kernel allocates bounce buffer slots in segments of 128 2 KiB slots */
+#define SWIOTLB_SEGMENT_SIZE (256UL << 10)
+
+/*
+ * Get the size of the bounce buffer memory for a requested bounce buffer
+ * size, 0 selecting the default size
+ */
+static size_t software_io_tlb_size(size_t buffer_size)
+{
+    if (!buffer_size)
+        buffer_size = SWIOTLB_DEFAULT_BUFFER_SIZE;
+    else if (buffer_size < SWIOTLB_MIN_BUFFER_SIZE)
+        buffer_size = SWIOTLB_MIN_BUFFER_SIZE;
+
+    buffer_size = (buffer_size + SWIOTLB_SEGMENT_SIZE - 1) &
+                  ~(SWIOTLB_SEGMENT_SIZE - 1);
+
+    return buffer_size + SWIOTLB_EXTRA_SIZE;
+}
 
 /*
  * Function to configure software io tlb (bounce buffer) for virtio.
@@ -14,7 +34,7 @@
  * enclave memory directly and hence bounce buffer needs to be setup
  * to exchange the data between host and enclave.
  */
-static inline void* configure_software_io_tlb(uint32_t size)
+static inline void* configure_software_io_tlb(size_t size)
 {
     void* bounce_buffer = NULL;
 
@@ -120,6 +140,8 @@ static void host_dev_cfg_init(
         edev_cfg->dev_id = (uint8_t)index;
         edev_cfg->enc_evt_chn = &enc_evt_channel[index];
         edev_cfg->evt_processed = 0;
+
+        hdev_cfg->enc_dev_cfg = edev_cfg;
     }
     *h_dev_config = host_dev_cfg;
     *e_dev_config = enc_dev_cfg;
@@ -132,6 +154,7 @@ static void host_dev_cfg_init(
  */
 int initialize_host_device_configuration(
     bool swiotlb,
+    size_t swiotlb_size,
     sgxlkl_shared_memory_t* shm,
     host_dev_config_t** host_dev_cfg,
     enc_dev_config_t** enc_dev_config,
@@ -139,10 +162,17 @@ int initialize_host_device_configuration(
 {
     if (swiotlb)
     {
-        shm->virtio_swiotlb = configure_software_io_tlb(SWIOTLB_SIZE);
-        shm->virtio_swiotlb_size = SWIOTLB_SIZE;
+        shm->virtio_swiotlb_size = software_io_tlb_size(swiotlb_size);
+        shm->virtio_swiotlb =
+            configure_software_io_tlb(shm->virtio_swiotlb_size);
     }
 
     host_dev_cfg_init(host_dev_cfg, enc_dev_config, evt_chn_number);
+
+    shm->evt_chn_pending = (uint64_t*)calloc(
+        VIO_EVT_CHN_PENDING_WORDS(evt_chn_number), sizeof(uint64_t));
+    if (!shm->evt_chn_pending)
+        sgxlkl_host_fail("evt channel bitmap allocation failed: %d\n", errno);
+
     return 0;
 }
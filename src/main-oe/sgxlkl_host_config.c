@@ -127,6 +127,34 @@ static char* make_path(json_parser_t* parser)
 #define JBOOL(PATH, DEST) \
     JPATHT(PATH, JSON_TYPE_BOOLEAN, (DEST) = un->boolean;);
 
+static json_result_t decode_uint64_t(
+    json_type_t type,
+    const json_union_t* value,
+    uint64_t* to)
+{
+    char* end = NULL;
+
+    if (type == JSON_TYPE_INTEGER)
+    {
+        if (value->integer < 0)
+            return JSON_OUT_OF_BOUNDS;
+        *to = value->integer;
+    }
+    else if (type == JSON_TYPE_STRING)
+    {
+        errno = 0;
+        *to = strtoull(value->string, &end, 10);
+        if (errno != 0 || end == value->string || *end != '\0')
+            return JSON_UNKNOWN_VALUE;
+    }
+    else
+        return JSON_UNKNOWN_VALUE;
+
+    return JSON_OK;
+}
+
+#define JU64(PATH, DEST) JPATH(PATH, return decode_uint64_t(type, un, &DEST));
+
 #define ALLOC_ARRAY(N, A, T)                              \
     do                                                    \
     {                                                     \
@@ -179,16 +207,52 @@ static json_result_t parse_host_config_entry(
             JBOOL("root.readonly", cfg->root.readonly);
             JSTRING("root.verity", cfg->root.verity);
             JSTRING("root.verity_offset", cfg->root.verity_offset);
+            JU64("root.num_queues", cfg->root.num_queues);
+            JU64("root.queue_depth", cfg->root.queue_depth);
+            JSTRING("root.cow_path", cfg->root.cow_path);
+            JU64("root.spin_us", cfg->root.spin_us);
 
 #define MOUNT() _mount(data->config, parser)
             JSTRING("mounts.image_path", MOUNT()->image_path);
             JSTRING("mounts.destination", MOUNT()->destination);
             JBOOL("mounts.readonly", MOUNT()->readonly);
+            JU64("mounts.num_queues", MOUNT()->num_queues);
+            JU64("mounts.queue_depth", MOUNT()->queue_depth);
+            JSTRING("mounts.cow_path", MOUNT()->cow_path);
+            JU64("mounts.size", MOUNT()->size);
+            JU64("mounts.spin_us", MOUNT()->spin_us);
 
             JBOOL("verbose", cfg->verbose);
             JSTRING("ethreads_affinity", cfg->ethreads_affinity);
             JSTRING("tap_device", cfg->tap_device);
+            JSTRING("packet_device", cfg->packet_device);
             JBOOL("tap_offload", cfg->tap_offload);
+            JU64("tap_num_queues", cfg->tap_num_queues);
+            JU64("net_batch_size", cfg->net_batch_size);
+            JU64("net_busy_poll_us", cfg->net_busy_poll_us);
+            JBOOL("io_uring", cfg->io_uring);
+            JBOOL("disk_mmap_io", cfg->disk_mmap_io);
+            JU64("readahead_window", cfg->readahead_window);
+            JBOOL("packed_virtqueues", cfg->packed_virtqueues);
+            JU64("device_spin_us", cfg->device_spin_us);
+            JU64("net_spin_us", cfg->net_spin_us);
+            JU64("console_spin_us", cfg->console_spin_us);
+            JU64("vsock_spin_us", cfg->vsock_spin_us);
+            JU64("host_dir_spin_us", cfg->host_dir_spin_us);
+            JU64("swiotlb_size", cfg->swiotlb_size);
+            JU64("console_buffer_size", cfg->console_buffer_size);
+            JU64("console_flush_delay_ms", cfg->console_flush_delay_ms);
+            JSTRING("vsock_uds_path", cfg->vsock_uds_path);
+            JSTRING("host_dir", cfg->host_dir);
+            JSTRING("device_threads_affinity", cfg->device_threads_affinity);
+            JSTRING("device_threads_sched", cfg->device_threads_sched);
+            JSTRING("timer_thread_affinity", cfg->timer_thread_affinity);
+            JSTRING("timer_thread_sched", cfg->timer_thread_sched);
+            JU64("disk_io_threads", cfg->disk_io_threads);
+            JU64("virtio_completion_batch", cfg->virtio_completion_batch);
+            JU64(
+                "virtio_completion_delay_us",
+                cfg->virtio_completion_delay_us);
 
             sgxlkl_host_warn("Unknown json path: %s.\n", make_path(parser));
             break;
@@ -28,6 +28,9 @@
 #include <arpa/inet.h>
 #include <netinet/ip.h>
 
+#include "host/host_cow.h"
+#include "host/host_packet_ring.h"
+#include "host/host_threads.h"
 #include "host/host_state.h"
 #include "host/serialize_enclave_config.h"
 #include "host/sgxlkl_host_config.h"
@@ -941,10 +944,14 @@ void override_enclave_wg_config()
 static void register_hd(
     sgxlkl_host_disk_state_t* disk,
     const char* image_path,
+    const char* cow_path,
     const char* destination,
     bool readonly,
+    size_t create_size,
     size_t idx)
 {
+    bool cow = cow_path && strlen(cow_path) != 0;
+
     sgxlkl_host_verbose(
         "Registering disk %lu (path='%s', mnt='%s', [%s])\n",
         idx,
@@ -952,6 +959,13 @@ static void register_hd(
         destination,
         readonly ? "RO" : "RW");
 
+    if (cow && readonly)
+    {
+        sgxlkl_host_warn(
+            "Copy-on-write delta file for read-only disk %lu ignored\n", idx);
+        cow = false;
+    }
+
     if (strlen(destination) > SGXLKL_DISK_MNT_MAX_PATH_LEN)
         sgxlkl_host_fail(
             "Mount path for disk %lu too long (maximum length is %d): \"%s\"\n",
@@ -959,17 +973,45 @@ static void register_hd(
             SGXLKL_DISK_MNT_MAX_PATH_LEN,
             destination);
 
-    int fd = open(image_path, readonly ? O_RDONLY : O_RDWR);
+    if (create_size && (readonly || cow))
+    {
+        sgxlkl_host_warn(
+            "Image size for read-only or copy-on-write disk %lu ignored\n",
+            idx);
+        create_size = 0;
+    }
+
+    // With copy-on-write, the image itself is only read
+    int fd = open(
+        image_path,
+        readonly || cow ? O_RDONLY : O_RDWR | (create_size ? O_CREAT : 0),
+        0600);
     if (fd == -1)
         sgxlkl_host_fail(
             "Unable to open disk file %s for %s access: %s\n",
             image_path,
-            readonly ? "read" : "read/write",
+            readonly || cow ? "read" : "read/write",
             strerror(errno));
 
     struct stat disk_stat;
     fstat(fd, &disk_stat);
 
+    // A new image is created as a sparse file, so that it only takes up
+    // as much space on the host as the enclave has written to it
+    if (create_size && (disk_stat.st_mode & S_IFMT) == S_IFREG &&
+        disk_stat.st_size == 0)
+    {
+        if (ftruncate(fd, create_size) < 0)
+            sgxlkl_host_fail(
+                "Unable to create disk file %s of %lu bytes: %s\n",
+                image_path,
+                create_size,
+                strerror(errno));
+        disk_stat.st_size = create_size;
+        sgxlkl_host_verbose(
+            "Created disk file %s of %lu bytes\n", image_path, create_size);
+    }
+
     off_t size = disk_stat.st_size;
     if ((disk_stat.st_mode & S_IFMT) == S_IFBLK)
     {
@@ -982,11 +1024,47 @@ static void register_hd(
         }
     }
 
-    char* disk_mmap = mmap(
-        NULL, size, PROT_READ | (readonly ? 0 : PROT_WRITE), MAP_SHARED, fd, 0);
-    if (disk_mmap == MAP_FAILED)
-        sgxlkl_host_fail(
-            "Could not map memory for disk image: %s\n", strerror(errno));
+    // Copy-on-write disks are not memory-mapped, their writes must go
+    // through the delta file
+    char* disk_mmap = NULL;
+    if (cow)
+    {
+        int cow_fd = open(cow_path, O_RDWR | O_CREAT, 0600);
+        if (cow_fd == -1)
+            sgxlkl_host_fail(
+                "Unable to open copy-on-write delta file %s: %s\n",
+                cow_path,
+                strerror(errno));
+
+        int ret = host_cow_open(&disk->cow, fd, size, cow_fd);
+        if (ret == -EINVAL)
+            sgxlkl_host_fail(
+                "Copy-on-write delta file %s does not belong to disk image "
+                "%s\n",
+                cow_path,
+                image_path);
+        else if (ret < 0)
+            sgxlkl_host_fail(
+                "Failed to set up copy-on-write delta file %s: %s\n",
+                cow_path,
+                strerror(-ret));
+
+        sgxlkl_host_verbose(
+            "Disk %lu: copy-on-write delta file %s\n", idx, cow_path);
+    }
+    else
+    {
+        disk_mmap = mmap(
+            NULL,
+            size,
+            PROT_READ | (readonly ? 0 : PROT_WRITE),
+            MAP_SHARED,
+            fd,
+            0);
+        if (disk_mmap == MAP_FAILED)
+            sgxlkl_host_fail(
+                "Could not map memory for disk image: %s\n", strerror(errno));
+    }
 
     int flags = fcntl(fd, F_GETFL);
     if (flags == -1)
@@ -1029,8 +1107,10 @@ static void register_hds(char* root_hd)
             register_hd(
                 disk,
                 disk->root_config->image_path,
+                disk->root_config->cow_path,
                 dest,
                 disk->root_config->readonly,
+                0,
                 i);
         }
         else
@@ -1039,31 +1119,80 @@ static void register_hds(char* root_hd)
             register_hd(
                 disk,
                 disk->mount_config->image_path,
+                disk->mount_config->cow_path,
                 disk->mount_config->destination,
                 disk->mount_config->readonly,
+                disk->mount_config->size,
                 i);
             strcpy(shm->virtio_blk_dev_names[i], dest);
         }
     }
 }
 
+/*
+ * Set the polling time of the host threads of device dev_id to spin_us, or
+ * to device_spin_us if spin_us is 0
+ */
+static void set_device_spin(int dev_id, uint64_t spin_us)
+{
+    vio_host_set_device_spin(
+        dev_id, spin_us ? spin_us : sgxlkl_host_state.config.device_spin_us);
+}
+
 static void register_net()
 {
     if (sgxlkl_host_state.net_fd != 0)
         sgxlkl_host_fail("Multiple network interfaces not supported yet\n");
 
-    // Open tap device FD
     const char* tapstr = sgxlkl_host_state.config.tap_device;
-    if (tapstr == NULL || strlen(tapstr) == 0)
+    const char* packetstr = sgxlkl_host_state.config.packet_device;
+    bool has_tap = tapstr != NULL && strlen(tapstr) != 0;
+
+    // Attach to the interface with an AF_PACKET socket
+    if (packetstr != NULL && strlen(packetstr) != 0)
+    {
+        if (has_tap)
+            sgxlkl_host_fail(
+                "Only one of a tap device and a packet device can be used\n");
+
+        int fd = host_packet_socket_open(packetstr);
+        if (fd < 0)
+            sgxlkl_host_fail(
+                "Network interface %s unavailable, AF_PACKET socket setup "
+                "failed: %s\n",
+                packetstr,
+                strerror(-fd));
+
+        sgxlkl_host_state.net_queue_fds[0] = fd;
+        sgxlkl_host_state.net_fd = fd;
+        sgxlkl_host_state.num_net_queue_pairs = 1;
+        sgxlkl_host_state.net_is_packet_socket = 1;
+        return;
+    }
+
+    // Open tap device FD
+    if (!has_tap)
     {
         sgxlkl_host_verbose(
             "No tap device specified, networking will not be available.\n");
         return;
     }
+    uint64_t num_queue_pairs = sgxlkl_host_state.config.tap_num_queues;
+    if (num_queue_pairs == 0)
+        num_queue_pairs = 1;
+    if (num_queue_pairs > HOST_MAX_NET_QUEUE_PAIRS)
+        sgxlkl_host_fail(
+            "Number of tap queues must be at most %d\n",
+            HOST_MAX_NET_QUEUE_PAIRS);
+
     struct ifreq ifr;
     strncpy(ifr.ifr_name, tapstr, IFNAMSIZ);
     ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
 
+    /* A multi-queue tap device has one fd per queue pair */
+    if (num_queue_pairs > 1)
+        ifr.ifr_flags |= IFF_MULTI_QUEUE;
+
     int vnet_hdr_sz = 0;
     if (sgxlkl_host_state.config.tap_offload)
     {
@@ -1071,39 +1200,61 @@ static void register_net()
         vnet_hdr_sz = sizeof(struct lkl_virtio_net_hdr_v1);
     }
 
-    sgxlkl_host_state.net_fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
-    if (sgxlkl_host_state.net_fd == -1)
-        sgxlkl_host_fail(
-            "TUN network device unavailable, open(\"/dev/net/tun\") failed");
+    /* Offloads are enabled by the net device once the enclave driver has
+     * acknowledged them */
+    int offload_flags = 0;
 
-    if (ioctl(sgxlkl_host_state.net_fd, TUNSETIFF, &ifr) == -1)
-        sgxlkl_host_fail(
-            "Tap device %s unavailable, ioctl(\"/dev/net/tun\"), TUNSETIFF) "
-            "failed: %s\n",
-            tapstr,
-            strerror(errno));
+    for (size_t i = 0; i < num_queue_pairs; i++)
+    {
+        int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+        if (fd == -1)
+            sgxlkl_host_fail(
+                "TUN network device unavailable, open(\"/dev/net/tun\") "
+                "failed");
 
-    if (vnet_hdr_sz &&
-        ioctl(sgxlkl_host_state.net_fd, TUNSETVNETHDRSZ, &vnet_hdr_sz) != 0)
-        sgxlkl_host_fail(
-            "Failed to TUNSETVNETHDRSZ: /dev/net/tun: %s\n", strerror(errno));
+        if (ioctl(fd, TUNSETIFF, &ifr) == -1)
+            sgxlkl_host_fail(
+                "Tap device %s unavailable, ioctl(\"/dev/net/tun\"), "
+                "TUNSETIFF) failed: %s\n",
+                tapstr,
+                strerror(errno));
 
-    int offload_flags = 0;
-    if (sgxlkl_host_state.config.tap_offload)
-        offload_flags = TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_CSUM;
+        if (vnet_hdr_sz && ioctl(fd, TUNSETVNETHDRSZ, &vnet_hdr_sz) != 0)
+            sgxlkl_host_fail(
+                "Failed to TUNSETVNETHDRSZ: /dev/net/tun: %s\n",
+                strerror(errno));
 
-    if (ioctl(sgxlkl_host_state.net_fd, TUNSETOFFLOAD, offload_flags) != 0)
-        sgxlkl_host_fail(
-            "Failed to TUNSETOFFLOAD: /dev/net/tun: %s\n", strerror(errno));
+        if (ioctl(fd, TUNSETOFFLOAD, offload_flags) != 0)
+            sgxlkl_host_fail(
+                "Failed to TUNSETOFFLOAD: /dev/net/tun: %s\n",
+                strerror(errno));
+
+        sgxlkl_host_state.net_queue_fds[i] = fd;
+    }
+
+    sgxlkl_host_state.net_fd = sgxlkl_host_state.net_queue_fds[0];
+    sgxlkl_host_state.num_net_queue_pairs = num_queue_pairs;
 }
 
 static void sgxlkl_cleanup(void)
 {
+    virtio_console_flush();
+    virtio_vsock_cleanup();
+
     // Close disk image fds
     while (sgxlkl_host_state.num_disks)
     {
-        close(sgxlkl_host_state.disks[--sgxlkl_host_state.num_disks].fd);
+        blk_device_print_stats(sgxlkl_host_state.num_disks - 1);
+        sgxlkl_host_disk_state_t* disk =
+            &sgxlkl_host_state.disks[--sgxlkl_host_state.num_disks];
+        if (disk->cow)
+            host_cow_close(disk->cow);
+        close(disk->fd);
     }
+    vio_host_print_dev_stats();
+    blk_reactor_print_stats();
+    virtio_print_bounce_stats();
+    host_threads_print_cpu_time();
     free(sgxlkl_host_state.shared_memory.virtio_blk_dev_mem);
     free(sgxlkl_host_state.shared_memory.virtio_blk_dev_names);
 }
@@ -1490,6 +1641,9 @@ void override_enclave_config(
     if (sgxlkl_config_overridden(SGXLKL_KERNEL_VERBOSE))
         econf->kernel_verbose = sgxlkl_config_bool(SGXLKL_KERNEL_VERBOSE);
 
+    if (sgxlkl_config_overridden(SGXLKL_PRINT_MEM_STATS))
+        econf->print_mem_stats = sgxlkl_config_bool(SGXLKL_PRINT_MEM_STATS);
+
     if (sgxlkl_config_overridden(SGXLKL_CMDLINE))
         econf->kernel_cmd = sgxlkl_config_str(SGXLKL_CMDLINE);
 
@@ -1624,6 +1778,14 @@ void override_host_config(char* root_disk_path)
         cfg->root.verity = sgxlkl_config_str(SGXLKL_HD_VERITY);
     if (sgxlkl_config_overridden(SGXLKL_HD_VERITY_OFFSET))
         cfg->root.verity_offset = sgxlkl_config_str(SGXLKL_HD_VERITY_OFFSET);
+    if (sgxlkl_config_overridden(SGXLKL_HD_NUM_QUEUES))
+        cfg->root.num_queues = sgxlkl_config_uint64(SGXLKL_HD_NUM_QUEUES);
+    if (sgxlkl_config_overridden(SGXLKL_HD_QUEUE_DEPTH))
+        cfg->root.queue_depth = sgxlkl_config_uint64(SGXLKL_HD_QUEUE_DEPTH);
+    if (sgxlkl_config_overridden(SGXLKL_HD_COW))
+        cfg->root.cow_path = sgxlkl_config_str(SGXLKL_HD_COW);
+    if (sgxlkl_config_overridden(SGXLKL_HD_SPIN_US))
+        cfg->root.spin_us = sgxlkl_config_uint64(SGXLKL_HD_SPIN_US);
 
     if (sgxlkl_config_overridden(SGXLKL_HDS))
     {
@@ -1665,8 +1827,65 @@ void override_host_config(char* root_disk_path)
         cfg->ethreads_affinity = sgxlkl_config_str(SGXLKL_ETHREADS_AFFINITY);
     if (sgxlkl_config_overridden(SGXLKL_TAP))
         cfg->tap_device = sgxlkl_config_str(SGXLKL_TAP);
+    if (sgxlkl_config_overridden(SGXLKL_PACKET_DEVICE))
+        cfg->packet_device = sgxlkl_config_str(SGXLKL_PACKET_DEVICE);
     if (sgxlkl_config_overridden(SGXLKL_TAP_OFFLOAD))
         cfg->tap_offload = sgxlkl_config_bool(SGXLKL_TAP_OFFLOAD);
+    if (sgxlkl_config_overridden(SGXLKL_TAP_NUM_QUEUES))
+        cfg->tap_num_queues = sgxlkl_config_uint64(SGXLKL_TAP_NUM_QUEUES);
+    if (sgxlkl_config_overridden(SGXLKL_NET_BATCH_SIZE))
+        cfg->net_batch_size = sgxlkl_config_uint64(SGXLKL_NET_BATCH_SIZE);
+    if (sgxlkl_config_overridden(SGXLKL_NET_BUSY_POLL_US))
+        cfg->net_busy_poll_us = sgxlkl_config_uint64(SGXLKL_NET_BUSY_POLL_US);
+    if (sgxlkl_config_overridden(SGXLKL_IO_URING))
+        cfg->io_uring = sgxlkl_config_bool(SGXLKL_IO_URING);
+    if (sgxlkl_config_overridden(SGXLKL_DISK_MMAP_IO))
+        cfg->disk_mmap_io = sgxlkl_config_bool(SGXLKL_DISK_MMAP_IO);
+    if (sgxlkl_config_overridden(SGXLKL_READAHEAD_WINDOW))
+        cfg->readahead_window = sgxlkl_config_uint64(SGXLKL_READAHEAD_WINDOW);
+    if (sgxlkl_config_overridden(SGXLKL_PACKED_VIRTQUEUES))
+        cfg->packed_virtqueues = sgxlkl_config_bool(SGXLKL_PACKED_VIRTQUEUES);
+    if (sgxlkl_config_overridden(SGXLKL_VIRTIO_COMPLETION_BATCH))
+        cfg->virtio_completion_batch =
+            sgxlkl_config_uint64(SGXLKL_VIRTIO_COMPLETION_BATCH);
+    if (sgxlkl_config_overridden(SGXLKL_VIRTIO_COMPLETION_DELAY_US))
+        cfg->virtio_completion_delay_us =
+            sgxlkl_config_uint64(SGXLKL_VIRTIO_COMPLETION_DELAY_US);
+    if (sgxlkl_config_overridden(SGXLKL_DEVICE_SPIN_US))
+        cfg->device_spin_us = sgxlkl_config_uint64(SGXLKL_DEVICE_SPIN_US);
+    if (sgxlkl_config_overridden(SGXLKL_NET_SPIN_US))
+        cfg->net_spin_us = sgxlkl_config_uint64(SGXLKL_NET_SPIN_US);
+    if (sgxlkl_config_overridden(SGXLKL_CONSOLE_SPIN_US))
+        cfg->console_spin_us = sgxlkl_config_uint64(SGXLKL_CONSOLE_SPIN_US);
+    if (sgxlkl_config_overridden(SGXLKL_VSOCK_SPIN_US))
+        cfg->vsock_spin_us = sgxlkl_config_uint64(SGXLKL_VSOCK_SPIN_US);
+    if (sgxlkl_config_overridden(SGXLKL_HOST_DIR_SPIN_US))
+        cfg->host_dir_spin_us = sgxlkl_config_uint64(SGXLKL_HOST_DIR_SPIN_US);
+    if (sgxlkl_config_overridden(SGXLKL_SWIOTLB_SIZE))
+        cfg->swiotlb_size = sgxlkl_config_uint64(SGXLKL_SWIOTLB_SIZE);
+    if (sgxlkl_config_overridden(SGXLKL_CONSOLE_BUFFER_SIZE))
+        cfg->console_buffer_size =
+            sgxlkl_config_uint64(SGXLKL_CONSOLE_BUFFER_SIZE);
+    if (sgxlkl_config_overridden(SGXLKL_CONSOLE_FLUSH_DELAY_MS))
+        cfg->console_flush_delay_ms =
+            sgxlkl_config_uint64(SGXLKL_CONSOLE_FLUSH_DELAY_MS);
+    if (sgxlkl_config_overridden(SGXLKL_VSOCK_UDS_PATH))
+        cfg->vsock_uds_path = sgxlkl_config_str(SGXLKL_VSOCK_UDS_PATH);
+    if (sgxlkl_config_overridden(SGXLKL_HOST_DIR))
+        cfg->host_dir = sgxlkl_config_str(SGXLKL_HOST_DIR);
+    if (sgxlkl_config_overridden(SGXLKL_DEVICE_THREADS_AFFINITY))
+        cfg->device_threads_affinity =
+            sgxlkl_config_str(SGXLKL_DEVICE_THREADS_AFFINITY);
+    if (sgxlkl_config_overridden(SGXLKL_DEVICE_THREADS_SCHED))
+        cfg->device_threads_sched =
+            sgxlkl_config_str(SGXLKL_DEVICE_THREADS_SCHED);
+    if (sgxlkl_config_overridden(SGXLKL_TIMER_THREAD_AFFINITY))
+        cfg->timer_thread_affinity =
+            sgxlkl_config_str(SGXLKL_TIMER_THREAD_AFFINITY);
+    if (sgxlkl_config_overridden(SGXLKL_TIMER_THREAD_SCHED))
+        cfg->timer_thread_sched = sgxlkl_config_str(SGXLKL_TIMER_THREAD_SCHED);
+    if (sgxlkl_config_overridden(SGXLKL_DISK_IO_THREADS))
+        cfg->disk_io_threads = sgxlkl_config_uint64(SGXLKL_DISK_IO_THREADS);
 }
 
 void host_config_from_file(char* filename)
@@ -1692,6 +1911,8 @@ int main(int argc, char* argv[], char* envp[])
     pthread_t* host_timerdev_task;
     int* ethreads_cores;
     size_t ethreads_cores_len;
+    int* host_thread_cores;
+    size_t host_thread_cores_len;
     pthread_attr_t eattr;
     cpu_set_t set;
     void* return_value;
@@ -1868,6 +2089,28 @@ int main(int argc, char* argv[], char* envp[])
         &ethreads_cores,
         &ethreads_cores_len);
 
+    parse_cpu_affinity_params(
+        sgxlkl_host_state.config.device_threads_affinity,
+        &host_thread_cores,
+        &host_thread_cores_len);
+    host_threads_configure(
+        HOST_THREAD_DEVICE,
+        host_thread_cores,
+        host_thread_cores_len,
+        sgxlkl_host_state.config.device_threads_sched);
+    free(host_thread_cores);
+
+    parse_cpu_affinity_params(
+        sgxlkl_host_state.config.timer_thread_affinity,
+        &host_thread_cores,
+        &host_thread_cores_len);
+    host_threads_configure(
+        HOST_THREAD_TIMER,
+        host_thread_cores,
+        host_thread_cores_len,
+        sgxlkl_host_state.config.timer_thread_sched);
+    free(host_thread_cores);
+
     sgxlkl_threads = calloc(sizeof(*sgxlkl_threads), econf->ethreads);
     if (sgxlkl_threads == 0)
     {
@@ -1908,14 +2151,41 @@ int main(int argc, char* argv[], char* envp[])
     /* Perform host interface initialization */
     sgxlkl_host_interface_initialization();
 
+    /* The vsock device is only set up if the enclave uses it */
+    const char* vsock_path = sgxlkl_host_state.config.vsock_uds_path;
+    bool has_vsock = vsock_path != NULL && strlen(vsock_path) != 0;
+    if (has_vsock && !econf->io.vsock)
+    {
+        sgxlkl_host_warn(
+            "vsock_uds_path ignored, io.vsock is disabled in the enclave "
+            "config\n");
+        has_vsock = false;
+    }
+
+    /* The 9p device is only set up if the enclave mounts the host directory */
+    const char* host_dir = sgxlkl_host_state.config.host_dir;
+    bool has_host_dir = host_dir != NULL && strlen(host_dir) != 0;
+    if (has_host_dir && !econf->host_dir.destination)
+    {
+        sgxlkl_host_warn(
+            "host_dir ignored, host_dir.destination is not set in the enclave "
+            "config\n");
+        has_host_dir = false;
+    }
+    else if (!has_host_dir && econf->host_dir.destination)
+        sgxlkl_host_fail(
+            "host_dir.destination is set in the enclave config, but no "
+            "host_dir is given\n");
+
     /* Total event channel is propotional to the total device count.
-     * Currently number of device supported is block, network and
-     * console device. Each block disk is treated as a seperate block
+     * Currently number of device supported is block, network, console,
+     * vsock and 9p device. Each block disk is treated as a seperate block
      * device and have an event channel associated with it.
      */
     sgxlkl_host_state.shared_memory.evt_channel_num =
         sgxlkl_host_state.num_disks + HOST_NETWORK_DEV_COUNT +
-        HOST_CONSOLE_DEV_COUNT;
+        HOST_CONSOLE_DEV_COUNT + (has_vsock ? HOST_VSOCK_DEV_COUNT : 0) +
+        (has_host_dir ? HOST_9P_DEV_COUNT : 0);
 
     /* Host & guest device configurations */
     host_dev_config_t* host_dev_cfg = NULL;
@@ -1923,6 +2193,7 @@ int main(int argc, char* argv[], char* envp[])
 
     initialize_host_device_configuration(
         econf->swiotlb,
+        sgxlkl_host_state.config.swiotlb_size,
         &sgxlkl_host_state.shared_memory,
         &host_dev_cfg,
         &enc_dev_config,
@@ -1930,19 +2201,48 @@ int main(int argc, char* argv[], char* envp[])
 
     /* Initialize the host dev configuration in host event handler */
     vio_host_initialize_device_cfg(
-        host_dev_cfg, sgxlkl_host_state.shared_memory.evt_channel_num);
+        host_dev_cfg,
+        sgxlkl_host_state.shared_memory.evt_channel_num,
+        sgxlkl_host_state.shared_memory.evt_chn_pending);
+
+    /* Devices poll for device_spin_us unless they have their own setting,
+     * which is applied as each device is set up below */
+    for (int i = 0; i < sgxlkl_host_state.shared_memory.evt_channel_num; i++)
+        vio_host_set_device_spin(i, sgxlkl_host_state.config.device_spin_us);
+
+    if (econf->swiotlb)
+        virtio_bounce_stats_init(
+            sgxlkl_host_state.shared_memory.virtio_swiotlb,
+            sgxlkl_host_state.shared_memory.virtio_swiotlb_size,
+            sgxlkl_host_state.shared_memory.evt_channel_num);
 
     int dev_index = 0;
 
-    /* Launch block device host tasks */
+    /* Launch block device host tasks, or hand the block devices to the
+     * shared disk I/O threads */
     for (; dev_index < sgxlkl_host_state.num_disks; dev_index++)
     {
-        pthread_create(
+        const sgxlkl_host_disk_state_t* disk =
+            &sgxlkl_host_state.disks[dev_index];
+        set_device_spin(
+            dev_index,
+            disk->root_config ? disk->root_config->spin_us
+                              : disk->mount_config->spin_us);
+
+        if (sgxlkl_host_state.config.disk_io_threads)
+        {
+            blk_reactor_add_device(
+                &host_dev_cfg[dev_index],
+                sgxlkl_host_state.config.disk_io_threads);
+            continue;
+        }
+
+        host_thread_create(
             &host_vdisk_task[dev_index],
-            NULL,
+            HOST_THREAD_DEVICE,
+            "HOST_BLKDEVICE",
             blkdevice_thread,
             &host_dev_cfg[dev_index]);
-        pthread_setname_np(host_vdisk_task[dev_index], "HOST_BLKDEVICE");
     }
 
     /* Pass the enclave dev configuration in enclave event handler */
@@ -1958,33 +2258,65 @@ int main(int argc, char* argv[], char* envp[])
         }
         else
         {
-            pthread_create(
+            set_device_spin(dev_index, sgxlkl_host_state.config.net_spin_us);
+            host_thread_create(
                 host_netdev_task,
-                NULL,
+                HOST_THREAD_DEVICE,
+                "HOST_NETDEV",
                 netdev_task,
                 &host_dev_cfg[dev_index++]);
-            pthread_setname_np(*host_netdev_task, "HOST_NETDEV");
         }
     }
 
     /* Initialize the virtio console backend driver configuration */
+    set_device_spin(dev_index, sgxlkl_host_state.config.console_spin_us);
     virtio_console_init(&sgxlkl_host_state, &host_dev_cfg[dev_index++]);
 
     /* Create host console device task */
-    pthread_create(host_console_task, NULL, console_task, NULL);
-    pthread_setname_np(*host_console_task, "HOST_CONSOLE_DEVICE");
+    host_thread_create(
+        host_console_task,
+        HOST_THREAD_DEVICE,
+        "HOST_CONSOLE_DEVICE",
+        console_task,
+        NULL);
+
+    /* Initialize the virtio vsock backend and create its device task */
+    if (has_vsock)
+    {
+        pthread_t host_vsock_task;
+
+        set_device_spin(dev_index, sgxlkl_host_state.config.vsock_spin_us);
+        virtio_vsock_init(&sgxlkl_host_state, &host_dev_cfg[dev_index++]);
+        host_thread_create(
+            &host_vsock_task,
+            HOST_THREAD_DEVICE,
+            "HOST_VSOCK_DEVICE",
+            vsock_task,
+            NULL);
+    }
+
+    /* Initialize the virtio 9p backend and create its device task */
+    if (has_host_dir)
+    {
+        pthread_t host_9p_task;
+
+        set_device_spin(dev_index, sgxlkl_host_state.config.host_dir_spin_us);
+        virtio_9p_init(&sgxlkl_host_state, &host_dev_cfg[dev_index++]);
+        host_thread_create(
+            &host_9p_task, HOST_THREAD_DEVICE, "HOST_9P_DEVICE", p9_task, NULL);
+    }
 
     int ret = timerdev_init(&sgxlkl_host_state.shared_memory);
     if (ret < 0)
         sgxlkl_host_fail("Timer device initialization failed\n");
     else
     {
-        pthread_create(
+        host_thread_create(
             host_timerdev_task,
-            NULL,
+            HOST_THREAD_TIMER,
+            "HOST_TIMER_DEVICE",
             timerdev_task,
             sgxlkl_host_state.shared_memory.timer_dev_mem);
-        pthread_setname_np(*host_timerdev_task, "HOST_TIMER_DEVICE");
     }
 
 #ifdef DEBUG
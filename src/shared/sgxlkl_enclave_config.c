@@ -376,6 +376,7 @@ static json_result_t json_read_callback(
             JBOOL("fsgsbase", cfg->fsgsbase);
             JBOOL("verbose", cfg->verbose);
             JBOOL("kernel_verbose", cfg->kernel_verbose);
+            JBOOL("print_mem_stats", cfg->print_mem_stats);
             JSTRING("kernel_cmd", cfg->kernel_cmd);
             JSTRING("sysctl", cfg->sysctl);
             JBOOL("swiotlb", cfg->swiotlb);
@@ -402,6 +403,7 @@ static json_result_t json_read_callback(
             JSTRING("root.roothash", data->config->root.roothash);
             JU64("root.roothash_offset", data->config->root.roothash_offset);
             JBOOL("root.overlay", data->config->root.overlay);
+            JSTRING("root.overlay_disk", data->config->root.overlay_disk);
 
 #define MOUNT() _mount(data->config, parser)
             JBOOL("mounts.create", MOUNT()->create);
@@ -421,6 +423,7 @@ static json_result_t json_read_callback(
             JSTRING("mounts.roothash", MOUNT()->roothash);
             JU64("mounts.roothash_offset", MOUNT()->roothash_offset);
             JU64("mounts.size", MOUNT()->size);
+            JBOOL("mounts.lazy", MOUNT()->lazy);
 
             sgxlkl_image_sizes_config_t* sizes = &cfg->image_sizes;
             JU64("image_sizes.num_heap_pages", sizes->num_heap_pages);
@@ -430,6 +433,10 @@ static json_result_t json_read_callback(
             JBOOL("io.console", io->console);
             JBOOL("io.block", io->block);
             JBOOL("io.network", io->network);
+            JBOOL("io.vsock", io->vsock);
+
+            JSTRING("host_dir.destination", cfg->host_dir.destination);
+            JSTRING("host_dir.manifest_hash", cfg->host_dir.manifest_hash);
 
             FAIL(
                 "Invalid unknown json element '%s'; refusing to run with this "
@@ -459,6 +466,13 @@ void check_config(const sgxlkl_enclave_config_t* cfg)
     CC(cfg->num_env > INT32_MAX, "size of env out of range");
     CC(cfg->num_host_import_env > INT32_MAX,
        "size of host_import_env out of range");
+
+    const sgxlkl_enclave_host_dir_config_t* host_dir = &cfg->host_dir;
+    CC(host_dir->destination && (host_dir->destination[0] != '/' ||
+                                 host_dir->destination[1] == '\0'),
+       "host_dir.destination must be an absolute path other than /");
+    CC(host_dir->manifest_hash && strlen(host_dir->manifest_hash) != 64,
+       "host_dir.manifest_hash must be a hex-encoded SHA-256 hash");
 }
 
 void check_required_elements(string_list_t* seen)
@@ -481,7 +495,7 @@ void sgxlkl_read_enclave_config(
     // Catch modifications to sgxlkl_enclave_config_t early. If this fails,
     // the code above/below needs adjusting for the added/removed settings.
     _Static_assert(
-        sizeof(sgxlkl_enclave_config_t) == 464,
+        sizeof(sgxlkl_enclave_config_t) == 488,
         "sgxlkl_enclave_config_t size has changed");
 
     if (!from)
@@ -575,6 +589,7 @@ void sgxlkl_free_enclave_config(sgxlkl_enclave_config_t* config)
     NONDEFAULT_FREE(root.key);
     NONDEFAULT_FREE(root.key_id);
     NONDEFAULT_FREE(root.roothash);
+    NONDEFAULT_FREE(root.overlay_disk);
 
     for (size_t i = 0; i < config->num_mounts; i++)
     {
@@ -583,6 +598,9 @@ void sgxlkl_free_enclave_config(sgxlkl_enclave_config_t* config)
         free(config->mounts[i].roothash);
     }
     NONDEFAULT_FREE(mounts);
+
+    NONDEFAULT_FREE(host_dir.destination);
+    NONDEFAULT_FREE(host_dir.manifest_hash);
     free(config);
 }
 
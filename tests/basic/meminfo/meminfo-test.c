@@ -0,0 +1,117 @@
+/*
+ * meminfo-test.c
+ *
+ * This test checks that the enclave memory statistics are exposed at
+ * /proc/sgxlkl/meminfo and that they reflect anonymous mappings made by the
+ * application. Each open must return its own snapshot, which later opens
+ * do not change.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MEMINFO_PATH "/proc/sgxlkl/meminfo"
+#define MAP_SIZE (16 * 1024 * 1024)
+
+static FILE* open_meminfo(void)
+{
+    FILE* f = fopen(MEMINFO_PATH, "r");
+    if (!f)
+    {
+        perror("fopen " MEMINFO_PATH);
+        printf("TEST_FAILED\n");
+        exit(1);
+    }
+
+    return f;
+}
+
+static long read_meminfo_file(FILE* f, const char* key)
+{
+    char line[128];
+    long val = -1;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        size_t len = strlen(key);
+        if (strncmp(line, key, len) == 0 && line[len] == ':')
+        {
+            val = strtol(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+
+    if (val < 0)
+    {
+        printf("TEST_FAILED (%s not found in %s)\n", key, MEMINFO_PATH);
+        exit(1);
+    }
+
+    return val;
+}
+
+static long read_meminfo(const char* key)
+{
+    return read_meminfo_file(open_meminfo(), key);
+}
+
+int main(void)
+{
+    long used_before = read_meminfo("MmapUsed");
+    long anon_before = read_meminfo("MmapAnonymous");
+
+    // Kept open across the mapping below, so it must still show the
+    // statistics from before the mapping
+    FILE* early = open_meminfo();
+
+    void* p = mmap(
+        NULL,
+        MAP_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        printf("TEST_FAILED\n");
+        exit(1);
+    }
+
+    long used_after = read_meminfo("MmapUsed");
+    long anon_after = read_meminfo("MmapAnonymous");
+    long peak = read_meminfo("MmapPeakUsed");
+    long used_early = read_meminfo_file(early, "MmapUsed");
+
+    munmap(p, MAP_SIZE);
+
+    if (used_early >= used_after)
+    {
+        printf(
+            "TEST_FAILED (snapshot opened before mmap shows %ld kB used, "
+            "%ld kB after mmap)\n",
+            used_early,
+            used_after);
+        exit(1);
+    }
+
+    if (used_after - used_before < MAP_SIZE / 1024 ||
+        anon_after <= anon_before || peak < used_after)
+    {
+        printf(
+            "TEST_FAILED (used %ld -> %ld kB, anonymous %ld -> %ld, peak %ld "
+            "kB)\n",
+            used_before,
+            used_after,
+            anon_before,
+            anon_after,
+            peak);
+        exit(1);
+    }
+
+    printf("TEST_PASSED\n");
+    return 0;
+}
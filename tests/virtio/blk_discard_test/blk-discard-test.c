@@ -0,0 +1,159 @@
+/*
+ * blk-discard-test.c
+ *
+ * This test checks DISCARD and WRITE_ZEROES requests. The root disk is
+ * larger than its file system, and the test discards and zeroes parts of the
+ * RAW_SIZE bytes at the end of the disk, which the host fills with random
+ * data. It checks that:
+ *
+ * - Discarded and zeroed ranges read back as zeroes.
+ * - The data next to a zeroed range is left alone.
+ * - Requests beyond the end of the disk fail.
+ *
+ * The host checks afterwards that the ranges were deallocated in the disk
+ * image.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define DISK "/dev/vda"
+#define RAW_SIZE (16 * 1024 * 1024)
+#define CHUNK (1024 * 1024)
+#define BLOCK 4096
+
+static char* buf;
+
+static void fail(const char* msg)
+{
+    perror(msg);
+    printf("TEST_FAILED\n");
+    exit(1);
+}
+
+static void read_at(int fd, uint64_t offset, size_t len)
+{
+    if (pread(fd, buf, len, offset) != (ssize_t)len)
+        fail("pread");
+}
+
+static int is_zero(size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        if (buf[i])
+            return 0;
+    return 1;
+}
+
+/* Check that len bytes at offset read back as zeroes */
+static void check_zero(int fd, uint64_t offset, uint64_t len, const char* what)
+{
+    for (uint64_t pos = 0; pos < len; pos += CHUNK)
+    {
+        size_t n = len - pos < CHUNK ? len - pos : CHUNK;
+
+        read_at(fd, offset + pos, n);
+        if (!is_zero(n))
+        {
+            printf(
+                "TEST_FAILED (%s range at offset %llu is not zero)\n",
+                what,
+                (unsigned long long)(offset + pos));
+            exit(1);
+        }
+    }
+}
+
+/* Random data is all zeroes with negligible probability */
+static void check_data(int fd, uint64_t offset, const char* what)
+{
+    read_at(fd, offset, BLOCK);
+    if (is_zero(BLOCK))
+    {
+        printf(
+            "TEST_FAILED (%s at offset %llu is zero)\n",
+            what,
+            (unsigned long long)offset);
+        exit(1);
+    }
+}
+
+static void range_ioctl(
+    int fd,
+    unsigned long req,
+    uint64_t offset,
+    uint64_t len)
+{
+    uint64_t range[2] = {offset, len};
+
+    if (ioctl(fd, req, range))
+        fail(req == BLKDISCARD ? "BLKDISCARD" : "BLKZEROOUT");
+}
+
+static void check_out_of_range(int fd, unsigned long req, uint64_t size)
+{
+    uint64_t range[2] = {size - BLOCK, 2 * BLOCK};
+
+    errno = 0;
+    if (ioctl(fd, req, range) == 0 || errno != EINVAL)
+    {
+        printf(
+            "TEST_FAILED (%s beyond the end of the disk: %s)\n",
+            req == BLKDISCARD ? "BLKDISCARD" : "BLKZEROOUT",
+            errno ? strerror(errno) : "success");
+        exit(1);
+    }
+}
+
+int main(void)
+{
+    uint64_t size;
+
+    if (posix_memalign((void**)&buf, BLOCK, CHUNK))
+        fail("posix_memalign");
+
+    /* Read with O_DIRECT so that the data comes from the device */
+    int fd = open(DISK, O_RDWR | O_DIRECT);
+    if (fd < 0)
+        fail("open " DISK);
+    if (ioctl(fd, BLKGETSIZE64, &size))
+        fail("BLKGETSIZE64");
+
+    uint64_t raw = size - RAW_SIZE;
+    uint64_t half = raw + RAW_SIZE / 2;
+
+    check_data(fd, raw, "random data");
+
+    /* Discard the first half */
+    range_ioctl(fd, BLKDISCARD, raw, RAW_SIZE / 2);
+    check_zero(fd, raw, RAW_SIZE / 2, "discarded");
+    printf("Discard ok\n");
+
+    /* Zero the second half except for its first block, which must keep its
+     * data, and then that block */
+    range_ioctl(fd, BLKZEROOUT, half + BLOCK, RAW_SIZE / 2 - BLOCK);
+    check_zero(fd, half + BLOCK, RAW_SIZE / 2 - BLOCK, "zeroed");
+    check_data(fd, half, "block before the zeroed range");
+    range_ioctl(fd, BLKZEROOUT, half, BLOCK);
+    check_zero(fd, half, BLOCK, "zeroed");
+    printf("Write zeroes ok\n");
+
+    check_out_of_range(fd, BLKDISCARD, size);
+    check_out_of_range(fd, BLKZEROOUT, size);
+    printf("Out-of-range requests fail\n");
+
+    if (fsync(fd))
+        fail("fsync");
+    close(fd);
+
+    printf("TEST_PASSED\n");
+    return 0;
+}
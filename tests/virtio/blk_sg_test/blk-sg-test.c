@@ -0,0 +1,200 @@
+/*
+ * blk-sg-test.c
+ *
+ * This test checks that block requests made up of several data segments are
+ * read and written correctly. It issues O_DIRECT vectored I/O from
+ * non-contiguous page-sized buffers, so that each request carries one
+ * segment per buffer, and verifies the data after dropping the page cache.
+ * It also checks that fsync of buffered writes, which sends a FLUSH to the
+ * device, succeeds.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define TEST_FILE "/blk-sg-test.dat"
+#define SEG_SIZE 4096
+#define MAX_SEGS 64
+
+static char* segs[MAX_SEGS * 2];
+
+static void fail(const char* msg)
+{
+    perror(msg);
+    printf("TEST_FAILED\n");
+    exit(1);
+}
+
+static void fill(char* buf, size_t len, off_t offset, int round)
+{
+    for (size_t i = 0; i < len; i++)
+        buf[i] = (char)((offset + i) * 31 + round);
+}
+
+static int check(const char* buf, size_t len, off_t offset, int round)
+{
+    for (size_t i = 0; i < len; i++)
+        if (buf[i] != (char)((offset + i) * 31 + round))
+            return -1;
+    return 0;
+}
+
+static void drop_caches(void)
+{
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd < 0)
+        fail("open drop_caches");
+    if (write(fd, "3", 1) != 1)
+        fail("write drop_caches");
+    close(fd);
+}
+
+/*
+ * Write nsegs segments at offset with a single pwritev and read them back,
+ * once with a single preadv into scattered buffers and once with a buffered
+ * read after dropping the page cache
+ */
+static void test_segments(int fd, int nsegs, off_t offset, int round)
+{
+    struct iovec iov[MAX_SEGS];
+    size_t len = (size_t)nsegs * SEG_SIZE;
+
+    /* Use every other buffer so that no two segments are adjacent */
+    for (int i = 0; i < nsegs; i++)
+    {
+        iov[i].iov_base = segs[i * 2];
+        iov[i].iov_len = SEG_SIZE;
+        fill(iov[i].iov_base, SEG_SIZE, offset + i * SEG_SIZE, round);
+    }
+
+    if (pwritev(fd, iov, nsegs, offset) != (ssize_t)len)
+        fail("pwritev");
+    if (fsync(fd))
+        fail("fsync");
+    drop_caches();
+
+    for (int i = 0; i < nsegs; i++)
+        memset(iov[i].iov_base, 0, SEG_SIZE);
+
+    if (preadv(fd, iov, nsegs, offset) != (ssize_t)len)
+        fail("preadv");
+
+    for (int i = 0; i < nsegs; i++)
+    {
+        if (check(iov[i].iov_base, SEG_SIZE, offset + i * SEG_SIZE, round))
+        {
+            printf(
+                "TEST_FAILED (segment %d of %d at offset %ld differs after "
+                "preadv)\n",
+                i,
+                nsegs,
+                (long)offset);
+            exit(1);
+        }
+    }
+
+    drop_caches();
+
+    int bfd = open(TEST_FILE, O_RDONLY);
+    if (bfd < 0)
+        fail("open " TEST_FILE);
+
+    char* buf = malloc(len);
+    if (!buf)
+        fail("malloc");
+    if (pread(bfd, buf, len, offset) != (ssize_t)len)
+        fail("pread");
+    if (check(buf, len, offset, round))
+    {
+        printf(
+            "TEST_FAILED (%d segments at offset %ld differ after buffered "
+            "read)\n",
+            nsegs,
+            (long)offset);
+        exit(1);
+    }
+    free(buf);
+    close(bfd);
+}
+
+/*
+ * Write through the page cache and fsync, so that the guest writes back the
+ * data and the journal and then flushes the disk
+ */
+static void test_flush(void)
+{
+    static char buf[3 * SEG_SIZE + 123];
+
+    int fd = open(TEST_FILE ".flush", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        fail("open " TEST_FILE ".flush");
+
+    for (int round = 0; round < 4; round++)
+    {
+        fill(buf, sizeof(buf), round * sizeof(buf), round);
+        if (pwrite(fd, buf, sizeof(buf), round * sizeof(buf)) !=
+            (ssize_t)sizeof(buf))
+            fail("pwrite");
+        if (fsync(fd))
+            fail("fsync");
+        if (fdatasync(fd))
+            fail("fdatasync");
+    }
+
+    close(fd);
+    drop_caches();
+
+    fd = open(TEST_FILE ".flush", O_RDONLY);
+    if (fd < 0)
+        fail("open " TEST_FILE ".flush");
+    for (int round = 0; round < 4; round++)
+    {
+        if (pread(fd, buf, sizeof(buf), round * sizeof(buf)) !=
+            (ssize_t)sizeof(buf))
+            fail("pread");
+        if (check(buf, sizeof(buf), round * sizeof(buf), round))
+        {
+            printf("TEST_FAILED (flushed data of round %d differs)\n", round);
+            exit(1);
+        }
+    }
+    close(fd);
+    unlink(TEST_FILE ".flush");
+}
+
+int main(void)
+{
+    static const int nsegs[] = {1, 2, 3, 8, 17, 32, 64};
+
+    for (int i = 0; i < MAX_SEGS * 2; i++)
+        if (posix_memalign((void**)&segs[i], SEG_SIZE, SEG_SIZE))
+            fail("posix_memalign");
+
+    int fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd < 0)
+        fail("open " TEST_FILE);
+
+    off_t offset = 0;
+    for (int round = 0; round < 2; round++)
+    {
+        for (size_t i = 0; i < sizeof(nsegs) / sizeof(nsegs[0]); i++)
+        {
+            test_segments(fd, nsegs[i], offset, round);
+            offset += (off_t)nsegs[i] * SEG_SIZE + SEG_SIZE;
+        }
+    }
+
+    close(fd);
+    unlink(TEST_FILE);
+
+    test_flush();
+
+    printf("TEST_PASSED\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * console-log.c
+ *
+ * Console logging microbenchmark. Writes lines to stdout with one write
+ * system call per line, as an application that logs verbosely without stdio
+ * buffering does, and reports the number of lines written per second.
+ *
+ *   console-log <lines> <line length>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <lines> <line length>\n", argv[0]);
+        return 1;
+    }
+
+    long lines = atol(argv[1]);
+    size_t line_len = atol(argv[2]);
+    if (lines <= 0 || line_len < 16)
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    char* line = malloc(line_len);
+    if (!line)
+    {
+        perror("malloc");
+        printf("TEST_FAILED\n");
+        return 1;
+    }
+    memset(line, 'x', line_len);
+    line[line_len - 1] = '\n';
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < lines; i++)
+    {
+        int n = snprintf(line, line_len, "%010ld", i);
+        line[n] = ' ';
+        if (write(STDOUT_FILENO, line, line_len) != (ssize_t)line_len)
+        {
+            perror("write");
+            printf("TEST_FAILED\n");
+            return 1;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    printf(
+        "console-log: %ld lines of %zu bytes in %.3f s, %.0f lines/s\n",
+        lines,
+        line_len,
+        elapsed / 1e9,
+        lines / (elapsed / 1e9));
+    printf("TEST_PASSED\n");
+
+    free(line);
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * cow-test.c
+ *
+ * Tests the copy-on-write disk backend against an in-memory model of the
+ * disk:
+ *
+ * - Unaligned writes copy the rest of their first and last clusters from
+ *   the base image.
+ * - Reads spanning clusters in the base image and in the delta file, split
+ *   over several iovecs, return the written data and the base image data.
+ * - The bitmap is only written by fsync, after the data.
+ * - An existing delta file is reopened with its clusters.
+ * - A delta file is rejected for a base image of a different size, or of the
+ *   same size but with other contents.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <host/host_cow.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define CLUSTER HOST_COW_CLUSTER_SIZE
+
+/* Not a multiple of the cluster size, so that the last cluster is partial */
+#define DISK_SIZE (8 * CLUSTER + 100)
+
+static char model[DISK_SIZE];
+
+static void fail(const char* msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    printf("TEST_FAILED\n");
+    exit(1);
+}
+
+static int tmp_file(const char* name)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/tmp/cow-test-%s-XXXXXX", name);
+    int fd = mkstemp(path);
+    if (fd < 0)
+        fail("mkstemp");
+    unlink(path);
+
+    return fd;
+}
+
+static int make_base(size_t size)
+{
+    int fd = tmp_file("base");
+
+    for (size_t i = 0; i < size; i++)
+        model[i] = (char)(i / CLUSTER + i % 251);
+    if (pwrite(fd, model, size, 0) != (ssize_t)size)
+        fail("pwrite base");
+
+    return fd;
+}
+
+static void check_rejected(int base_fd, size_t size, int fd, const char* what)
+{
+    struct host_cow* cow;
+    int cow_fd = dup(fd);
+    int ret = host_cow_open(&cow, base_fd, size, cow_fd);
+
+    close(cow_fd);
+    if (ret != -EINVAL)
+    {
+        printf("delta file of %s: got %d, expected %d\n", what, ret, -EINVAL);
+        printf("TEST_FAILED\n");
+        exit(1);
+    }
+}
+
+static struct host_cow* open_cow(int base_fd, size_t size, int fd)
+{
+    struct host_cow* cow;
+    int ret = host_cow_open(&cow, base_fd, size, dup(fd));
+
+    if (ret < 0)
+    {
+        errno = -ret;
+        fail("host_cow_open");
+    }
+
+    return cow;
+}
+
+static void write_at(struct host_cow* cow, size_t offset, size_t len, char c)
+{
+    char* buf = malloc(len);
+    struct iovec iov = {buf, len};
+
+    memset(buf, c, len);
+    if (host_cow_pwritev(cow, &iov, 1, offset) != (ssize_t)len)
+        fail("host_cow_pwritev");
+    memset(model + offset, c, len);
+    free(buf);
+}
+
+/* Read the whole disk in pieces of odd sizes and compare with the model */
+static void check_disk(struct host_cow* cow, const char* when)
+{
+    static const size_t piece_len[] = {1, 999, CLUSTER, 3 * CLUSTER + 7, 12};
+    char* buf = malloc(DISK_SIZE);
+    struct iovec iov[16];
+    size_t pos = 0;
+    int n = 0;
+
+    while (pos < DISK_SIZE)
+    {
+        size_t len = piece_len[n % 5];
+        if (len > DISK_SIZE - pos)
+            len = DISK_SIZE - pos;
+        iov[n].iov_base = buf + pos;
+        iov[n].iov_len = len;
+        pos += len;
+        n++;
+    }
+
+    if (host_cow_preadv(cow, iov, n, 0) != DISK_SIZE)
+        fail("host_cow_preadv");
+
+    for (size_t i = 0; i < DISK_SIZE; i++)
+    {
+        if (buf[i] != model[i])
+        {
+            printf(
+                "%s: byte %zu is 0x%02x, expected 0x%02x\n",
+                when,
+                i,
+                (unsigned char)buf[i],
+                (unsigned char)model[i]);
+            printf("TEST_FAILED\n");
+            exit(1);
+        }
+    }
+
+    free(buf);
+}
+
+static void check_stats(
+    struct host_cow* cow,
+    uint64_t allocated,
+    uint64_t copied,
+    const char* when)
+{
+    uint64_t num_allocated, num_copied;
+
+    host_cow_get_stats(cow, &num_allocated, &num_copied);
+    if (num_allocated != allocated || num_copied != copied)
+    {
+        printf(
+            "%s: %lu clusters allocated, %lu copied, expected %lu and %lu\n",
+            when,
+            (unsigned long)num_allocated,
+            (unsigned long)num_copied,
+            (unsigned long)allocated,
+            (unsigned long)copied);
+        printf("TEST_FAILED\n");
+        exit(1);
+    }
+}
+
+int main(void)
+{
+    int base_fd = make_base(DISK_SIZE);
+    int fd = tmp_file("delta");
+    struct host_cow* cow = open_cow(base_fd, DISK_SIZE, fd);
+
+    check_disk(cow, "new delta");
+
+    /* Within cluster 1: copies it up */
+    write_at(cow, CLUSTER + 100, 200, 'a');
+    check_stats(cow, 1, 1, "write within a cluster");
+
+    /* Whole cluster 3: no copy-up */
+    write_at(cow, 3 * CLUSTER, CLUSTER, 'b');
+    check_stats(cow, 2, 1, "aligned write");
+
+    /* End of cluster 4 to the start of cluster 6: copies up 4 and 6 */
+    write_at(cow, 5 * CLUSTER - 10, CLUSTER + 20, 'c');
+    check_stats(cow, 5, 3, "unaligned write over three clusters");
+
+    /* Partial last cluster, up to the end of the disk */
+    write_at(cow, 8 * CLUSTER + 50, 50, 'd');
+    check_stats(cow, 6, 4, "write to the last cluster");
+
+    /* Rewrite of a cluster in the delta file */
+    write_at(cow, CLUSTER + 50, 10, 'e');
+    check_stats(cow, 6, 4, "rewrite");
+
+    check_disk(cow, "after writes");
+
+    /* Before fsync, the delta file does not mark any cluster as written */
+    struct host_cow* unsynced = open_cow(base_fd, DISK_SIZE, fd);
+    check_stats(unsynced, 0, 0, "delta before fsync");
+    host_cow_close(unsynced);
+
+    if (host_cow_fsync(cow) < 0)
+        fail("host_cow_fsync");
+    host_cow_close(cow);
+
+    /* Reopening the delta file finds the written clusters */
+    cow = open_cow(base_fd, DISK_SIZE, fd);
+    check_stats(cow, 6, 0, "reopened delta");
+    check_disk(cow, "reopened delta");
+
+    write_at(cow, 7 * CLUSTER + 1, 1, 'f');
+    check_stats(cow, 7, 1, "write after reopening");
+    host_cow_close(cow);
+
+    /* The bitmap is written on close */
+    cow = open_cow(base_fd, DISK_SIZE, fd);
+    check_stats(cow, 7, 0, "delta reopened after close");
+    check_disk(cow, "delta reopened after close");
+    host_cow_close(cow);
+
+    /* A delta file of another base image is rejected */
+    check_rejected(base_fd, DISK_SIZE - CLUSTER, fd, "a smaller base image");
+
+    /* A rebuilt base image of the same size differs in its first cluster */
+    int other_fd = tmp_file("other");
+    char* other = malloc(DISK_SIZE);
+    if (pread(base_fd, other, DISK_SIZE, 0) != DISK_SIZE)
+        fail("pread base");
+    other[1024] ^= 1;
+    if (pwrite(other_fd, other, DISK_SIZE, 0) != DISK_SIZE)
+        fail("pwrite other base");
+    check_rejected(other_fd, DISK_SIZE, fd, "a rebuilt base image");
+    free(other);
+    close(other_fd);
+
+    /* The delta file still belongs to the original base image */
+    cow = open_cow(base_fd, DISK_SIZE, fd);
+    check_stats(cow, 7, 0, "delta reopened after rejections");
+    host_cow_close(cow);
+
+    close(fd);
+    close(base_fd);
+
+    printf("TEST_PASSED\n");
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * host-dir-test.c
+ *
+ * Tests the read-only host directory shared at /host and the checks against
+ * its manifest:
+ *
+ * - A file listed in the manifest can be read, also after dropping the page
+ *   cache and through a memory mapping, and cannot be written.
+ * - A file that is not listed cannot be opened (EACCES).
+ * - A file that was changed after the manifest was written cannot be opened
+ *   (EIO).
+ * - Writes fail (EROFS).
+ * - ".." at the root of the share does not lead to the host directory that
+ *   contains it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HOST_DIR "/host"
+
+static int failed;
+
+static void check(int cond, const char* what)
+{
+    if (!cond)
+    {
+        printf("%s: failed (errno %d, %s)\n", what, errno, strerror(errno));
+        failed = 1;
+    }
+}
+
+static void check_open_error(const char* path, int flags, int err)
+{
+    errno = 0;
+    int fd = open(path, flags, 0644);
+    if (fd >= 0)
+        close(fd);
+
+    if (fd >= 0 || errno != err)
+    {
+        printf(
+            "open(%s): expected %s, got %s\n",
+            path,
+            strerror(err),
+            fd >= 0 ? "success" : strerror(errno));
+        failed = 1;
+    }
+}
+
+static void check_contents(int fd, const char* what)
+{
+    char buf[64];
+
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    check(n >= 0, what);
+    if (n >= 0)
+    {
+        buf[n] = '\0';
+        check(strcmp(buf, "listed\n") == 0, what);
+    }
+}
+
+static void drop_caches(void)
+{
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    check(fd >= 0, "open drop_caches");
+    if (fd < 0)
+        return;
+    check(write(fd, "3", 1) == 1, "write drop_caches");
+    close(fd);
+}
+
+static void test_listed(void)
+{
+    int fd = open(HOST_DIR "/listed.txt", O_RDONLY);
+    check(fd >= 0, "open listed file");
+    if (fd < 0)
+        return;
+
+    check_contents(fd, "read listed file");
+
+    /* The verified data does not depend on the page cache */
+    drop_caches();
+    check_contents(fd, "read listed file after dropping the page cache");
+
+    char* p = mmap(NULL, 7, PROT_READ, MAP_PRIVATE, fd, 0);
+    check(p != MAP_FAILED, "mmap listed file");
+    if (p != MAP_FAILED)
+    {
+        check(memcmp(p, "listed\n", 7) == 0, "contents of mapped file");
+        munmap(p, 7);
+    }
+
+    errno = 0;
+    check(
+        write(fd, "x", 1) < 0 && errno == EBADF,
+        "write to listed file fails with EBADF");
+    close(fd);
+}
+
+static void test_dotdot(void)
+{
+    struct stat root, parent;
+
+    /* The parent of the share is the enclave root, not the host directory
+     * that contains the share */
+    check(stat("/", &root) == 0, "stat /");
+    check(stat(HOST_DIR "/..", &parent) == 0, "stat " HOST_DIR "/..");
+    check(
+        root.st_dev == parent.st_dev && root.st_ino == parent.st_ino,
+        HOST_DIR "/.. is the enclave root");
+
+    check_open_error(HOST_DIR "/../outside.txt", O_RDONLY, ENOENT);
+    check_open_error(HOST_DIR "/../../outside.txt", O_RDONLY, ENOENT);
+}
+
+int main(void)
+{
+    test_listed();
+
+    check_open_error(HOST_DIR "/unlisted.txt", O_RDONLY, EACCES);
+    check_open_error(HOST_DIR "/modified.txt", O_RDONLY, EIO);
+
+    check_open_error(HOST_DIR "/listed.txt", O_WRONLY, EROFS);
+    check_open_error(HOST_DIR "/new.txt", O_WRONLY | O_CREAT, EROFS);
+    errno = 0;
+    check(
+        mkdir(HOST_DIR "/newdir", 0755) < 0 && errno == EROFS,
+        "mkdir fails with EROFS");
+
+    test_dotdot();
+
+    if (failed)
+    {
+        printf("TEST_FAILED\n");
+        return 1;
+    }
+
+    printf("TEST_PASSED\n");
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * udp-pps.c
+ *
+ * Small-packet UDP benchmark. The sender transmits fixed-size datagrams as
+ * fast as it can; the receiver counts the datagrams it gets during the
+ * measurement interval, which starts with the first datagram, and reports
+ * the packet rate.
+ *
+ *   udp-pps send <ip> <port> <size> <seconds>
+ *   udp-pps recv <port> <seconds>
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PKT_SIZE 1472
+#define SOCK_BUF_SIZE (4 * 1024 * 1024)
+
+static void fail(const char* msg)
+{
+    perror(msg);
+    printf("TEST_FAILED\n");
+    exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void report(const char* what, uint64_t pkts, size_t bytes, uint64_t ns)
+{
+    double secs = ns / 1e9;
+    printf(
+        "%s: %lu packets, %lu bytes in %.2f s: %.0f pps, %.2f Mbit/s\n",
+        what,
+        (unsigned long)pkts,
+        (unsigned long)bytes,
+        secs,
+        pkts / secs,
+        bytes * 8 / secs / 1e6);
+}
+
+static int do_send(const char* ip, int port, size_t size, int seconds)
+{
+    char buf[MAX_PKT_SIZE];
+    struct sockaddr_in addr = {0};
+    uint64_t pkts = 0, bytes = 0;
+    int buf_size = SOCK_BUF_SIZE;
+
+    if (size == 0 || size > MAX_PKT_SIZE)
+    {
+        fprintf(stderr, "Packet size must be between 1 and %d\n", MAX_PKT_SIZE);
+        return 1;
+    }
+    memset(buf, 0xa5, size);
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid address: %s\n", ip);
+        return 1;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        fail("socket");
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)))
+        fail("connect");
+
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)seconds * 1000000000UL;
+    uint64_t t = start;
+    while (t < end)
+    {
+        /* Only read the clock every so often to keep the send loop tight */
+        for (int i = 0; i < 64; i++)
+        {
+            ssize_t ret = send(fd, buf, size, 0);
+            if (ret < 0)
+            {
+                /* The receiver may not be up yet, or the queue is full */
+                if (errno == ECONNREFUSED || errno == ENOBUFS ||
+                    errno == EAGAIN)
+                    continue;
+                fail("send");
+            }
+            pkts++;
+            bytes += ret;
+        }
+        t = now_ns();
+    }
+
+    report("sent", pkts, bytes, t - start);
+    close(fd);
+    return 0;
+}
+
+static int do_recv(int port, int seconds)
+{
+    char buf[MAX_PKT_SIZE];
+    struct sockaddr_in addr = {0};
+    struct timeval tv = {.tv_sec = 1};
+    uint64_t pkts = 0, bytes = 0;
+    uint64_t start = 0, end = 0, t = 0;
+    int buf_size = SOCK_BUF_SIZE;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        fail("socket");
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)))
+        fail("bind");
+
+    /* Wait up to a minute for the first packet to start the measurement */
+    for (int i = 0; i < 60 && !start; i++)
+    {
+        ssize_t ret = recv(fd, buf, sizeof(buf), 0);
+        if (ret >= 0)
+        {
+            start = now_ns();
+            end = start + (uint64_t)seconds * 1000000000UL;
+        }
+        else if (errno != EAGAIN && errno != EINTR)
+            fail("recv");
+    }
+    if (!start)
+    {
+        printf("TEST_FAILED (no packets received)\n");
+        return 1;
+    }
+
+    for (t = start; t < end; t = now_ns())
+    {
+        ssize_t ret = recv(fd, buf, sizeof(buf), 0);
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            fail("recv");
+        }
+        pkts++;
+        bytes += ret;
+    }
+
+    report("received", pkts, bytes, t - start);
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 6 && !strcmp(argv[1], "send"))
+        return do_send(argv[2], atoi(argv[3]), atoi(argv[4]), atoi(argv[5]));
+    if (argc == 4 && !strcmp(argv[1], "recv"))
+        return do_recv(atoi(argv[2]), atoi(argv[3]));
+
+    fprintf(
+        stderr,
+        "Usage: %s send <ip> <port> <size> <seconds>\n"
+        "       %s recv <port> <seconds>\n",
+        argv[0],
+        argv[0]);
+    return 1;
+}
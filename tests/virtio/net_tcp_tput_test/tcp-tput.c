@@ -0,0 +1,163 @@
+/*
+ * tcp-tput.c
+ *
+ * Bulk TCP throughput benchmark. The sender connects to the receiver and
+ * writes data as fast as it can for the given number of seconds; the
+ * receiver accepts a single connection, reads until the sender closes it,
+ * and reports the throughput.
+ *
+ *   tcp-tput send <ip> <port> <seconds>
+ *   tcp-tput recv <port>
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUF_SIZE (256 * 1024)
+
+static char buf[BUF_SIZE];
+
+static void fail(const char* msg)
+{
+    perror(msg);
+    printf("TEST_FAILED\n");
+    exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void report(const char* what, uint64_t bytes, uint64_t ns)
+{
+    double secs = ns / 1e9;
+    printf(
+        "%s: %lu bytes in %.2f s: %.2f Gbit/s\n",
+        what,
+        (unsigned long)bytes,
+        secs,
+        bytes * 8 / secs / 1e9);
+}
+
+static int do_send(const char* ip, int port, int seconds)
+{
+    struct sockaddr_in addr = {0};
+    uint64_t bytes = 0;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid address: %s\n", ip);
+        return 1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        fail("socket");
+
+    /* The receiver may not be listening yet */
+    int ret;
+    for (int i = 0; i < 60; i++)
+    {
+        ret = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        if (ret == 0 || (errno != ECONNREFUSED && errno != ENETUNREACH))
+            break;
+        sleep(1);
+    }
+    if (ret)
+        fail("connect");
+
+    memset(buf, 0xa5, sizeof(buf));
+
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)seconds * 1000000000UL;
+    uint64_t t = start;
+    while (t < end)
+    {
+        ssize_t n = write(fd, buf, sizeof(buf));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fail("write");
+        }
+        bytes += n;
+        t = now_ns();
+    }
+
+    report("sent", bytes, t - start);
+    close(fd);
+    return 0;
+}
+
+static int do_recv(int port)
+{
+    struct sockaddr_in addr = {0};
+    uint64_t bytes = 0;
+    int one = 1;
+
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0)
+        fail("socket");
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)))
+        fail("bind");
+    if (listen(lfd, 1))
+        fail("listen");
+
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0)
+        fail("accept");
+
+    uint64_t start = now_ns();
+    for (;;)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n == 0)
+            break;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fail("read");
+        }
+        bytes += n;
+    }
+
+    report("received", bytes, now_ns() - start);
+    close(fd);
+    close(lfd);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 5 && !strcmp(argv[1], "send"))
+        return do_send(argv[2], atoi(argv[3]), atoi(argv[4]));
+    if (argc == 3 && !strcmp(argv[1], "recv"))
+        return do_recv(atoi(argv[2]));
+
+    fprintf(
+        stderr,
+        "Usage: %s send <ip> <port> <seconds>\n"
+        "       %s recv <port>\n",
+        argv[0],
+        argv[0]);
+    return 1;
+}
@@ -0,0 +1,120 @@
+/*
+ * virtq-rtt.c
+ *
+ * Virtqueue round-trip microbenchmark. Issues small direct reads from a file
+ * on a virtio-blk disk one at a time, so that each read is a single request
+ * that travels through the virtqueue to the host and back, and reports the
+ * average and percentile round-trip times.
+ *
+ *   virtq-rtt <file> <block size> <requests>
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ALIGNMENT 4096
+#define WARMUP_REQS 1000
+
+static void fail(const char* msg)
+{
+    perror(msg);
+    printf("TEST_FAILED\n");
+    exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char** argv)
+{
+    struct stat st;
+    uint64_t *rtt, total = 0;
+    size_t block_size;
+    long reqs, num_blocks;
+    void* buf;
+    int fd;
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "usage: %s <file> <block size> <requests>\n", argv[0]);
+        return 1;
+    }
+    block_size = strtoul(argv[2], NULL, 0);
+    reqs = strtol(argv[3], NULL, 0);
+    if (!block_size || block_size % 512 || reqs <= 0)
+    {
+        fprintf(stderr, "invalid block size or number of requests\n");
+        return 1;
+    }
+
+    /* Bypass the page cache so that every read reaches the device */
+    fd = open(argv[1], O_RDONLY | O_DIRECT);
+    if (fd < 0)
+        fail("open");
+    if (fstat(fd, &st))
+        fail("fstat");
+    num_blocks = st.st_size / block_size;
+    if (!num_blocks)
+    {
+        fprintf(stderr, "%s is smaller than a block\n", argv[1]);
+        return 1;
+    }
+
+    if (posix_memalign(&buf, ALIGNMENT, block_size))
+        fail("posix_memalign");
+    rtt = malloc(reqs * sizeof(*rtt));
+    if (!rtt)
+        fail("malloc");
+
+    srand(1);
+    for (long i = -WARMUP_REQS; i < reqs; i++)
+    {
+        off_t offset = (off_t)(rand() % num_blocks) * block_size;
+        uint64_t start = now_ns();
+
+        if (pread(fd, buf, block_size, offset) != (ssize_t)block_size)
+            fail("pread");
+
+        if (i >= 0)
+        {
+            rtt[i] = now_ns() - start;
+            total += rtt[i];
+        }
+    }
+
+    qsort(rtt, reqs, sizeof(*rtt), cmp_u64);
+    printf(
+        "%ld requests of %zu bytes: avg %.2f us, p50 %.2f us, p99 %.2f us, "
+        "max %.2f us\n",
+        reqs,
+        block_size,
+        total / 1e3 / reqs,
+        rtt[reqs / 2] / 1e3,
+        rtt[reqs * 99 / 100] / 1e3,
+        rtt[reqs - 1] / 1e3);
+    printf("TEST_PASSED\n");
+
+    close(fd);
+    free(rtt);
+    free(buf);
+    return 0;
+}
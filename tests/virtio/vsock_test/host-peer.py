@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+#
+# Host side of the vsock test: echoes data on the Unix socket the enclave
+# connects to for port 5000, closes the connection to port 5001 while the
+# enclave is still writing, and connects to port 6000 of the enclave.
+
+import os
+import socket
+import sys
+import threading
+import time
+
+ECHO_PORT = 5000
+CLOSE_PORT = 5001
+LISTEN_PORT = 6000
+TIMEOUT = 60
+
+
+def echo_server(srv):
+    conn, _ = srv.accept()
+    while True:
+        data = conn.recv(65536)
+        if not data:
+            break
+        conn.sendall(data)
+    conn.close()
+    srv.close()
+
+
+def close_server(srv):
+    conn, _ = srv.accept()
+    conn.recv(4096)
+    conn.close()
+    srv.close()
+
+
+def listen(path):
+    if os.path.exists(path):
+        os.unlink(path)
+    srv = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    srv.bind(path)
+    srv.listen(1)
+    return srv
+
+
+def connect_to_enclave(path):
+    deadline = time.time() + TIMEOUT
+    while time.time() < deadline:
+        try:
+            sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            sock.connect(path)
+            sock.sendall(b"CONNECT %d\n" % LISTEN_PORT)
+            line = sock.makefile("rb").readline()
+            if line.startswith(b"OK "):
+                sock.sendall(b"ping")
+                reply = b""
+                while len(reply) < 4:
+                    data = sock.recv(4 - len(reply))
+                    if not data:
+                        break
+                    reply += data
+                return reply == b"pong"
+        except OSError:
+            pass
+        # The launcher or the enclave is not listening yet
+        sock.close()
+        time.sleep(0.5)
+    return False
+
+
+def main():
+    path = sys.argv[1]
+    close_path = "%s_%d" % (path, CLOSE_PORT)
+    echo_path = "%s_%d" % (path, ECHO_PORT)
+
+    # The launcher is started once the echo socket exists
+    srv = listen(close_path)
+    threading.Thread(target=close_server, args=(srv,), daemon=True).start()
+    srv = listen(echo_path)
+    threading.Thread(target=echo_server, args=(srv,), daemon=True).start()
+    ok = connect_to_enclave(path)
+    os.unlink(echo_path)
+    os.unlink(close_path)
+    print("Host vsock peer: %s" % ("ok" if ok else "failed"))
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,170 @@
+/*
+ * vsock-test.c
+ *
+ * Tests vsock connections between the enclave and host processes:
+ *
+ * - Connects to port 5000 of the host and checks that the data it sends is
+ *   echoed back. The data is larger than the buffer space of a connection,
+ *   so that the transfer depends on flow control.
+ * - Connects to port 5001 of the host, which closes the connection while
+ *   the enclave is still writing. The writes must fail with a reset
+ *   connection, and the launcher must survive.
+ * - Listens on port 6000, accepts a connection from the host and answers
+ *   "ping" with "pong".
+ */
+
+#include <errno.h>
+#include <linux/vm_sockets.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define ECHO_PORT 5000
+#define CLOSE_PORT 5001
+#define LISTEN_PORT 6000
+#define ECHO_SIZE (1024 * 1024)
+
+static void fail(const char* msg)
+{
+    perror(msg);
+    printf("TEST_FAILED\n");
+    exit(1);
+}
+
+static void read_all(int fd, char* buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = read(fd, buf, len);
+        if (n <= 0)
+            fail("read");
+        buf += n;
+        len -= n;
+    }
+}
+
+static void test_echo(void)
+{
+    struct sockaddr_vm addr = {
+        .svm_family = AF_VSOCK,
+        .svm_cid = VMADDR_CID_HOST,
+        .svm_port = ECHO_PORT,
+    };
+    char* out = malloc(ECHO_SIZE);
+    char* in = malloc(ECHO_SIZE);
+    size_t sent = 0;
+
+    if (!out || !in)
+        fail("malloc");
+
+    for (size_t i = 0; i < ECHO_SIZE; i++)
+        out[i] = i * 7;
+
+    int fd = socket(AF_VSOCK, SOCK_STREAM, 0);
+    if (fd < 0)
+        fail("socket");
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)))
+        fail("connect");
+
+    /* The echo server writes back what it reads, so read back each chunk
+     * before sending the next one */
+    while (sent < ECHO_SIZE)
+    {
+        size_t len = ECHO_SIZE - sent < 65536 ? ECHO_SIZE - sent : 65536;
+        ssize_t n = write(fd, out + sent, len);
+        if (n <= 0)
+            fail("write");
+        read_all(fd, in + sent, n);
+        sent += n;
+    }
+
+    if (memcmp(in, out, ECHO_SIZE))
+    {
+        printf("Echoed data differs\nTEST_FAILED\n");
+        exit(1);
+    }
+
+    close(fd);
+    free(in);
+    free(out);
+    printf("Echo over vsock ok\n");
+}
+
+static void test_peer_close(void)
+{
+    struct sockaddr_vm addr = {
+        .svm_family = AF_VSOCK,
+        .svm_cid = VMADDR_CID_HOST,
+        .svm_port = CLOSE_PORT,
+    };
+    static char buf[65536];
+    size_t sent = 0;
+    ssize_t n;
+
+    int fd = socket(AF_VSOCK, SOCK_STREAM, 0);
+    if (fd < 0)
+        fail("socket");
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)))
+        fail("connect");
+
+    /* The host reads at most 4 KiB, so the writes must fail long before
+     * this limit */
+    while ((n = send(fd, buf, sizeof(buf), MSG_NOSIGNAL)) > 0)
+    {
+        sent += n;
+        if (sent > 64 * ECHO_SIZE)
+        {
+            printf("Writes did not fail after the host closed\nTEST_FAILED\n");
+            exit(1);
+        }
+    }
+    if (n == 0 || (errno != EPIPE && errno != ECONNRESET))
+        fail("send after the host closed");
+
+    close(fd);
+    printf("Connection closed by host while writing ok\n");
+}
+
+static void test_accept(void)
+{
+    struct sockaddr_vm addr = {
+        .svm_family = AF_VSOCK,
+        .svm_cid = VMADDR_CID_ANY,
+        .svm_port = LISTEN_PORT,
+    };
+    char buf[4];
+
+    int lfd = socket(AF_VSOCK, SOCK_STREAM, 0);
+    if (lfd < 0)
+        fail("socket");
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) || listen(lfd, 1))
+        fail("listen");
+
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0)
+        fail("accept");
+
+    read_all(fd, buf, sizeof(buf));
+    if (memcmp(buf, "ping", sizeof(buf)))
+    {
+        printf("Unexpected message from host\nTEST_FAILED\n");
+        exit(1);
+    }
+    if (write(fd, "pong", 4) != 4)
+        fail("write");
+
+    close(fd);
+    close(lfd);
+    printf("Connection from host over vsock ok\n");
+}
+
+int main(void)
+{
+    test_echo();
+    test_peer_close();
+    test_accept();
+    printf("TEST_PASSED\n");
+    return 0;
+}